@@ -32,7 +32,14 @@ SOURCES += \
     ../Verilog/VlCrossRefModel.cpp \
     ../Verilog/VlProjectFile.cpp \
     ../Verilog/VlProjectConfig.cpp \
-    ../Verilog/VlTokenType.cpp
+    ../Verilog/VlTokenType.cpp \
+    ../Verilog/VlAtoms.cpp \
+    ../Verilog/VlTrace.cpp \
+    ../Verilog/VlIndexFile.cpp \
+    ../Verilog/VlHash.cpp \
+    ../Verilog/VlConstEval.cpp \
+    ../Verilog/VlElaborator.cpp \
+    ../Verilog/VlTokenTable.cpp
 
 HEADERS  += \
     ../Verilog/VlPpSymbols.h \
@@ -47,5 +54,12 @@ HEADERS  += \
     ../Verilog/VlCrossRefModel.h \
     ../Verilog/VlProjectFile.h \
     ../Verilog/VlProjectConfig.h\
-    ../Verilog/VlTokenType.h
+    ../Verilog/VlTokenType.h \
+    ../Verilog/VlAtoms.h \
+    ../Verilog/VlTrace.h \
+    ../Verilog/VlIndexFile.h \
+    ../Verilog/VlHash.h \
+    ../Verilog/VlConstEval.h \
+    ../Verilog/VlElaborator.h \
+    ../Verilog/VlTokenTable.h
 
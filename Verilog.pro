@@ -17,7 +17,7 @@
 #* http://www.gnu.org/copyleft/gpl.html.
 #*/
 
-QT       += core
+QT       += core network
 QT       -= gui
 
 TARGET = Verilog
@@ -25,7 +25,8 @@ TEMPLATE = app
 
 INCLUDEPATH +=  ..
 
-SOURCES += main.cpp
+SOURCES += main.cpp \
+    VlQueryServer.cpp
 
 include( Verilog.pri )
 
@@ -37,9 +38,13 @@ QMAKE_CXXFLAGS += -Wno-reorder -Wno-unused-parameter -Wno-unused-function -Wno-u
 
 #CONFIG += c++11
 
+# compiles in the Chrome trace events, see VlTrace.h
+#DEFINES += VL_ENABLE_TRACE
+
 #include( ../../Libraries/antlr4/antlr4.pri )
 
-HEADERS +=
+HEADERS += \
+    VlQueryServer.h
 
 
 
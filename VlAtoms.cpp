@@ -0,0 +1,141 @@
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Verilog parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "VlAtoms.h"
+#include <QReadWriteLock>
+#include <QVector>
+#include <string.h>
+using namespace Vl;
+
+namespace
+{
+    struct Slot
+    {
+        QByteArray d_str; // null if slot is empty
+        uint d_hash;
+        Slot():d_hash(0) {}
+    };
+
+    struct Table
+    {
+        QReadWriteLock d_lock;
+        QVector<Slot> d_slots; // size is a power of two; open addressing with linear probing
+        int d_count;
+        Table():d_slots(4096),d_count(0) {}
+
+        int lookup( const char* str, int len, uint hash ) const
+        {
+            const int mask = d_slots.size() - 1;
+            int i = hash & mask;
+            while( !d_slots[i].d_str.isNull() )
+            {
+                const Slot& s = d_slots[i];
+                if( s.d_hash == hash && s.d_str.size() == len && ::memcmp( s.d_str.constData(), str, len ) == 0 )
+                    return i;
+                i = ( i + 1 ) & mask;
+            }
+            return i;
+        }
+        void grow()
+        {
+            QVector<Slot> old = d_slots;
+            d_slots = QVector<Slot>( old.size() * 2 );
+            for( int i = 0; i < old.size(); i++ )
+            {
+                if( !old[i].d_str.isNull() )
+                    d_slots[ lookup( old[i].d_str.constData(), old[i].d_str.size(), old[i].d_hash ) ] = old[i];
+            }
+        }
+    };
+}
+
+static Table& table()
+{
+    static Table t;
+    return t;
+}
+
+static inline uint hashOf( const char* str, int len )
+{
+    // FNV-1a
+    uint h = 2166136261u;
+    for( int i = 0; i < len; i++ )
+    {
+        h ^= quint8(str[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+QByteArray Atoms::intern(const char* str, int len)
+{
+    if( len <= 0 )
+        return QByteArray();
+    Table& t = table();
+    const uint h = hashOf( str, len );
+
+    t.d_lock.lockForRead();
+    int i = t.lookup( str, len, h );
+    QByteArray res = t.d_slots[i].d_str;
+    t.d_lock.unlock();
+    if( !res.isNull() )
+        return res;
+
+    t.d_lock.lockForWrite();
+    i = t.lookup( str, len, h ); // someone else could have been faster
+    if( t.d_slots[i].d_str.isNull() )
+    {
+        if( ( t.d_count + 1 ) * 4 > t.d_slots.size() * 3 )
+        {
+            t.grow();
+            i = t.lookup( str, len, h );
+        }
+        t.d_slots[i].d_str = QByteArray( str, len ); // always a deep copy, str could be part of a larger buffer
+        t.d_slots[i].d_hash = h;
+        t.d_count++;
+    }
+    res = t.d_slots[i].d_str;
+    t.d_lock.unlock();
+    return res;
+}
+
+QByteArray Atoms::intern(const QByteArray& str)
+{
+    return intern( str.constData(), str.size() );
+}
+
+QByteArray Atoms::find(const QByteArray& str)
+{
+    if( str.isEmpty() )
+        return QByteArray();
+    Table& t = table();
+    t.d_lock.lockForRead();
+    const QByteArray res = t.d_slots[ t.lookup( str.constData(), str.size(), hashOf( str.constData(), str.size() ) ) ].d_str;
+    t.d_lock.unlock();
+    return res;
+}
+
+int Atoms::count()
+{
+    Table& t = table();
+    t.d_lock.lockForRead();
+    const int res = t.d_count;
+    t.d_lock.unlock();
+    return res;
+}
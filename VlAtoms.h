@@ -0,0 +1,43 @@
+#ifndef VLATOMS_H
+#define VLATOMS_H
+
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Verilog parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QByteArray>
+
+namespace Vl
+{
+    class Atoms
+    {
+        // this class is thread-safe
+        // Global, append-only table of interned identifiers. All QByteArrays returned by intern() for the same
+        // name share the same data, so two atoms are equal iff their constData() pointers are equal.
+        // Atoms are never removed and thus stay valid across model updates.
+    public:
+        static QByteArray intern( const char* str, int len );
+        static QByteArray intern( const QByteArray& str );
+        static QByteArray find( const QByteArray& str ); // returns a null QByteArray if str was never interned
+        static int count();
+    private:
+        Atoms() {}
+    };
+}
+
+#endif // VLATOMS_H
@@ -0,0 +1,1552 @@
+/*
+* Copyright 2018-2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Verilog parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "VlConstEval.h"
+#include "VlSynTree.h"
+#include "VlNumLex.h"
+using namespace Vl;
+
+typedef ConstEval::Value Value;
+
+// Word kernels; n is the number of 64 bit words of each operand and the result
+
+static inline quint64 topMask( quint32 width )
+{
+    return ( width % 64 ) ? ( quint64(1) << ( width % 64 ) ) - 1 : ~quint64(0);
+}
+
+static void addWords( quint64* r, const quint64* x, const quint64* y, int n, quint64 carry )
+{
+    for( int i = 0; i < n; i++ )
+    {
+        const quint64 s = x[i] + y[i];
+        const quint64 c1 = s < x[i];
+        r[i] = s + carry;
+        carry = c1 | ( r[i] < s );
+    }
+}
+
+static void subWords( quint64* r, const quint64* x, const quint64* y, int n )
+{
+    quint64 borrow = 0;
+    for( int i = 0; i < n; i++ )
+    {
+        const quint64 d = x[i] - y[i];
+        const quint64 b1 = x[i] < y[i];
+        r[i] = d - borrow;
+        borrow = b1 | ( d < borrow );
+    }
+}
+
+static void negWords( quint64* r, const quint64* x, int n )
+{
+    quint64 carry = 1;
+    for( int i = 0; i < n; i++ )
+    {
+        r[i] = ~x[i] + carry;
+        carry = carry && r[i] == 0;
+    }
+}
+
+static void mulWords( quint64* r, const quint64* x, const quint64* y, int n )
+{
+    // schoolbook on 32 bit limbs, truncated to n words
+    if( n == 1 )
+    {
+        r[0] = x[0] * y[0];
+        return;
+    }
+    const int m = 2 * n;
+    QVarLengthArray<quint32,8> res(m), xs(m), ys(m);
+    for( int i = 0; i < n; i++ )
+    {
+        xs[2*i] = quint32( x[i] );
+        xs[2*i+1] = quint32( x[i] >> 32 );
+        ys[2*i] = quint32( y[i] );
+        ys[2*i+1] = quint32( y[i] >> 32 );
+    }
+    for( int i = 0; i < m; i++ )
+        res[i] = 0;
+    for( int i = 0; i < m; i++ )
+    {
+        if( xs[i] == 0 )
+            continue;
+        quint64 carry = 0;
+        for( int j = 0; i + j < m; j++ )
+        {
+            const quint64 t = quint64(xs[i]) * ys[j] + res[i+j] + carry;
+            res[i+j] = quint32(t);
+            carry = t >> 32;
+        }
+    }
+    for( int i = 0; i < n; i++ )
+        r[i] = quint64(res[2*i]) | ( quint64(res[2*i+1]) << 32 );
+}
+
+static int cmpWords( const quint64* x, const quint64* y, int n )
+{
+    for( int i = n - 1; i >= 0; i-- )
+    {
+        if( x[i] != y[i] )
+            return x[i] < y[i] ? -1 : 1;
+    }
+    return 0;
+}
+
+static void divWords( quint64* q, quint64* rem, const quint64* x, const quint64* y, int n, quint32 width )
+{
+    // y must not be zero
+    if( n == 1 )
+    {
+        q[0] = x[0] / y[0];
+        rem[0] = x[0] % y[0];
+        return;
+    }
+    for( int i = 0; i < n; i++ )
+        q[i] = rem[i] = 0;
+    for( int bit = int(width) - 1; bit >= 0; bit-- )
+    {
+        // rem = rem << 1 | x[bit]; if a bit is shifted out, rem is certainly >= y and the subtraction wraps
+        // around to the right result
+        const bool out = ( rem[n-1] >> 63 ) != 0;
+        for( int i = n - 1; i > 0; i-- )
+            rem[i] = ( rem[i] << 1 ) | ( rem[i-1] >> 63 );
+        rem[0] = ( rem[0] << 1 ) | ( ( x[bit/64] >> ( bit % 64 ) ) & 1 );
+        if( out || cmpWords( rem, y, n ) >= 0 )
+        {
+            subWords( rem, rem, y, n );
+            q[bit/64] |= quint64(1) << ( bit % 64 );
+        }
+    }
+}
+
+static void shiftLeftWords( quint64* r, const quint64* x, int n, quint64 amount )
+{
+    const quint64 ws = amount / 64;
+    const int bs = amount % 64;
+    for( int i = n - 1; i >= 0; i-- )
+    {
+        quint64 v = 0;
+        if( quint64(i) >= ws )
+        {
+            const int src = i - int(ws);
+            v = x[src] << bs;
+            if( bs && src > 0 )
+                v |= x[src-1] >> ( 64 - bs );
+        }
+        r[i] = v;
+    }
+}
+
+static void shiftRightWords( quint64* r, const quint64* x, int n, quint64 amount, quint64 fill )
+{
+    // fill is 0 or ~0 and already present above the width in x
+    const quint64 ws = amount / 64;
+    const int bs = amount % 64;
+    for( int i = 0; i < n; i++ )
+    {
+        const quint64 src = i + ws;
+        const quint64 lo = src < quint64(n) ? x[src] : fill;
+        const quint64 hi = src + 1 < quint64(n) ? x[src+1] : fill;
+        r[i] = bs ? ( lo >> bs ) | ( hi << ( 64 - bs ) ) : lo;
+    }
+}
+
+Value::Value(quint32 width, bool isSigned, Bit f):d_width(width),d_signed(isSigned)
+{
+    d_words.resize( 2 * words() );
+    fill( 0, f );
+}
+
+void Value::mask()
+{
+    if( d_width == 0 )
+        return;
+    const quint64 m = topMask( d_width );
+    a()[words()-1] &= m;
+    b()[words()-1] &= m;
+}
+
+void Value::fill(quint32 from, Bit f)
+{
+    const quint64 av = ( f == B1 || f == Bx ) ? ~quint64(0) : 0;
+    const quint64 bv = ( f == Bz || f == Bx ) ? ~quint64(0) : 0;
+    const int n = words();
+    for( int i = from / 64; i < n; i++ )
+    {
+        const quint64 m = ( i == int(from / 64) ) ? ~quint64(0) << ( from % 64 ) : ~quint64(0);
+        a()[i] = ( a()[i] & ~m ) | ( av & m );
+        b()[i] = ( b()[i] & ~m ) | ( bv & m );
+    }
+    mask();
+}
+
+Value Value::fromInt(qint64 v, quint32 width, bool isSigned)
+{
+    Value res( width, isSigned, ( isSigned && v < 0 ) ? B1 : B0 );
+    res.a()[0] = quint64(v);
+    res.mask();
+    return res;
+}
+
+Value Value::fromString(const QByteArray& str)
+{
+    if( str.isEmpty() )
+        return Value( 8 ); // "" is the same as 8'b0
+    Value res( str.size() * 8 );
+    for( int i = 0; i < str.size(); i++ )
+    {
+        // the last character is the least significant byte
+        const quint32 pos = ( str.size() - 1 - i ) * 8;
+        res.a()[pos/64] |= quint64(quint8(str[i])) << ( pos % 64 );
+    }
+    return res;
+}
+
+Value Value::fromNumber(const QByteArray& text, QString* error)
+{
+    NumLex lex( text );
+    if( !lex.parse(true) )
+    {
+        if( error )
+            *error = lex.getError();
+        return Value();
+    }
+    if( lex.getKind() == NumLex::Real )
+    {
+        if( error )
+            *error = QLatin1String("real numbers are not supported");
+        return Value();
+    }
+    const QByteArray& val = lex.getVal();
+    // a plain decimal number is signed; a based one only with 's
+    const bool isSigned = lex.hasBaseFormat() ? lex.getSigned() : true;
+    quint32 width = 32;
+    if( lex.hasSize() )
+    {
+        bool ok;
+        width = lex.getSize().toUInt(&ok);
+        if( !ok || width == 0 || width > 0x1000000 )
+        {
+            if( error )
+                *error = QLatin1String("invalid size");
+            return Value();
+        }
+    }
+    if( val.isEmpty() )
+    {
+        if( error )
+            *error = QLatin1String("number without value");
+        return Value();
+    }
+
+    Bit ext = B0; // extension above the digits
+    const char msd = val[0];
+    if( msd == 'x' || msd == 'X' )
+        ext = Bx;
+    else if( msd == 'z' || msd == 'Z' || msd == '?' )
+        ext = Bz;
+
+    if( lex.getKind() == NumLex::Decimal )
+    {
+        if( ext != B0 )
+            return Value( width, isSigned, ext ); // 'dx or 'dz
+        // multiply and add in a buffer which is big enough for all digits (log2(10) < 3.33)
+        const quint32 bits = quint32( val.size() ) * 10 / 3 + 1;
+        Value tmp( qMax( bits, width ) );
+        const int n = tmp.words();
+        for( int i = 0; i < val.size(); i++ )
+        {
+            quint64 carry = quint64( val[i] - '0' );
+            for( int j = 0; j < n; j++ )
+            {
+                // a[j] * 10 + carry with 32 bit halves to stay within 64 bits
+                const quint64 lo = ( tmp.a()[j] & 0xffffffff ) * 10 + carry;
+                const quint64 hi = ( tmp.a()[j] >> 32 ) * 10 + ( lo >> 32 );
+                tmp.a()[j] = ( lo & 0xffffffff ) | ( hi << 32 );
+                carry = hi >> 32;
+            }
+        }
+        tmp.mask();
+        if( !lex.hasSize() )
+        {
+            // unsized numbers have at least 32 bits, more only if the value (and its sign) needs them
+            quint32 used = tmp.d_width;
+            while( used > 0 && tmp.getBit( used - 1 ) == B0 )
+                used--;
+            width = qMax( width, used + ( isSigned ? 1 : 0 ) );
+        }
+        Value res = tmp.resized( width );
+        res.d_signed = isSigned;
+        return res;
+    }
+
+    const int bpd = lex.getKind() == NumLex::Binary ? 1 : lex.getKind() == NumLex::Octal ? 3 : 4;
+    if( !lex.hasSize() )
+        width = qMax( width, quint32( val.size() * bpd ) );
+    Value res( width, isSigned );
+    quint32 pos = 0;
+    for( int i = val.size() - 1; i >= 0 && pos < width; i--, pos += bpd )
+    {
+        const char ch = val[i];
+        quint64 digit;
+        Bit unknown = B0;
+        if( ch == 'x' || ch == 'X' )
+            unknown = Bx;
+        else if( ch == 'z' || ch == 'Z' || ch == '?' )
+            unknown = Bz;
+        else if( ch >= '0' && ch <= '9' )
+            digit = ch - '0';
+        else
+            digit = ( ch | 0x20 ) - 'a' + 10;
+        for( int k = 0; k < bpd && pos + k < width; k++ )
+        {
+            if( unknown != B0 )
+                res.setBit( pos + k, unknown );
+            else if( ( digit >> k ) & 1 )
+                res.setBit( pos + k, B1 );
+        }
+    }
+    if( pos < width && ext != B0 )
+        res.fill( pos, ext );
+    return res;
+}
+
+bool Value::hasUnknown() const
+{
+    for( int i = 0; i < words(); i++ )
+        if( b()[i] )
+            return true;
+    return false;
+}
+
+Value::Bit Value::getBit(quint32 i) const
+{
+    if( i >= d_width )
+        return Bx;
+    const int av = ( a()[i/64] >> ( i % 64 ) ) & 1;
+    const int bv = ( b()[i/64] >> ( i % 64 ) ) & 1;
+    return Bit( av | ( bv << 1 ) ); // matches the order of Bit
+}
+
+void Value::setBit(quint32 i, Bit v)
+{
+    if( i >= d_width )
+        return;
+    const quint64 m = quint64(1) << ( i % 64 );
+    if( v == B1 || v == Bx )
+        a()[i/64] |= m;
+    else
+        a()[i/64] &= ~m;
+    if( v == Bz || v == Bx )
+        b()[i/64] |= m;
+    else
+        b()[i/64] &= ~m;
+}
+
+bool Value::isZero() const
+{
+    for( int i = 0; i < words(); i++ )
+        if( a()[i] )
+            return false;
+    return true;
+}
+
+bool Value::toInt(qint64& res) const
+{
+    if( !isValid() || hasUnknown() )
+        return false;
+    const bool neg = d_signed && getBit( d_width - 1 ) == B1;
+    const quint64 ext = neg ? ~quint64(0) : 0;
+    for( int i = 1; i < words(); i++ )
+    {
+        const quint64 m = ( i == words() - 1 ) ? topMask( d_width ) : ~quint64(0);
+        if( ( a()[i] & m ) != ( ext & m ) )
+            return false;
+    }
+    quint64 v = a()[0];
+    if( d_width < 64 && neg )
+        v |= ~topMask( d_width );
+    if( !d_signed && d_width >= 64 && ( v >> 63 ) )
+        return false; // doesn't fit in qint64
+    res = qint64(v);
+    return true;
+}
+
+Value::Bit Value::truth() const
+{
+    bool unknown = false;
+    for( int i = 0; i < words(); i++ )
+    {
+        if( a()[i] & ~b()[i] )
+            return B1;
+        if( b()[i] )
+            unknown = true;
+    }
+    return unknown ? Bx : B0;
+}
+
+Value Value::resized(quint32 width) const
+{
+    if( width == d_width || width == 0 )
+    {
+        Value res = *this;
+        res.d_width = width == 0 ? d_width : width;
+        return res;
+    }
+    Value res( width, d_signed );
+    const int n = qMin( words(), res.words() );
+    for( int i = 0; i < n; i++ )
+    {
+        res.a()[i] = a()[i];
+        res.b()[i] = b()[i];
+    }
+    if( width > d_width )
+    {
+        // the bits of the top word above the old width are zero
+        if( d_signed && d_width > 0 )
+            res.fill( d_width, getBit( d_width - 1 ) );
+    }else
+        res.mask();
+    return res;
+}
+
+Value Value::withSign(bool s) const
+{
+    Value res = *this;
+    res.d_signed = s;
+    return res;
+}
+
+QByteArray Value::toString() const
+{
+    if( !isValid() )
+        return QByteArray();
+    QByteArray res = QByteArray::number( d_width ) + ( d_signed ? "'s" : "'" );
+    static const char* hex = "0123456789abcdef";
+    if( !hasUnknown() )
+    {
+        res += 'h';
+        const int digits = ( d_width + 3 ) / 4;
+        for( int i = digits - 1; i >= 0; i-- )
+            res += hex[ ( a()[i/16] >> ( ( i % 16 ) * 4 ) ) & 0xf ];
+    }else
+    {
+        res += 'b';
+        static const char* bits = "01zx";
+        for( int i = int(d_width) - 1; i >= 0; i-- )
+            res += bits[ getBit(i) ];
+    }
+    return res;
+}
+
+bool Value::operator==(const Value& rhs) const
+{
+    if( d_width != rhs.d_width || d_signed != rhs.d_signed )
+        return false;
+    for( int i = 0; i < d_words.size(); i++ )
+        if( d_words[i] != rhs.d_words[i] )
+            return false;
+    return true;
+}
+
+ConstEval::ConstEval(const Params* p):d_params(p),d_skip(0)
+{
+}
+
+Value ConstEval::unary(quint16 op, const Value& v)
+{
+    if( !v.isValid() )
+        return Value();
+    const int n = v.words();
+    switch( op )
+    {
+    case Tok_Plus:
+        return v;
+    case Tok_Minus:
+        {
+            if( v.hasUnknown() )
+                return Value( v.d_width, v.d_signed, Value::Bx );
+            Value res( v.d_width, v.d_signed );
+            negWords( res.a(), v.a(), n );
+            res.mask();
+            return res;
+        }
+    case Tok_Tilde:
+        {
+            Value res( v.d_width, v.d_signed );
+            for( int i = 0; i < n; i++ )
+            {
+                res.a()[i] = ~v.a()[i] | v.b()[i]; // x and z become x
+                res.b()[i] = v.b()[i];
+            }
+            res.mask();
+            return res;
+        }
+    case Tok_Bang:
+        {
+            const Value::Bit t = v.truth();
+            return Value( 1, false, t == Value::B1 ? Value::B0 : t == Value::B0 ? Value::B1 : Value::Bx );
+        }
+    case Tok_Amp:
+    case Tok_TildeAmp:
+    case Tok_Bar:
+    case Tok_TildeBar:
+    case Tok_Hat:
+    case Tok_TildeHat:
+    case Tok_HatTilde:
+        {
+            bool zero = false, one = false, unknown = false, parity = false;
+            for( int i = 0; i < n; i++ )
+            {
+                const quint64 m = ( i == n - 1 ) ? topMask( v.d_width ) : ~quint64(0);
+                zero |= ( ~v.a()[i] & ~v.b()[i] & m ) != 0;
+                one |= ( v.a()[i] & ~v.b()[i] ) != 0;
+                unknown |= v.b()[i] != 0;
+                quint64 p = v.a()[i];
+                p ^= p >> 32; p ^= p >> 16; p ^= p >> 8; p ^= p >> 4; p ^= p >> 2; p ^= p >> 1;
+                parity ^= p & 1;
+            }
+            Value::Bit r;
+            if( op == Tok_Amp || op == Tok_TildeAmp )
+                r = zero ? Value::B0 : unknown ? Value::Bx : Value::B1;
+            else if( op == Tok_Bar || op == Tok_TildeBar )
+                r = one ? Value::B1 : unknown ? Value::Bx : Value::B0;
+            else
+                r = unknown ? Value::Bx : parity ? Value::B1 : Value::B0;
+            if( ( op == Tok_TildeAmp || op == Tok_TildeBar || op == Tok_TildeHat || op == Tok_HatTilde ) &&
+                    r != Value::Bx )
+                r = r == Value::B1 ? Value::B0 : Value::B1;
+            return Value( 1, false, r );
+        }
+    default:
+        return Value();
+    }
+}
+
+Value ConstEval::power( const Value& base, const Value& exp )
+{
+    // the result has the size and sign of the base
+    Value res = Value::fromInt( 1, base.getWidth(), base.isSigned() );
+    if( base.hasUnknown() || exp.hasUnknown() )
+        return Value( base.getWidth(), base.isSigned(), Value::Bx );
+    qint64 b;
+    const bool smallBase = base.toInt( b );
+    if( exp.isSigned() && exp.getBit( exp.getWidth() - 1 ) == Value::B1 )
+    {
+        // negative exponent
+        qint64 e = 0;
+        exp.toInt( e );
+        if( smallBase && b == 0 )
+            return Value( base.getWidth(), base.isSigned(), Value::Bx );
+        if( smallBase && b == 1 )
+            return res;
+        if( smallBase && b == -1 && base.isSigned() )
+            return ( e % 2 ) ? base : res;
+        return Value( base.getWidth(), base.isSigned() );
+    }
+    Value sq = base;
+    for( quint32 i = 0; i < exp.getWidth(); i++ )
+    {
+        if( exp.getBit(i) == Value::B1 )
+            res = binary( Tok_Star, res, sq );
+        bool more = false;
+        for( quint32 j = i + 1; j < exp.getWidth() && !more; j++ )
+            more = exp.getBit(j) == Value::B1;
+        if( !more )
+            break;
+        sq = binary( Tok_Star, sq, sq );
+    }
+    return res;
+}
+
+Value ConstEval::shift( quint16 op, const Value& lhs, const Value& rhs )
+{
+    // the result has the size and sign of the lhs; the rhs is unsigned
+    if( rhs.hasUnknown() )
+        return Value( lhs.getWidth(), lhs.isSigned(), Value::Bx );
+    qint64 amount;
+    if( !rhs.withSign(false).toInt( amount ) || amount > qint64(lhs.getWidth()) )
+        amount = lhs.getWidth();
+    Value res( lhs.getWidth(), lhs.isSigned() );
+    const int n = res.words();
+    const quint64* la = lhs.a();
+    const quint64* lb = lhs.b();
+    if( op == Tok_2Lt || op == Tok_3Lt )
+    {
+        shiftLeftWords( res.a(), la, n, amount );
+        shiftLeftWords( res.b(), lb, n, amount );
+    }else
+    {
+        Value::Bit fill = Value::B0;
+        if( op == Tok_3Gt && lhs.isSigned() )
+            fill = lhs.getBit( lhs.getWidth() - 1 );
+        // extend the operand with its fill bits, shift, and cut it back
+        QVarLengthArray<quint64,4> tmpA(n), tmpB(n);
+        for( int i = 0; i < n; i++ )
+        {
+            const quint64 m = ( i == n - 1 ) ? ~topMask( lhs.getWidth() ) : 0;
+            tmpA[i] = la[i] | ( ( fill == Value::B1 || fill == Value::Bx ) ? m : 0 );
+            tmpB[i] = lb[i] | ( ( fill == Value::Bz || fill == Value::Bx ) ? m : 0 );
+        }
+        shiftRightWords( res.a(), tmpA.constData(), n, amount,
+                         ( fill == Value::B1 || fill == Value::Bx ) ? ~quint64(0) : 0 );
+        shiftRightWords( res.b(), tmpB.constData(), n, amount,
+                         ( fill == Value::Bz || fill == Value::Bx ) ? ~quint64(0) : 0 );
+    }
+    res.mask();
+    return res;
+}
+
+Value ConstEval::binary(quint16 op, const Value& lhs, const Value& rhs)
+{
+    if( !lhs.isValid() || !rhs.isValid() )
+        return Value();
+    if( op == Tok_2Star )
+        return power( lhs, rhs );
+    if( op == Tok_2Lt || op == Tok_3Lt || op == Tok_2Gt || op == Tok_3Gt )
+        return shift( op, lhs, rhs );
+    if( op == Tok_2Amp || op == Tok_2Bar )
+    {
+        const Value::Bit l = lhs.truth();
+        const Value::Bit r = rhs.truth();
+        Value::Bit res;
+        if( op == Tok_2Amp )
+            res = ( l == Value::B0 || r == Value::B0 ) ? Value::B0 :
+                  ( l == Value::B1 && r == Value::B1 ) ? Value::B1 : Value::Bx;
+        else
+            res = ( l == Value::B1 || r == Value::B1 ) ? Value::B1 :
+                  ( l == Value::B0 && r == Value::B0 ) ? Value::B0 : Value::Bx;
+        return Value( 1, false, res );
+    }
+
+    // both operands are extended to the common width; signed only if both are signed
+    const bool sgn = lhs.isSigned() && rhs.isSigned();
+    const quint32 w = qMax( lhs.getWidth(), rhs.getWidth() );
+    const Value x = lhs.withSign(sgn).resized(w);
+    const Value y = rhs.withSign(sgn).resized(w);
+    const int n = x.words();
+    const bool unknown = x.hasUnknown() || y.hasUnknown();
+
+    switch( op )
+    {
+    case Tok_Amp:
+    case Tok_Bar:
+    case Tok_Hat:
+    case Tok_HatTilde:
+    case Tok_TildeHat:
+        {
+            Value res( w, sgn );
+            for( int i = 0; i < n; i++ )
+            {
+                const quint64 xa = x.a()[i], xb = x.b()[i], ya = y.a()[i], yb = y.b()[i];
+                const quint64 zero1 = ~xa & ~xb, zero2 = ~ya & ~yb;
+                const quint64 one1 = xa & ~xb, one2 = ya & ~yb;
+                quint64 r1, rx;
+                if( op == Tok_Amp )
+                {
+                    r1 = one1 & one2;
+                    rx = ~( ( zero1 | zero2 ) | r1 );
+                }else if( op == Tok_Bar )
+                {
+                    r1 = one1 | one2;
+                    rx = ~( r1 | ( zero1 & zero2 ) );
+                }else
+                {
+                    rx = xb | yb;
+                    r1 = ( xa ^ ya ) & ~rx;
+                    if( op != Tok_Hat )
+                        r1 = ~r1 & ~rx;
+                }
+                res.a()[i] = r1 | rx;
+                res.b()[i] = rx;
+            }
+            res.mask();
+            return res;
+        }
+    case Tok_3Eq:
+    case Tok_Bang2Eq:
+        {
+            bool same = true;
+            for( int i = 0; i < n && same; i++ )
+                same = x.a()[i] == y.a()[i] && x.b()[i] == y.b()[i];
+            return Value( 1, false, same == ( op == Tok_3Eq ) ? Value::B1 : Value::B0 );
+        }
+    case Tok_2Eq:
+    case Tok_BangEq:
+        {
+            bool differ = false;
+            for( int i = 0; i < n && !differ; i++ )
+                differ = ( ( x.a()[i] ^ y.a()[i] ) & ~x.b()[i] & ~y.b()[i] ) != 0;
+            if( !differ && unknown )
+                return Value( 1, false, Value::Bx );
+            return Value( 1, false, differ == ( op == Tok_BangEq ) ? Value::B1 : Value::B0 );
+        }
+    default:
+        break;
+    }
+
+    if( op == Tok_Lt || op == Tok_Leq || op == Tok_Gt || op == Tok_Geq )
+    {
+        if( unknown )
+            return Value( 1, false, Value::Bx );
+        int cmp;
+        const bool xneg = sgn && x.getBit( w - 1 ) == Value::B1;
+        const bool yneg = sgn && y.getBit( w - 1 ) == Value::B1;
+        if( xneg != yneg )
+            cmp = xneg ? -1 : 1;
+        else
+            cmp = cmpWords( x.a(), y.a(), n ); // two's complement of the same sign compares as unsigned
+        bool res;
+        if( op == Tok_Lt )
+            res = cmp < 0;
+        else if( op == Tok_Leq )
+            res = cmp <= 0;
+        else if( op == Tok_Gt )
+            res = cmp > 0;
+        else
+            res = cmp >= 0;
+        return Value( 1, false, res ? Value::B1 : Value::B0 );
+    }
+
+    // arithmetic
+    if( unknown )
+        return Value( w, sgn, Value::Bx );
+    Value res( w, sgn );
+    switch( op )
+    {
+    case Tok_Plus:
+        addWords( res.a(), x.a(), y.a(), n, 0 );
+        break;
+    case Tok_Minus:
+        subWords( res.a(), x.a(), y.a(), n );
+        break;
+    case Tok_Star:
+        mulWords( res.a(), x.a(), y.a(), n );
+        break;
+    case Tok_Slash:
+    case Tok_Percent:
+        {
+            if( y.isZero() )
+                return Value( w, sgn, Value::Bx );
+            // on magnitudes; the quotient is negative if the signs differ, the remainder has the sign of x
+            const bool xneg = sgn && x.getBit( w - 1 ) == Value::B1;
+            const bool yneg = sgn && y.getBit( w - 1 ) == Value::B1;
+            Value mx = xneg ? unary( Tok_Minus, x ) : x;
+            Value my = yneg ? unary( Tok_Minus, y ) : y;
+            mx.mask(); my.mask();
+            Value q( w ), r( w );
+            divWords( q.a(), r.a(), mx.a(), my.a(), n, w );
+            if( op == Tok_Slash )
+            {
+                res = xneg != yneg ? unary( Tok_Minus, q ) : q;
+            }else
+                res = xneg ? unary( Tok_Minus, r ) : r;
+            res.d_signed = sgn;
+            break;
+        }
+    default:
+        return Value();
+    }
+    res.mask();
+    return res;
+}
+
+Value ConstEval::conditional(const Value& cond, const Value& lhs, const Value& rhs)
+{
+    if( !cond.isValid() || !lhs.isValid() || !rhs.isValid() )
+        return Value();
+    const bool sgn = lhs.isSigned() && rhs.isSigned();
+    const quint32 w = qMax( lhs.getWidth(), rhs.getWidth() );
+    const Value x = lhs.withSign(sgn).resized(w);
+    const Value y = rhs.withSign(sgn).resized(w);
+    switch( cond.truth() )
+    {
+    case Value::B1:
+        return x;
+    case Value::B0:
+        return y;
+    default:
+        break;
+    }
+    // bits which are equal and known in both are kept, all others are x
+    Value res( w, sgn );
+    for( int i = 0; i < res.words(); i++ )
+    {
+        const quint64 same = ~( x.a()[i] ^ y.a()[i] ) & ~x.b()[i] & ~y.b()[i];
+        res.a()[i] = ( x.a()[i] & same ) | ~same;
+        res.b()[i] = ~same;
+    }
+    res.mask();
+    return res;
+}
+
+Value ConstEval::concat(const QList<Value>& parts)
+{
+    quint32 w = 0;
+    foreach( const Value& v, parts )
+    {
+        if( !v.isValid() )
+            return Value();
+        w += v.getWidth();
+    }
+    if( w == 0 )
+        return Value();
+    Value res( w );
+    quint32 pos = 0;
+    for( int i = parts.size() - 1; i >= 0; i-- )
+    {
+        const Value& v = parts[i];
+        for( quint32 j = 0; j < v.getWidth(); j++ )
+        {
+            const Value::Bit bit = v.getBit(j);
+            if( bit != Value::B0 )
+                res.setBit( pos + j, bit );
+        }
+        pos += v.getWidth();
+    }
+    return res;
+}
+
+Value ConstEval::replicate(quint32 count, const Value& v)
+{
+    if( count == 0 || !v.isValid() )
+        return Value();
+    QList<Value> parts;
+    for( quint32 i = 0; i < count; i++ )
+        parts.append( v.withSign(false) );
+    return concat( parts );
+}
+
+Value ConstEval::select(const Value& v, qint64 lsb, quint32 width)
+{
+    if( !v.isValid() || width == 0 )
+        return Value();
+    Value res( width );
+    for( quint32 i = 0; i < width; i++ )
+    {
+        const qint64 pos = lsb + i;
+        res.setBit( i, ( pos < 0 || pos >= qint64(v.getWidth()) ) ? Value::Bx : v.getBit( pos ) );
+    }
+    return res;
+}
+
+static inline bool isTransparent( const SynTree* st )
+{
+    // attributes and macro usages can appear everywhere in the tree
+    return st->d_tok.d_type == Tok_Attribute || st->d_tok.d_type == Tok_MacroUsage || st->d_tok.d_prePp;
+}
+
+static int precedence( quint16 op )
+{
+    switch( op )
+    {
+    case Tok_2Star:
+        return 12;
+    case Tok_Star:
+    case Tok_Slash:
+    case Tok_Percent:
+        return 11;
+    case Tok_Plus:
+    case Tok_Minus:
+        return 10;
+    case Tok_2Lt:
+    case Tok_2Gt:
+    case Tok_3Lt:
+    case Tok_3Gt:
+        return 9;
+    case Tok_Lt:
+    case Tok_Leq:
+    case Tok_Gt:
+    case Tok_Geq:
+        return 8;
+    case Tok_2Eq:
+    case Tok_BangEq:
+    case Tok_3Eq:
+    case Tok_Bang2Eq:
+        return 7;
+    case Tok_Amp:
+        return 6;
+    case Tok_Hat:
+    case Tok_HatTilde:
+    case Tok_TildeHat:
+        return 5;
+    case Tok_Bar:
+        return 4;
+    case Tok_2Amp:
+        return 3;
+    case Tok_2Bar:
+        return 2;
+    case Tok_Qmark:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+void ConstEval::flatten(const SynTree* expr, Operands& ops)
+{
+    // expression ::= [ unary_operator ] primary expression_nlr_; the grammar is right recursive without
+    // precedence, so the operands and operators are collected in a flat list and build() applies the precedence
+    Operand o;
+    const SynTree* nlr = 0;
+    foreach( const SynTree* sub, expr->d_children )
+    {
+        if( isTransparent(sub) )
+            continue;
+        switch( sub->d_tok.d_type )
+        {
+        case SynTree::R_unary_operator:
+            o.d_unary = sub;
+            break;
+        case SynTree::R_primary:
+            o.d_primary = sub;
+            break;
+        case SynTree::R_expression_nlr_:
+            nlr = sub;
+            break;
+        }
+    }
+    ops.append( o );
+    if( nlr )
+        flattenNlr( nlr, ops );
+}
+
+void ConstEval::flattenNlr(const SynTree* nlr, Operands& ops)
+{
+    // expression_nlr_ ::= [ binary_operator expression expression_nlr_ | '?' expression2 ':' expression3 expression_nlr_ ]
+    const SynTree* next = 0;
+    foreach( const SynTree* sub, nlr->d_children )
+    {
+        if( isTransparent(sub) )
+            continue;
+        switch( sub->d_tok.d_type )
+        {
+        case SynTree::R_binary_operator:
+            foreach( const SynTree* t, sub->d_children )
+                if( !isTransparent(t) )
+                    ops[ops.size()-1].d_op = t->d_tok.d_type;
+            break;
+        case Tok_Qmark:
+            ops[ops.size()-1].d_op = Tok_Qmark;
+            break;
+        case SynTree::R_expression2:
+            ops[ops.size()-1].d_then = sub;
+            break;
+        case SynTree::R_expression:
+            flatten( sub, ops );
+            break;
+        case SynTree::R_expression3:
+            foreach( const SynTree* e, sub->d_children )
+                if( e->d_tok.d_type == SynTree::R_expression )
+                    flatten( e, ops );
+            break;
+        case SynTree::R_expression_nlr_:
+            next = sub;
+            break;
+        }
+    }
+    if( next )
+        flattenNlr( next, ops );
+}
+
+Value ConstEval::widen(const Value& v, quint32 width, bool sgn)
+{
+    // extended with the sign of the operation, not of the operand, e.g. -4'sd1 + 4'd1 is unsigned
+    if( !v.isValid() || width <= v.getWidth() )
+        return v;
+    return v.withSign( sgn ).resized( width ).withSign( v.isSigned() );
+}
+
+int ConstEval::build(const Operands& ops, int& pos, int minPrec, Nodes& nodes)
+{
+    Node leaf;
+    leaf.d_leaf = &ops[pos];
+    nodes.append( leaf );
+    int lhs = nodes.size() - 1;
+    while( pos < ops.size() )
+    {
+        const Operand& cur = ops[pos];
+        const int prec = precedence( cur.d_op );
+        if( cur.d_op == 0 || prec < minPrec )
+            break;
+        pos++;
+        if( pos >= ops.size() )
+        {
+            error( cur.d_primary, QLatin1String("operand missing") );
+            return -1;
+        }
+        // ?: is right associative, all others left associative
+        const int rhs = build( ops, pos, cur.d_op == Tok_Qmark ? prec : prec + 1, nodes );
+        if( rhs == -1 )
+            return -1;
+        Node n;
+        n.d_op = cur.d_op;
+        n.d_lhs = lhs;
+        n.d_rhs = rhs;
+        n.d_then = cur.d_then;
+        nodes.append( n );
+        lhs = nodes.size() - 1;
+    }
+    return lhs;
+}
+
+Value ConstEval::evalNode(Nodes& nodes, int i, quint32 width)
+{
+    if( d_skip )
+        return Value(1);
+    // the self-determined value is needed anyway to know the width of the operation above; a context which is
+    // not wider gives the same value
+    if( !nodes[i].d_hasSelf )
+    {
+        nodes[i].d_self = nodes[i].d_leaf ? evalLeaf( *nodes[i].d_leaf, 0 ) : evalOperation( nodes, i, 0 );
+        nodes[i].d_hasSelf = true;
+    }
+    const Value& self = nodes[i].d_self;
+    if( !self.isValid() || width <= self.getWidth() )
+        return self;
+    return nodes[i].d_leaf ? evalLeaf( *nodes[i].d_leaf, width ) : evalOperation( nodes, i, width );
+}
+
+Value ConstEval::evalOperation(Nodes& nodes, int i, quint32 width)
+{
+    const quint16 op = nodes[i].d_op;
+    const int l = nodes[i].d_lhs;
+    const int r = nodes[i].d_rhs;
+    switch( op )
+    {
+    case Tok_Qmark:
+        {
+            // the condition is self-determined; only the selected branch is evaluated if the condition is known
+            const Value cond = evalNode( nodes, l, 0 );
+            if( !cond.isValid() )
+                return Value();
+            const Value::Bit t = cond.truth();
+            if( t == Value::B0 )
+                d_skip++;
+            Value then = eval( nodes[i].d_then );
+            if( t == Value::B0 )
+                d_skip--;
+            if( t == Value::B1 )
+                d_skip++;
+            Value other = evalNode( nodes, r, 0 );
+            if( t == Value::B1 )
+                d_skip--;
+            // a skipped branch is Value(1) and doesn't add to the width
+            const quint32 w = qMax( width, qMax( then.getWidth(), other.getWidth() ) );
+            if( t != Value::B0 && w > then.getWidth() )
+                then = eval( nodes[i].d_then, w );
+            if( t != Value::B1 )
+                other = evalNode( nodes, r, w );
+            return conditional( cond, then, other );
+        }
+    case Tok_2Amp:
+    case Tok_2Bar:
+        {
+            // self-determined; the rhs is skipped if the lhs decides
+            const Value lhs = evalNode( nodes, l, 0 );
+            if( !lhs.isValid() )
+                return Value();
+            if( ( op == Tok_2Amp && lhs.truth() == Value::B0 ) || ( op == Tok_2Bar && lhs.truth() == Value::B1 ) )
+                return Value( 1, false, op == Tok_2Amp ? Value::B0 : Value::B1 );
+            return binary( op, lhs, evalNode( nodes, r, 0 ) );
+        }
+    case Tok_2Lt:
+    case Tok_2Gt:
+    case Tok_3Lt:
+    case Tok_3Gt:
+    case Tok_2Star:
+        {
+            // the shift amount and the exponent are self-determined
+            const Value rhs = evalNode( nodes, r, 0 );
+            const Value lhs = evalNode( nodes, l, width );
+            return binary( op, widen( lhs, width, lhs.isSigned() ), rhs );
+        }
+    case Tok_Lt:
+    case Tok_Leq:
+    case Tok_Gt:
+    case Tok_Geq:
+    case Tok_2Eq:
+    case Tok_BangEq:
+    case Tok_3Eq:
+    case Tok_Bang2Eq:
+        {
+            // the operands are sized to the wider of the two, not to the context
+            const quint32 w = qMax( evalNode( nodes, l, 0 ).getWidth(), evalNode( nodes, r, 0 ).getWidth() );
+            return binary( op, evalNode( nodes, l, w ), evalNode( nodes, r, w ) );
+        }
+    default:
+        {
+            // arithmetic and bitwise operators
+            const quint32 w = qMax( width, qMax( evalNode( nodes, l, 0 ).getWidth(),
+                                                 evalNode( nodes, r, 0 ).getWidth() ) );
+            const Value lhs = evalNode( nodes, l, w );
+            const Value rhs = evalNode( nodes, r, w );
+            const bool sgn = lhs.isSigned() && rhs.isSigned();
+            return binary( op, widen( lhs, w, sgn ), widen( rhs, w, sgn ) );
+        }
+    }
+}
+
+Value ConstEval::evalLeaf(const Operand& o, quint32 width)
+{
+    // unary + - ~ are context-determined, ! and the reduction operators self-determined
+    bool inContext = true;
+    if( o.d_unary )
+    {
+        foreach( const SynTree* t, o.d_unary->d_children )
+        {
+            if( !isTransparent(t) && t->d_tok.d_type != Tok_Plus && t->d_tok.d_type != Tok_Minus &&
+                    t->d_tok.d_type != Tok_Tilde )
+                inContext = false;
+        }
+    }
+    Value v = evalPrimary( o.d_primary, inContext ? width : 0 );
+    if( o.d_unary )
+    {
+        if( inContext )
+            v = widen( v, width, v.isSigned() );
+        foreach( const SynTree* t, o.d_unary->d_children )
+            if( !isTransparent(t) )
+                v = unary( t->d_tok.d_type, v );
+    }
+    return v;
+}
+
+Value ConstEval::eval(const SynTree* st, quint32 width)
+{
+    if( d_skip )
+        return Value(1);
+    if( st == 0 )
+        return Value();
+    switch( st->d_tok.d_type )
+    {
+    case SynTree::R_expression:
+        return evalExpression( st, width );
+    case SynTree::R_primary:
+        return evalPrimary( st, width );
+    case SynTree::R_number:
+        return evalNumber( st );
+    case Tok_Str:
+        return Value::fromString( st->d_tok.d_val );
+    case SynTree::R_mintypmax_expression:
+    case SynTree::R_constant_mintypmax_expression:
+        {
+            // min:typ:max; the typical value is used
+            QList<const SynTree*> exprs;
+            foreach( const SynTree* sub, st->d_children )
+                if( sub->d_tok.d_type > SynTree::R_First && !isTransparent(sub) )
+                    exprs.append( sub );
+            if( exprs.size() == 3 )
+                return eval( exprs[1], width );
+            else if( exprs.size() == 1 )
+                return eval( exprs[0], width );
+            break;
+        }
+    default:
+        {
+            // wrappers like constant_expression or expression2
+            const SynTree* single = 0;
+            int count = 0;
+            foreach( const SynTree* sub, st->d_children )
+            {
+                if( !isTransparent(sub) )
+                {
+                    single = sub;
+                    count++;
+                }
+            }
+            if( count == 1 && single->d_tok.d_type > SynTree::R_First )
+                return eval( single, width );
+        }
+        break;
+    }
+    return error( st, QString("cannot evaluate %1").arg( SynTree::rToStr( st->d_tok.d_type ) ) );
+}
+
+Value ConstEval::evalExpression(const SynTree* expr, quint32 width)
+{
+    Operands ops;
+    flatten( expr, ops );
+    Nodes nodes;
+    int pos = 0;
+    const int root = build( ops, pos, 1, nodes );
+    if( root == -1 )
+        return Value();
+    return evalNode( nodes, root, width );
+}
+
+Value ConstEval::evalPrimary(const SynTree* primary, quint32 width)
+{
+    // only a parenthesized expression is in the context; selects, concatenations and function arguments are
+    // self-determined
+    if( d_skip )
+        return Value(1);
+    if( primary == 0 )
+        return Value();
+    foreach( const SynTree* sub, primary->d_children )
+    {
+        if( isTransparent(sub) )
+            continue;
+        switch( sub->d_tok.d_type )
+        {
+        case SynTree::R_number:
+            return evalNumber( sub );
+        case SynTree::R_rvalue_or_function_call_:
+            return evalName( sub );
+        case SynTree::R_single_or_multiple_concatenation_:
+            return evalConcat( sub );
+        case SynTree::R_system_function_call:
+            return evalSysCall( sub );
+        case SynTree::R_mintypmax_expression:
+            return eval( sub, width ); // '(' mintypmax_expression ')'
+        case Tok_Str:
+            return Value::fromString( sub->d_tok.d_val );
+        default:
+            break;
+        }
+    }
+    return error( primary, QLatin1String("unsupported primary") );
+}
+
+Value ConstEval::evalNumber(const SynTree* number)
+{
+    QByteArray str;
+    foreach( const SynTree* child, number->d_children )
+    {
+        if( !child->d_tok.d_prePp )
+            str += child->d_tok.d_val;
+    }
+    QString msg;
+    const Value res = Value::fromNumber( str, &msg );
+    if( !res.isValid() )
+        return error( number, msg );
+    return res;
+}
+
+Value ConstEval::evalName(const SynTree* rvalue)
+{
+    // rvalue_or_function_call_ ::= hierarchical_identifier [ { '[' range_expression ']' } | '(' expression... ')' ]
+    const SynTree* id = 0;
+    QList<const SynTree*> selects;
+    foreach( const SynTree* sub, rvalue->d_children )
+    {
+        if( isTransparent(sub) )
+            continue;
+        if( sub->d_tok.d_type == SynTree::R_hierarchical_identifier )
+        {
+            foreach( const SynTree* part, sub->d_children )
+            {
+                if( part->d_tok.d_type == Tok_Dot )
+                    return error( rvalue, QLatin1String("hierarchical names are not supported") );
+                else if( part->d_tok.d_type == Tok_Ident )
+                    id = part;
+                else if( part->d_tok.d_type == SynTree::R_range_expression )
+                    selects.append( part );
+            }
+        }else if( sub->d_tok.d_type == Tok_Lpar )
+            return error( rvalue, QLatin1String("function calls are not supported") );
+        else if( sub->d_tok.d_type == SynTree::R_range_expression )
+            selects.append( sub );
+    }
+    if( id == 0 )
+        return error( rvalue, QLatin1String("identifier expected") );
+    if( d_params == 0 || !d_params->contains( id->d_tok.d_val ) )
+        return error( id, QString("unknown parameter '%1'").arg( id->d_tok.d_val.constData() ) );
+    Value res = d_params->value( id->d_tok.d_val );
+    foreach( const SynTree* sel, selects )
+        res = applySelect( res, sel );
+    return res;
+}
+
+bool ConstEval::evalInt(const SynTree* st, qint64& res)
+{
+    const Value v = eval( st );
+    if( d_skip )
+    {
+        res = 0;
+        return true;
+    }
+    if( !v.isValid() )
+        return false;
+    if( !v.toInt( res ) )
+    {
+        error( st, QLatin1String("expecting a known integer value") );
+        return false;
+    }
+    return true;
+}
+
+Value ConstEval::applySelect(const Value& v, const SynTree* range)
+{
+    // range_expression ::= expression [ ( ':' | '+:' | '-:' ) constant_expression ]
+    // the declared range of parameters is not known, so [width-1:0] is assumed
+    const SynTree* first = 0;
+    const SynTree* second = 0;
+    quint16 kind = 0;
+    foreach( const SynTree* sub, range->d_children )
+    {
+        if( isTransparent(sub) )
+            continue;
+        if( sub->d_tok.d_type == Tok_Colon || sub->d_tok.d_type == Tok_PlusColon ||
+                sub->d_tok.d_type == Tok_MinusColon )
+            kind = sub->d_tok.d_type;
+        else if( first == 0 )
+            first = sub;
+        else
+            second = sub;
+    }
+    if( first == 0 || ( kind != 0 && second == 0 ) )
+        return error( range, QLatin1String("invalid select") );
+    if( kind == 0 )
+    {
+        const Value idx = eval( first );
+        if( !idx.isValid() )
+            return Value();
+        qint64 i;
+        if( !idx.toInt( i ) )
+            return Value( 1, false, Value::Bx );
+        return select( v, i, 1 );
+    }
+    qint64 a, b;
+    if( !evalInt( first, a ) || !evalInt( second, b ) )
+        return Value();
+    if( kind == Tok_Colon )
+        return select( v, qMin( a, b ), quint32( qAbs( a - b ) + 1 ) );
+    if( b <= 0 )
+        return error( range, QLatin1String("invalid width of part select") );
+    if( kind == Tok_PlusColon )
+        return select( v, a, quint32(b) );
+    else
+        return select( v, a - b + 1, quint32(b) );
+}
+
+Value ConstEval::evalConcat(const SynTree* st)
+{
+    // '{' expression ( { ',' expression } | '{' expression { ',' expression } '}' ) '}'
+    QList<const SynTree*> outer, inner;
+    int depth = 0;
+    foreach( const SynTree* sub, st->d_children )
+    {
+        if( isTransparent(sub) )
+            continue;
+        if( sub->d_tok.d_type == Tok_Lbrace )
+            depth++;
+        else if( sub->d_tok.d_type == SynTree::R_expression )
+            ( depth > 1 ? inner : outer ).append( sub );
+    }
+    if( depth > 1 )
+    {
+        // replication; outer holds the count
+        qint64 count;
+        if( outer.size() != 1 || !evalInt( outer.first(), count ) )
+            return Value();
+        if( count <= 0 || count > 0x100000 )
+            return error( st, QLatin1String("invalid replication count") );
+        QList<Value> parts;
+        foreach( const SynTree* e, inner )
+            parts.append( eval( e ) );
+        return d_skip ? Value(1) : replicate( quint32(count), concat( parts ) );
+    }
+    QList<Value> parts;
+    foreach( const SynTree* e, outer )
+        parts.append( eval( e ) );
+    return d_skip ? Value(1) : concat( parts );
+}
+
+Value ConstEval::evalSysCall(const SynTree* st)
+{
+    QByteArray name;
+    QList<const SynTree*> args;
+    foreach( const SynTree* sub, st->d_children )
+    {
+        if( isTransparent(sub) )
+            continue;
+        if( sub->d_tok.d_type == Tok_SysName )
+            name = sub->d_tok.d_val;
+        else if( sub->d_tok.d_type == SynTree::R_expression )
+            args.append( sub );
+    }
+    if( args.size() != 1 )
+        return error( st, QString("unsupported system function %1").arg( name.constData() ) );
+    const Value arg = eval( args.first() );
+    if( !arg.isValid() )
+        return Value();
+    if( name == "$signed" )
+        return arg.withSign(true);
+    if( name == "$unsigned" )
+        return arg.withSign(false);
+    if( name == "$clog2" )
+    {
+        // ceil(log2(arg)), with the argument treated as unsigned
+        if( arg.hasUnknown() )
+            return Value( 32, true, Value::Bx );
+        const Value one = Value::fromInt( 1, arg.getWidth(), false );
+        const Value n = binary( Tok_Minus, arg.withSign(false), one );
+        if( arg.withSign(false).isZero() )
+            return Value::fromInt( 0 );
+        qint64 bits = 0;
+        for( qint64 i = n.getWidth() - 1; i >= 0; i-- )
+        {
+            if( n.getBit( i ) == Value::B1 )
+            {
+                bits = i + 1;
+                break;
+            }
+        }
+        return Value::fromInt( bits );
+    }
+    return error( st, QString("unsupported system function %1").arg( name.constData() ) );
+}
+
+Value ConstEval::error(const SynTree* st, const QString& msg)
+{
+    if( d_skip )
+        return Value(1);
+    if( d_error.isEmpty() && st )
+    {
+        d_error = msg;
+        d_errorPos = st->d_tok;
+    }
+    return Value();
+}
+
+bool ConstEval::evalParams(const SynTree* st, Params& params)
+{
+    const quint16 type = st->d_tok.d_type;
+    if( type == SynTree::R_function_declaration || type == SynTree::R_task_declaration ||
+            type == SynTree::R_loop_generate_construct || type == SynTree::R_conditional_generate_construct ||
+            type == SynTree::R_case_generate_construct )
+        return true;
+    if( type != SynTree::R_parameter_declaration && type != SynTree::R_local_parameter_declaration )
+    {
+        bool ok = true;
+        foreach( const SynTree* sub, st->d_children )
+        {
+            if( sub->d_tok.d_type > SynTree::R_First )
+                ok = evalParams( sub, params ) && ok;
+        }
+        return ok;
+    }
+
+    const bool local = type == SynTree::R_local_parameter_declaration;
+    bool sgn = false;
+    quint32 width = 0;
+    ConstEval ev( &params );
+    bool ok = ev.evalParamType( st, width, sgn );
+    Params::const_iterator old;
+    const SynTree* list = 0;
+    foreach( const SynTree* sub, st->d_children )
+    {
+        if( sub->d_tok.d_type == SynTree::R_list_of_param_assignments )
+            list = sub;
+    }
+    if( list == 0 )
+        return false;
+    foreach( const SynTree* pa, list->d_children )
+    {
+        if( pa->d_tok.d_type != SynTree::R_param_assignment )
+            continue;
+        const SynTree* id = 0;
+        const SynTree* expr = 0;
+        foreach( const SynTree* sub, pa->d_children )
+        {
+            if( sub->d_tok.d_type == Tok_Ident )
+                id = sub;
+            else if( sub->d_tok.d_type > SynTree::R_First )
+                expr = sub;
+        }
+        if( id == 0 || expr == 0 )
+            continue;
+        Value v;
+        if( !local && ( old = params.find( id->d_tok.d_val ) ) != params.end() )
+            v = old.value();
+        else
+            v = ev.eval( expr, width ); // the declared type is the context of the value
+        if( !v.isValid() || !ok )
+        {
+            if( d_error.isEmpty() )
+            {
+                d_error = ev.getError().isEmpty() ? QString("cannot evaluate parameter '%1'").
+                                                    arg( id->d_tok.d_val.constData() ) : ev.getError();
+                d_errorPos = ev.getError().isEmpty() ? id->d_tok : ev.getErrorPos();
+            }
+            params.remove( id->d_tok.d_val );
+            ok = false;
+            continue;
+        }
+        params.insert( id->d_tok.d_val, toParamType( v, width, sgn ) );
+    }
+    return ok;
+}
+
+bool ConstEval::evalParamType(const SynTree* st, quint32& width, bool& sgn)
+{
+    // [ signed ] [ range ] list_of_param_assignments | parameter_type list_of_param_assignments
+    sgn = false;
+    width = 0; // 0: the width of the value
+    bool ok = true;
+    foreach( const SynTree* sub, st->d_children )
+    {
+        switch( sub->d_tok.d_type )
+        {
+        case Tok_signed:
+            sgn = true;
+            break;
+        case SynTree::R_range:
+            {
+                QList<const SynTree*> bounds;
+                foreach( const SynTree* b, sub->d_children )
+                    if( b->d_tok.d_type > SynTree::R_First )
+                        bounds.append( b );
+                qint64 msb, lsb;
+                if( bounds.size() != 2 || !evalInt( bounds[0], msb ) || !evalInt( bounds[1], lsb ) )
+                    ok = false;
+                else
+                    width = quint32( qAbs( msb - lsb ) + 1 );
+            }
+            break;
+        case SynTree::R_parameter_type:
+            foreach( const SynTree* t, sub->d_children )
+            {
+                if( t->d_tok.d_type == Tok_integer )
+                {
+                    width = 32;
+                    sgn = true;
+                }else if( t->d_tok.d_type == Tok_time )
+                    width = 64;
+                else
+                    ok = false; // real and realtime
+            }
+            break;
+        }
+    }
+    return ok;
+}
+
+ConstEval::Value ConstEval::toParamType(const Value& v, quint32 width, bool sgn)
+{
+    // the declared type wins; without one, signed only changes the sign
+    if( width != 0 )
+        return v.resized( width ).withSign( sgn ); // extended with the sign of the value itself
+    else if( sgn )
+        return v.withSign( true );
+    else
+        return v;
+}
@@ -0,0 +1,159 @@
+#ifndef VLCONSTEVAL_H
+#define VLCONSTEVAL_H
+
+/*
+* Copyright 2018-2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Verilog parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QHash>
+#include <QVarLengthArray>
+#include <Verilog/VlToken.h>
+
+namespace Vl
+{
+    struct SynTree;
+
+    class ConstEval
+    {
+        // this class is reentrant
+        // Evaluates constant expressions of a SynTree (R_constant_expression, R_expression, R_range etc.) to
+        // 4-state values of arbitrary width. The operands are sized like IEEE 1364 5.4: the operands of arithmetic,
+        // bitwise, shift (lhs only) and ?: operators are extended to the max of the context width and the widest
+        // operand before the operation; comparisons use the widest of their operands; all others are
+        // self-determined. The sign is still taken from the operands of each operation.
+        // Supported are numbers, strings, parameters incl. bit and part selects, all unary and binary operators,
+        // ?:, concatenation, replication and $clog2, $signed, $unsigned. Not supported are real numbers,
+        // constant function calls and hierarchical names.
+    public:
+        class Value
+        {
+            // Two planes of 64 bit words like aval/bval of the VPI: 0 = (0,0), 1 = (1,0), z = (0,1), x = (1,1).
+            // Values up to 64 bits don't allocate.
+        public:
+            enum Bit { B0, B1, Bz, Bx };
+
+            Value():d_width(0),d_signed(false) {}
+            explicit Value( quint32 width, bool isSigned = false, Bit fill = B0 );
+            static Value fromInt( qint64, quint32 width = 32, bool isSigned = true );
+            static Value fromString( const QByteArray& ); // eight bits per character
+            static Value fromNumber( const QByteArray& text, QString* error = 0 ); // invalid value on error
+
+            bool isValid() const { return d_width != 0; }
+            quint32 getWidth() const { return d_width; }
+            bool isSigned() const { return d_signed; }
+            bool hasUnknown() const; // any x or z bits
+            Bit getBit( quint32 ) const;
+            void setBit( quint32, Bit );
+            bool toInt( qint64& ) const; // false if there are unknown bits or the value doesn't fit
+            Bit truth() const; // B1 if any bit is 1, B0 if all bits are 0, Bx otherwise
+            Value resized( quint32 width ) const; // truncated or extended according to the sign
+            Value withSign( bool ) const;
+            QByteArray toString() const; // canonical form, e.g. 8'h7f, 32'sh10, 4'b10xz; usable as key
+            bool operator==( const Value& ) const; // same width, sign and bits
+            bool operator!=( const Value& rhs ) const { return !( *this == rhs ); }
+        private:
+            friend class ConstEval;
+            int words() const { return ( d_width + 63 ) / 64; }
+            quint64* a() { return d_words.data(); }
+            quint64* b() { return d_words.data() + words(); }
+            const quint64* a() const { return d_words.data(); }
+            const quint64* b() const { return d_words.data() + words(); }
+            void mask(); // clears the bits above d_width
+            void fill( quint32 from, Bit );
+            bool isZero() const; // only for known values
+            QVarLengthArray<quint64,2> d_words; // a plane, then b plane
+            quint32 d_width;
+            bool d_signed;
+        };
+        typedef QHash<QByteArray,Value> Params; // parameter name -> value
+
+        explicit ConstEval( const Params* = 0 );
+        void setParams( const Params* p ) { d_params = p; }
+
+        // An invalid Value on error, see getError; width is the context width, e.g. of the declared type of a
+        // parameter, 0 for a self-determined expression
+        Value eval( const SynTree*, quint32 width = 0 );
+        // Evaluates the parameter and localparam declarations below the given node (usually a module_declaration)
+        // in order of appearance and stores their values in params. An entry of a parameter which is already in
+        // params is an override and only converted to the declared type. Declarations in functions, tasks and
+        // generate constructs are skipped. Returns false if a declaration could not be evaluated.
+        bool evalParams( const SynTree*, Params& params );
+        // The declared type of a parameter_declaration or local_parameter_declaration; width 0 is the width of the
+        // value. Returns false if the range cannot be evaluated or the type is real.
+        bool evalParamType( const SynTree*, quint32& width, bool& sgn );
+        static Value toParamType( const Value&, quint32 width, bool sgn );
+
+        const QString& getError() const { return d_error; }
+        const Token& getErrorPos() const { return d_errorPos; }
+
+        // The operations on values; op is the TokenType of the operator
+        static Value unary( quint16 op, const Value& );
+        static Value binary( quint16 op, const Value&, const Value& );
+        static Value conditional( const Value& cond, const Value& lhs, const Value& rhs );
+        static Value concat( const QList<Value>& ); // first is most significant
+        static Value replicate( quint32 count, const Value& );
+        static Value select( const Value&, qint64 lsb, quint32 width ); // out of range bits are x
+    protected:
+        struct Operand
+        {
+            const SynTree* d_unary;
+            const SynTree* d_primary;
+            quint16 d_op; // binary operator following the operand, 0 if none
+            const SynTree* d_then; // for d_op == Tok_Qmark
+            Operand():d_unary(0),d_primary(0),d_op(0),d_then(0){}
+        };
+        typedef QVarLengthArray<Operand,8> Operands;
+        struct Node
+        {
+            // the expression tree built from the Operands; the operands of a node precede it
+            const Operand* d_leaf; // 0 for an operation
+            quint16 d_op;
+            int d_lhs, d_rhs;
+            const SynTree* d_then; // for d_op == Tok_Qmark
+            Value d_self; // the value in a self-determined context, once evaluated
+            bool d_hasSelf;
+            Node():d_leaf(0),d_op(0),d_lhs(-1),d_rhs(-1),d_then(0),d_hasSelf(false){}
+        };
+        typedef QVarLengthArray<Node,16> Nodes;
+        static Value power( const Value& base, const Value& exp );
+        static Value shift( quint16 op, const Value&, const Value& amount );
+        static void flatten( const SynTree* expression, Operands& );
+        static void flattenNlr( const SynTree* nlr, Operands& );
+        static Value widen( const Value&, quint32 width, bool sgn ); // keeps the sign of the value
+        int build( const Operands&, int& pos, int minPrec, Nodes& ); // index of the node or -1
+        Value evalNode( Nodes&, int, quint32 width );
+        Value evalOperation( Nodes&, int, quint32 width );
+        Value evalLeaf( const Operand&, quint32 width );
+        Value evalExpression( const SynTree*, quint32 width );
+        Value evalPrimary( const SynTree*, quint32 width );
+        Value evalNumber( const SynTree* );
+        Value evalName( const SynTree* );
+        Value evalConcat( const SynTree* );
+        Value evalSysCall( const SynTree* );
+        Value applySelect( const Value&, const SynTree* rangeExpression );
+        bool evalInt( const SynTree*, qint64& );
+        Value error( const SynTree*, const QString& );
+    private:
+        const Params* d_params;
+        QString d_error;
+        Token d_errorPos;
+        int d_skip; // > 0 while evaluating the branch not taken; no errors, no values
+    };
+}
+
+#endif // VLCONSTEVAL_H
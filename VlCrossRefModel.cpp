@@ -25,10 +25,18 @@
 #include "VlPpLexer.h"
 #include "VlParser.h"
 #include "VlNumLex.h"
+#include "VlAtoms.h"
+#include "VlFileCache.h"
+#include "VlTrace.h"
+#include "VlHash.h"
 #include <QtDebug>
 #include <QElapsedTimer>
 #include <QThread>
 #include <QBuffer>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileSystemWatcher>
+#include <algorithm>
 using namespace Vl;
 
 //#define _DUMP_AST
@@ -48,7 +56,29 @@ public:
     }
 };
 
-CrossRefModel::CrossRefModel(QObject *parent, FileCache* fc) : QObject(parent)
+class CrossRefModel::Resolver : public QThread
+{
+public:
+    Index d_index;
+    RevIndex d_revIndex;
+    Errors d_errs;
+    QList<const Scope*> d_cells;
+    const Scope* d_global;
+    Resolver(const Errors* proto):d_errs(0,true),d_global(0)
+    {
+        d_errs.setShowWarnings( proto->showWarnings() );
+        d_errs.setReportToConsole( proto->reportToConsole() );
+        d_errs.setRecord( proto->record() );
+    }
+    void run()
+    {
+        VL_TRACE( "CrossRefModel::Resolver" );
+        foreach( const Scope* cell, d_cells )
+            resolveIdents( d_index, d_revIndex, cell, 0, cell, d_global, &d_errs );
+    }
+};
+
+CrossRefModel::CrossRefModel(QObject *parent, FileCache* fc) : QObject(parent),d_runningPrio(0),d_resolverThreads(0),d_keepToks(false),d_indexNames(false),d_watcher(0)
 {
     d_worker = new Worker(this);
     connect(d_worker,SIGNAL(finished()), this, SLOT(onWorkFinished()) );
@@ -66,17 +96,228 @@ CrossRefModel::CrossRefModel(QObject *parent, FileCache* fc) : QObject(parent)
 CrossRefModel::~CrossRefModel()
 {
     d_break = 1;
+    d_cancel = 1;
     d_worker->wait();
 }
 
-bool CrossRefModel::updateFiles(const QStringList& files, bool synchronous)
+void CrossRefModel::setResolverThreads(int n)
+{
+    d_lock.lockForWrite();
+    d_resolverThreads = qMax( 0, n );
+    d_lock.unlock();
+}
+
+int CrossRefModel::getResolverThreads() const
+{
+    d_lock.lockForRead();
+    const int res = d_resolverThreads;
+    d_lock.unlock();
+    return res;
+}
+
+void CrossRefModel::setKeepTokens(bool on)
+{
+    d_lock.lockForWrite();
+    d_keepToks = on;
+    d_lock.unlock();
+}
+
+bool CrossRefModel::isKeepingTokens() const
+{
+    d_lock.lockForRead();
+    const bool res = d_keepToks;
+    d_lock.unlock();
+    return res;
+}
+
+void CrossRefModel::setIndexNames(bool on)
+{
+    d_lock.lockForWrite();
+    d_indexNames = on;
+    d_lock.unlock();
+}
+
+bool CrossRefModel::isIndexingNames() const
+{
+    d_lock.lockForRead();
+    const bool res = d_indexNames;
+    d_lock.unlock();
+    return res;
+}
+
+int CrossRefModel::chunkOfLine(const ChunkList& chunks, quint32 line)
+{
+    // the chunks are contiguous and in order of their current lines
+    int lo = 0, hi = chunks.size();
+    while( lo < hi )
+    {
+        const int mid = ( lo + hi ) / 2;
+        if( chunks[mid].d_lineTo < line )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if( lo < chunks.size() && chunks[lo].d_lineFrom <= line )
+        return lo;
+    return -1;
+}
+
+const TokenTable* CrossRefModel::tokensOfLine(const FileData& fd, quint32 line, qint32& shift)
+{
+    shift = 0;
+    if( fd.d_chunks.isEmpty() )
+        return &fd.d_toks;
+    const int i = chunkOfLine( fd.d_chunks, line );
+    if( i == -1 )
+        return 0;
+    shift = fd.d_chunks[i].d_shift;
+    return &fd.d_chunks[i].d_toks;
+}
+
+CrossRefModel::LineShifts CrossRefModel::lineShifts(const ChunkList& chunks)
+{
+    LineShifts res;
+    foreach( const Chunk& c, chunks )
+    {
+        if( c.d_shift == 0 )
+            continue;
+        LineShift s;
+        s.d_from = c.d_lineFrom - c.d_shift;
+        s.d_to = c.d_lineTo - c.d_shift;
+        s.d_shift = c.d_shift;
+        res.append( s );
+    }
+    std::sort( res.begin(), res.end(), lessLineShift );
+    return res;
+}
+
+quint32 CrossRefModel::currentLine(const LineShifts& shifts, quint32 line)
+{
+    if( shifts.isEmpty() )
+        return line;
+    LineShifts::const_iterator i = std::upper_bound( shifts.begin(), shifts.end(), line, lessLine );
+    if( i == shifts.begin() )
+        return line;
+    --i;
+    if( line <= (*i).d_to )
+        return line + (*i).d_shift;
+    return line;
+}
+
+quint32 CrossRefModel::symbolLine(const FileData& fd, quint32 line)
+{
+    if( fd.d_shifts.isEmpty() )
+        return line;
+    const int i = chunkOfLine( fd.d_chunks, line );
+    if( i == -1 )
+        return line;
+    return line - fd.d_chunks[i].d_shift;
+}
+
+void CrossRefModel::shiftErrors(const Errors& from, const Files& files, Errors* to)
+{
+    // the messages about the symbols of reused chunks have the lines of the symbols
+    Errors::EntriesByFile all = from.getErrors();
+    Errors::EntriesByFile::const_iterator i;
+    for( i = all.begin(); i != all.end(); ++i )
+    {
+        const LineShifts shifts = files.value( i.key() ).d_shifts;
+        foreach( const Errors::Entry& e, i.value() )
+            to->error( Errors::Source(e.d_source), i.key(), currentLine( shifts, e.d_line ), e.d_col,
+                       Errors::MsgId(e.d_id), e.d_arg1, e.d_arg2 );
+    }
+    all = from.getWarnings();
+    for( i = all.begin(); i != all.end(); ++i )
+    {
+        const LineShifts shifts = files.value( i.key() ).d_shifts;
+        foreach( const Errors::Entry& e, i.value() )
+            to->warning( Errors::Source(e.d_source), i.key(), currentLine( shifts, e.d_line ), e.d_col,
+                         Errors::MsgId(e.d_id), e.d_arg1, e.d_arg2 );
+    }
+}
+
+Token CrossRefModel::currentTok(const Token& t) const
+{
+    Token res = t;
+    if( t.d_substituted )
+        return res; // the position is the one of the macro
+    d_lock.lockForRead();
+    Files::const_iterator fd = d_files.find( t.d_sourcePath );
+    if( fd != d_files.end() )
+        res.d_lineNr = currentLine( fd.value().d_shifts, t.d_lineNr );
+    d_lock.unlock();
+    return res;
+}
+
+Token CrossRefModel::findTokenBySourcePos(const QString& file, quint32 line, quint16 col) const
+{
+    Token res;
+    d_lock.lockForRead();
+    Files::const_iterator fd = d_files.find(file);
+    if( fd != d_files.end() )
+    {
+        qint32 shift;
+        const TokenTable* toks = tokensOfLine( fd.value(), line, shift );
+        const int i = toks ? toks->findIndex( line - shift, col ) : -1;
+        if( i != -1 )
+        {
+            res = toks->toToken( i, file );
+            res.d_lineNr += shift;
+        }
+    }
+    d_lock.unlock();
+    return res;
+}
+
+QList<Token> CrossRefModel::getTokens(const QString& file, quint32 fromLine, quint32 toLine) const
+{
+    QList<Token> res;
+    d_lock.lockForRead();
+    Files::const_iterator fd = d_files.find(file);
+    if( fd != d_files.end() )
+    {
+        if( fd.value().d_chunks.isEmpty() )
+            res = fd.value().d_toks.tokens( fromLine, toLine, file );
+        else
+        {
+            foreach( const Chunk& c, fd.value().d_chunks )
+            {
+                if( c.d_lineTo < fromLine || c.d_lineFrom > toLine )
+                    continue;
+                // the table has the lines of the symbols of the chunk
+                QList<Token> toks = c.d_toks.tokens( qMax( fromLine, c.d_lineFrom ) - c.d_shift,
+                                                     qMin( toLine, c.d_lineTo ) - c.d_shift, file );
+                for( int i = 0; i < toks.size(); i++ )
+                    toks[i].d_lineNr += c.d_shift;
+                res += toks;
+            }
+        }
+    }
+    d_lock.unlock();
+    return res;
+}
+
+bool CrossRefModel::hasTokens(const QString& file) const
+{
+    d_lock.lockForRead();
+    Files::const_iterator fd = d_files.find(file);
+    const bool res = fd != d_files.end() && fd.value().d_withToks;
+    d_lock.unlock();
+    return res;
+}
+
+bool CrossRefModel::updateFiles(const QStringList& files, bool synchronous, Priority prio)
 {
     d_lock.lockForWrite();
+    bool supersedes = !d_running.isEmpty() && prio > d_runningPrio;
     foreach( const QString& f, files )
     {
-        if( !d_work.contains(f) )
-            d_work.append(f);
+        enqueue( f, prio );
+        if( !supersedes && d_running.contains(f) )
+            supersedes = true; // the running parse of f is stale anyway
     }
+    if( supersedes )
+        d_cancel = 1;
     d_lock.unlock();
 
     if( !d_worker->isRunning() )
@@ -113,19 +354,38 @@ void CrossRefModel::clear()
 {
     QSet<QString> files;
     d_lock.lockForWrite();
-    foreach( const QString& f, d_work )
-        files.insert(f);
-    d_work.clear();
-    foreach( const SymRef& sub, d_global.d_children )
+    for( int p = 0; p < PrioCount; p++ )
+    {
+        foreach( const QString& f, d_work[p] )
+            files.insert(f);
+        d_work[p].clear();
+    }
+    d_queued.clear();
+    if( !d_running.isEmpty() )
+        d_cancel = 1;
+    d_running.clear(); // tells the worker to drop the results of the running batch
+    Files::const_iterator i;
+    for( i = d_files.begin(); i != d_files.end(); ++i )
     {
-        files.insert(sub->d_tok.d_sourcePath);
+        if( !i.value().d_cells.isEmpty() )
+            files.insert(i.key());
     }
     d_global.d_children.clear();
     d_global.d_names.clear();
+    d_global.resetCaches();
+    d_allUpdates = UpdateStats();
+    d_files.clear();
     d_idols.clear();
     d_index.clear();
     d_revIndex.clear();
+    d_hierLock.lock();
+    clearHierarchy();
+    d_hierLock.unlock();
+    d_semLock.lock();
+    d_semToks.clear();
+    d_semLock.unlock();
     d_lock.unlock();
+    syncWatcher();
     emit sigModelUpdated();
     foreach( const QString& file, files )
         emit sigFileUpdated(file);
@@ -162,7 +422,12 @@ CrossRefModel::TreePath CrossRefModel::findSymbolBySourcePos(const QString& file
 {
     SymRefList list;
     d_lock.lockForRead();
-    list = d_global.children();
+    Files::const_iterator fd = d_files.find(file);
+    if( fd != d_files.end() )
+    {
+        list = fd.value().d_cells;
+        line = symbolLine( fd.value(), line );
+    }
     d_lock.unlock();
 
     TreePath res;
@@ -213,12 +478,9 @@ CrossRefModel::SymRefList CrossRefModel::findReferencingSymbolsByFile(const Cros
 {
     SymRefList res;
     d_lock.lockForRead();
-    QList<const Symbol*> tmp = d_revIndex.values( sym );
+    QList<const Symbol*> tmp = d_revIndex.values( sym, file );
     foreach( const Symbol* s, tmp )
-    {
-        if( s->d_tok.d_sourcePath == file )
-            res.append( SymRef(const_cast<Symbol*>(s)) );
-    }
+        res.append( SymRef(const_cast<Symbol*>(s)) );
     d_lock.unlock();
     return res;
 }
@@ -236,7 +498,7 @@ CrossRefModel::SectionList CrossRefModel::getSections(const QString& file) const
 {
     SectionList res;
     d_lock.lockForRead();
-    res = d_sections.value(file);
+    res = d_files.value(file).d_sections;
     d_lock.unlock();
     return res;
 }
@@ -256,163 +518,827 @@ CrossRefModel::SymRef CrossRefModel::findGlobal(const QByteArray& name) const
 {
     SymRef res;
     d_lock.lockForRead();
-    const CrossRefModel::IdentDecl* decl = findNameInScope( &d_global, name, false);
+    // name tables are keyed by atoms; a name which was never interned cannot be declared
+    const CrossRefModel::IdentDecl* decl = findNameInScope( &d_global, Atoms::find(name), false);
     if( decl )
         res = decl->decl();
     d_lock.unlock();
     return res;
 }
 
-CrossRefModel::SymRefList CrossRefModel::getGlobalSyms(const QString& file) const
+void CrossRefModel::FileStats::add(const FileStats& rhs)
 {
-    SymRefList res;
-    d_lock.lockForRead();
-    if( file.isEmpty() )
-        res = d_global.d_children;
-    else
-    {
-        foreach( const SymRef& sym, d_global.d_children )
-        {
-            if( sym->d_tok.d_sourcePath == file )
-                res.append(sym);
-        }
-    }
-    d_lock.unlock();
-    return res;
+    d_tokens += rhs.d_tokens;
+    d_synTreeNodes += rhs.d_synTreeNodes;
+    d_symbols += rhs.d_symbols;
+    d_names += rhs.d_names;
+    d_chunks += rhs.d_chunks;
+    d_bytes += rhs.d_bytes;
 }
 
-CrossRefModel::IdentDeclRefList CrossRefModel::getGlobalNames(const QString& file) const
+void CrossRefModel::UpdateStats::add(const UpdateStats& rhs)
 {
-    IdentDeclRefList res;
-    d_lock.lockForRead();
+    d_files += rhs.d_files;
+    d_filesUnchanged += rhs.d_filesUnchanged;
+    d_chunksParsed += rhs.d_chunksParsed;
+    d_chunksReused += rhs.d_chunksReused;
+    d_parseMs += rhs.d_parseMs;
+    d_mergeMs += rhs.d_mergeMs;
+    d_resolveMs += rhs.d_resolveMs;
+    d_swapMs += rhs.d_swapMs;
+}
 
-    Scope::Names::const_iterator i;
-    for( i = d_global.d_names.begin(); i != d_global.d_names.end(); ++i )
+CrossRefModel::Stats CrossRefModel::getStats() const
+{
+    Stats res;
+    d_lock.lockForRead();
+    Files::const_iterator f;
+    for( f = d_files.begin(); f != d_files.end(); ++f )
     {
-        if( file.isEmpty() || file == i.value()->tok().d_sourcePath )
-            res.append( IdentDeclRef( i.value() ) );
+        FileStats fs;
+        fs.d_tokens = f.value().d_tokens;
+        fs.d_synTreeNodes = f.value().d_synTreeNodes;
+        fs.d_names = f.value().d_names.size();
+        fs.d_chunks = f.value().d_chunks.size();
+        res.d_tokenTableBytes += f.value().d_toks.byteSize();
+        foreach( const Chunk& c, f.value().d_chunks )
+            res.d_tokenTableBytes += c.d_toks.byteSize();
+        res.d_nameIndexBytes += f.value().d_nameIdx.byteSize();
+        foreach( const SymRef& cell, f.value().d_cells )
+            countSymbols( cell.constData(), fs );
+        res.d_files.insert( f.key(), fs );
+        res.d_total.add( fs );
     }
+    res.d_globalNames = d_global.d_names.size();
+    res.d_indexEntries = d_index.size();
+    // key, value, next and hash of each node plus the bucket
+    res.d_indexBytes = quint64(d_index.size()) * ( 4 * sizeof(void*) ) + d_index.capacity() * sizeof(void*);
+    res.d_revIndexEntries = d_revIndex.size();
+    res.d_revIndexBytes = d_revIndex.byteSize();
+    d_hierLock.lock();
+    res.d_instances = d_hier.size();
+    d_hierLock.unlock();
+    res.d_lastUpdate = d_lastUpdate;
+    res.d_allUpdates = d_allUpdates;
     d_lock.unlock();
+
+    if( d_fcache )
+    {
+        res.d_cachedFiles = d_fcache->getFileCount();
+        res.d_cachedBytes = d_fcache->getByteCount();
+    }
+    res.d_defines = d_syms->getCount();
+    res.d_atoms = Atoms::count();
     return res;
 }
 
-QList<Token> CrossRefModel::findTokenByPos(const QString& line, int col, int* pos, bool supportSv)
+CrossRefModel::SemanticTokens CrossRefModel::getSemanticTokens(const QString& file) const
 {
-    PpLexer l;
-    l.setIgnoreAttrs(false);
-    l.setPackAttrs(false);
-    l.setIgnoreComments(false);
-    l.setPackComments(false);
-    l.setSupportSvExt(supportSv);
-
-    QList<Token> res = l.tokens(line);
-    if( pos )
+    SemanticTokens res;
+    d_lock.lockForRead();
+    d_semLock.lock();
+    QHash<QString,SemanticTokens>::const_iterator i = d_semToks.find( file );
+    const bool cached = i != d_semToks.end();
+    if( cached )
+        res = i.value();
+    d_semLock.unlock();
+    if( !cached )
     {
-        *pos = -1;
-        for( int i = 0; i < res.size(); i++ )
+        // computed without d_semLock; concurrent callers may compute the same tokens twice, with the same result
+        Files::const_iterator fd = d_files.find( file );
+        if( fd != d_files.end() )
         {
-            const Token& t = res[i];
-            if( t.d_colNr <= col && col < ( t.d_colNr + t.d_len ) )
+            if( fd.value().d_chunks.isEmpty() )
             {
-                *pos = i;
+                foreach( const SymRef& cell, fd.value().d_cells )
+                    collectSemanticTokens( cell.constData(), file, d_index, res );
+            }else
+            {
+                foreach( const Chunk& c, fd.value().d_chunks )
+                {
+                    const int from = res.size();
+                    foreach( const SymRef& cell, c.d_cells )
+                        collectSemanticTokens( cell.constData(), file, d_index, res );
+                    for( int j = from; j < res.size(); j++ )
+                        res[j].d_lineNr += c.d_shift;
+                }
             }
+            std::sort( res.begin(), res.end(), lessSemanticToken );
+            res.squeeze();
+            // unknown paths are not cached, else each queried path would leave an entry
+            d_semLock.lock();
+            d_semToks.insert( file, res );
+            d_semLock.unlock();
         }
     }
+    d_lock.unlock();
     return res;
 }
 
-QString CrossRefModel::qualifiedName(const CrossRefModel::TreePath& path, bool skipFirst)
+void CrossRefModel::collectSemanticTokens(const Symbol* sym, const QString& file, const Index& index,
+                                          SemanticTokens& res)
 {
-    return qualifiedNameParts(path,skipFirst).join(QChar('.') );
+    if( sym == 0 )
+        return;
+    const int cls = sym->getType();
+    if( ( cls == ClassIdentDecl || cls == ClassIdentUse || cls == ClassPathIdent || cls == ClassCellRef ||
+          cls == ClassPortRef ) && !sym->d_tok.d_substituted && sym->d_tok.d_sourcePath == file )
+    {
+        // symbols from includes and macro expansions have no position in the file
+        SemanticToken t;
+        t.d_lineNr = sym->d_tok.d_lineNr;
+        t.d_colNr = sym->d_tok.d_colNr;
+        t.d_len = sym->d_tok.d_len;
+        t.d_class = cls;
+        t.d_isDecl = cls == ClassIdentDecl;
+        const IdentDecl* decl = t.d_isDecl ? sym->toIdentDecl() : index.value( sym );
+        t.d_declKind = decl && decl->d_decl ? decl->d_decl->d_tok.d_type : 0;
+        res.append( t );
+    }
+    foreach( const SymRef& sub, sym->children() )
+        collectSemanticTokens( sub.constData(), file, index, res );
 }
 
-QStringList CrossRefModel::qualifiedNameParts(const CrossRefModel::TreePath& path, bool skipFirst)
+void CrossRefModel::collectDecls(const Symbol* sym, NameIndex& idx)
 {
-    QStringList res;
-    for( int i = path.size() - 1; i >= 0; i-- )
-    {
-        QByteArray name = path[i]->d_tok.d_val;
-        if( path[i]->d_tok.d_type == SynTree::R_module_or_udp_instantiation_ )
-            name.clear();
+    if( sym == 0 )
+        return;
+    if( const IdentDecl* id = sym->toIdentDecl() )
+        idx.insert( id );
+    foreach( const SymRef& sub, sym->children() )
+        collectDecls( sub.constData(), idx );
+}
 
-        if( !name.isEmpty() && ( i != 0 || !skipFirst ) )
-        {
-            res << QString::fromLatin1( name );
-        }
-    }
-    return res;
+void CrossRefModel::collectDeclKinds(const IdentDecl* cell, QSet<QByteArray>& res)
+{
+    // cell is a top level name; the decls of nested scopes are only distinguished by the cell they are in
+    const QByteArray prefix = cell->d_tok.d_val + '.';
+    res.insert( cell->d_tok.d_val + ':' + QByteArray::number( cell->d_decl ? cell->d_decl->d_tok.d_type : 0 ) );
+    if( cell->d_decl )
+        collectDeclKinds( cell->d_decl, prefix, res );
 }
 
-const CrossRefModel::Scope*CrossRefModel::closestScope(const CrossRefModel::TreePath& path)
+void CrossRefModel::collectDeclKinds(const Symbol* sym, const QByteArray& prefix, QSet<QByteArray>& res)
 {
-    for( int i = 0; i < path.size(); i++ )
-    {
-        Q_ASSERT(path[i]);
-        const Scope* s = path[i]->toScope();
-        if( s )
-            return s;
-    }
-    return 0;
+    if( sym == 0 )
+        return;
+    if( const IdentDecl* id = sym->toIdentDecl() )
+        res.insert( prefix + id->d_tok.d_val + ':' +
+                    QByteArray::number( id->d_decl ? id->d_decl->d_tok.d_type : 0 ) );
+    foreach( const SymRef& sub, sym->children() )
+        collectDeclKinds( sub.constData(), prefix, res );
 }
 
-const CrossRefModel::Branch*CrossRefModel::closestBranch(const CrossRefModel::TreePath& path)
+bool CrossRefModel::lessSemanticToken(const SemanticToken& lhs, const SemanticToken& rhs)
 {
-    for( int i = 0; i < path.size(); i++ )
-    {
-        Q_ASSERT(path[i]);
-        const Branch* s = path[i]->toBranch();
-        if( s )
-            return s;
-    }
-    return 0;
+    return lhs.d_lineNr < rhs.d_lineNr || ( lhs.d_lineNr == rhs.d_lineNr && lhs.d_colNr < rhs.d_colNr );
 }
 
-const CrossRefModel::IdentDecl* CrossRefModel::findNameInScope(const Scope* scope, const QByteArray& name, bool recursiv, bool ports)
+static inline char toLower( char ch )
 {
-    const IdentDecl* res = scope->d_names.value(name);
-    if( res )
-        return res;
-    if( ports && scope->d_tok.d_type == SynTree::R_module_declaration )
+    return ( ch >= 'A' && ch <= 'Z' ) ? ch + ( 'a' - 'A' ) : ch;
+}
+
+static inline char toUpper( char ch )
+{
+    return ( ch >= 'a' && ch <= 'z' ) ? ch - ( 'a' - 'A' ) : ch;
+}
+
+static inline bool isWordStart( const char* name, int i )
+{
+    // the first char, the one after an underscore, an upper case letter after a lower case one and the first digit
+    if( i == 0 )
+        return true;
+    const char prev = name[i-1];
+    const char ch = name[i];
+    if( prev == '_' || prev == '$' )
+        return ch != '_';
+    if( ch >= 'A' && ch <= 'Z' && prev >= 'a' && prev <= 'z' )
+        return true;
+    if( ch >= '0' && ch <= '9' && !( prev >= '0' && prev <= '9' ) )
+        return true;
+    return false;
+}
+
+static bool matchWordStarts( const char* pat, const char* name, int n )
+{
+    // pat[0] matches name[n-1] or later within the same word; each following char either continues
+    // the current word or starts a later one
+    if( *pat == 0 )
+        return true;
+    if( name[n] == 0 )
+        return false;
+    if( toLower( name[n] ) == toLower( *pat ) && matchWordStarts( pat + 1, name, n + 1 ) )
+        return true;
+    for( int i = n + 1; name[i] != 0; i++ )
     {
-        const Scope* lop = Symbol::toScope( findFirst( scope, SynTree::R_list_of_ports) );
-        if( lop )
-        {
-            res = lop->d_names.value(name);
-            if( res )
-                return res;
-        }
+        if( isWordStart( name, i ) && toLower( name[i] ) == toLower( *pat ) &&
+                matchWordStarts( pat + 1, name, i + 1 ) )
+            return true;
     }
-    if( scope->d_super && recursiv )
-        return findNameInScope( scope->d_super->toScope(), name, recursiv, ports );
-    else
-        return 0;
+    return false;
 }
 
-static void findTokensOnSameLine( QList<const SynTree*>& res, const SynTree* st, int line, const QString& path )
+enum CompletionMatch { ExactMatch, PrefixMatch, NoCasePrefixMatch, WordStartMatch, NoMatch };
+
+static CompletionMatch matchCompletion( const QByteArray& pat, const char* name, bool fuzzy )
 {
-    foreach( const SynTree* sub, st->d_children )
+    const int len = pat.size();
+    if( ::strncmp( name, pat.constData(), len ) == 0 )
+        return name[len] == 0 ? ExactMatch : PrefixMatch;
+    if( !fuzzy )
+        return NoMatch;
+    if( qstrnicmp( name, pat.constData(), len ) == 0 )
+        return NoCasePrefixMatch;
+    if( matchWordStarts( pat.constData() + 1, name, 1 ) )
+        return WordStartMatch; // the first char was already compared by the caller
+    return NoMatch;
+}
+
+struct CompletionCand
+{
+    quint8 d_match;
+    quint16 d_depth;
+    int d_len;
+    const char* d_name;
+    const CrossRefModel::IdentDecl* d_decl;
+    bool operator<( const CompletionCand& rhs ) const
     {
-        if( sub->d_tok.d_sourcePath == path && sub->d_tok.d_lineNr > quint32(line))
-            return;
-        if( sub->d_tok.d_type < SynTree::R_First )
-            res << sub;
-        else
-            findTokensOnSameLine(res, sub, line, path );
+        if( d_match != rhs.d_match )
+            return d_match < rhs.d_match;
+        if( d_depth != rhs.d_depth )
+            return d_depth < rhs.d_depth;
+        if( d_len != rhs.d_len )
+            return d_len < rhs.d_len;
+        return ::strcmp( d_name, rhs.d_name ) < 0;
     }
-}
+};
 
-quint16 CrossRefModel::calcTextLenOfDecl(const SynTree* st)
+CrossRefModel::IdentDeclRefList CrossRefModel::findCompletions(const Scope* scope, const QByteArray& pattern,
+                                                               int max, bool fuzzy) const
 {
-    QList<const SynTree*> tokens;
-    findTokensOnSameLine( tokens, st, st->d_tok.d_lineNr, st->d_tok.d_sourcePath );
-    int i = 0;
-    while( i < tokens.size() )
+    if( max <= 0 )
+        max = 20;
+    QList<CompletionCand> best; // ordered, at most max
+    QSet<const char*> seen; // matching names of inner scopes hide the ones of outer scopes
+    d_lock.lockForRead();
+    if( scope == 0 )
+        scope = &d_global;
+    quint16 depth = 0;
+    while( scope )
     {
-        const SynTree* cur = tokens[i];
-        switch( cur->d_tok.d_type )
+        const Scope::SortedNames& names = scope->sortedNames();
+        // a candidate starts with the first char of the pattern, either in the same or in the other case
+        QByteArray firsts;
+        if( pattern.isEmpty() )
+            firsts += char(0);
+        else
         {
-        case Tok_Semi:
-        case Tok_Hash:
+            firsts += pattern[0];
+            const char other = toLower( pattern[0] ) != pattern[0] ? toLower( pattern[0] ) : toUpper( pattern[0] );
+            if( fuzzy && other != pattern[0] )
+                firsts += other;
+        }
+        for( int f = 0; f < firsts.size(); f++ )
+        {
+            Scope::SortedNames::const_iterator i = names.begin();
+            const char from[2] = { firsts[f], 0 };
+            if( firsts[f] != 0 )
+            {
+                Scope::NameEntry key;
+                key.d_name = from;
+                key.d_decl = 0;
+                i = std::lower_bound( names.begin(), names.end(), key, Scope::lessNameEntry );
+            }
+            for( ; i != names.end(); ++i )
+            {
+                const char* name = (*i).d_name;
+                if( firsts[f] != 0 && name[0] != firsts[f] )
+                    break;
+                const CompletionMatch m = matchCompletion( pattern, name, fuzzy );
+                if( m == NoMatch || seen.contains( name ) )
+                    continue;
+                seen.insert( name );
+                CompletionCand c;
+                c.d_match = m;
+                c.d_depth = depth;
+                c.d_len = int(::strlen( name ));
+                c.d_name = name;
+                c.d_decl = (*i).d_decl;
+                if( best.size() == max && !( c < best.last() ) )
+                    continue;
+                int pos = best.size();
+                while( pos > 0 && c < best[pos-1] )
+                    pos--;
+                best.insert( pos, c );
+                if( best.size() > max )
+                    best.removeLast();
+            }
+        }
+        scope = scope->d_super ? scope->d_super->toScope() : 0;
+        depth++;
+    }
+    IdentDeclRefList res;
+    for( int i = 0; i < best.size(); i++ )
+        res.append( IdentDeclRef( best[i].d_decl ) );
+    d_lock.unlock();
+    return res;
+}
+
+CrossRefModel::IdentDeclRefList CrossRefModel::findNames(const QByteArray& pattern, int max, bool fuzzy) const
+{
+    IdentDeclRefList res;
+    if( pattern.isEmpty() )
+        return res;
+    if( max <= 0 )
+        max = 100;
+    const NameIndex::Query q( pattern, fuzzy );
+    NameIndex::Hits best;
+    d_lock.lockForRead();
+    Files::const_iterator f;
+    for( f = d_files.begin(); f != d_files.end(); ++f )
+        f.value().d_nameIdx.find( q, best, max );
+    foreach( const NameIndex::Hit& h, best )
+        res.append( IdentDeclRef( h.d_decl ) );
+    d_lock.unlock();
+    return res;
+}
+
+CrossRefModel::IdentDeclRefList CrossRefModel::findCompletionsAtSourcePos(const QString& file, quint32 line,
+                                                                          quint16 col, const QByteArray& pattern,
+                                                                          int max, bool fuzzy) const
+{
+    // the scope is also found between the symbols
+    const TreePath path = findSymbolBySourcePos( file, line, col, false, true );
+    return findCompletions( closestScope( path ), pattern, max, fuzzy );
+}
+
+void CrossRefModel::countSymbols(const Symbol* sym, FileStats& fs)
+{
+    if( sym == 0 )
+        return;
+    fs.d_symbols++;
+    if( const Scope* s = sym->toScope() )
+        fs.d_bytes += sizeof(Scope) + s->d_names.byteSize();
+    else if( sym->toBranch() )
+        fs.d_bytes += sizeof(Branch);
+    else if( sym->toIdentDecl() )
+        fs.d_bytes += sizeof(IdentDecl);
+    else
+        fs.d_bytes += sizeof(Symbol);
+    fs.d_bytes += sym->children().size() * sizeof(void*);
+    foreach( const SymRef& sub, sym->children() )
+        countSymbols( sub.constData(), fs );
+}
+
+void CrossRefModel::setTopModule(const QByteArray& name)
+{
+    d_lock.lockForWrite();
+    d_topMod = name;
+    d_hierLock.lock();
+    clearHierarchy();
+    d_hierLock.unlock();
+    d_lock.unlock();
+}
+
+QByteArray CrossRefModel::getTopModule() const
+{
+    d_lock.lockForRead();
+    const QByteArray res = d_topMod;
+    d_lock.unlock();
+    return res;
+}
+
+CrossRefModel::Instance CrossRefModel::findInstance(const QByteArray& path) const
+{
+    Instance res;
+    const int dot = path.indexOf('.');
+    d_lock.lockForRead();
+    d_hierLock.lock();
+    if( path.left( dot == -1 ? path.size() : dot ) == d_topMod )
+    {
+        const int n = findHierNode( path );
+        if( n >= 0 )
+            res = toInstance( n );
+    }else
+        res = walkInstance( path );
+    d_hierLock.unlock();
+    d_lock.unlock();
+    return res;
+}
+
+CrossRefModel::Instance CrossRefModel::walkInstance(const QByteArray& path) const
+{
+    // like findHierNode, but for a path starting with another module than d_topMod; the nodes along the path are
+    // not added to d_hier, so the hierarchy of the top module stays as it is
+    int pos = path.indexOf('.');
+    if( pos == -1 )
+        pos = path.size();
+    Instance res;
+    const IdentDecl* top = findNameInScope( &d_global, Atoms::find( path.left( pos ) ), false, false );
+    if( top == 0 )
+        return res;
+    const Scope* cell = top->decl()->toScope();
+    res.d_path = path;
+    res.d_name = path.left( pos );
+    res.d_cell = cell;
+    while( pos < path.size() )
+    {
+        if( cell == 0 )
+            return Instance();
+        const CellInsts& insts = cellInstances( cell );
+        const int i = matchInstance( insts, path, pos );
+        if( i == -1 )
+            return Instance();
+        cell = findCellOfInstance( insts[i].d_inst, &d_global );
+        res.d_name = insts[i].d_name;
+        res.d_inst = insts[i].d_inst;
+        res.d_cell = cell;
+        pos += insts[i].d_name.size() + 1;
+    }
+    return res;
+}
+
+const CrossRefModel::CellInsts& CrossRefModel::cellInstances(const Scope* cell) const
+{
+    // the instances of a cell are only collected once, no matter how often the cell is instantiated
+    QHash<const Scope*,CellInsts>::const_iterator i = d_cellInsts.find( cell );
+    if( i == d_cellInsts.end() )
+    {
+        CellInsts insts;
+        findInstances( cell, QByteArray(), insts );
+        i = d_cellInsts.insert( cell, insts );
+    }
+    return i.value();
+}
+
+int CrossRefModel::matchInstance(const CellInsts& insts, const QByteArray& path, int pos)
+{
+    // pos is the '.' in front of the segment; the segment may span several names, e.g. "g1.u"
+    for( int i = 0; i < insts.size(); i++ )
+    {
+        const QByteArray& name = insts[i].d_name;
+        const int end = pos + 1 + name.size();
+        if( end <= path.size() && ( end == path.size() || path[end] == '.' ) &&
+                ::memcmp( path.constData() + pos + 1, name.constData(), name.size() ) == 0 )
+            return i;
+    }
+    return -1;
+}
+
+CrossRefModel::InstanceList CrossRefModel::getSubInstances(const QByteArray& path) const
+{
+    InstanceList res;
+    d_lock.lockForRead();
+    d_hierLock.lock();
+    const int n = findHierNode( path );
+    if( n >= 0 )
+    {
+        expandHierNode( n );
+        const int from = d_hier[n].d_firstChild;
+        for( int i = from; i < from + d_hier[n].d_childCount; i++ )
+            res.append( toInstance( i ) );
+    }
+    d_hierLock.unlock();
+    d_lock.unlock();
+    return res;
+}
+
+CrossRefModel::InstanceList CrossRefModel::findInstancesByPrefix(const QByteArray& prefix, int max) const
+{
+    // Only the level of the last name in prefix is searched, so only the nodes along prefix are expanded
+    InstanceList res;
+    int dot = prefix.lastIndexOf('.');
+    d_lock.lockForRead();
+    d_hierLock.lock();
+    if( dot == -1 )
+    {
+        const int n = d_topMod.startsWith( prefix ) ? findHierNode( d_topMod ) : -1;
+        if( n >= 0 )
+            res.append( toInstance( n ) );
+    }else
+    {
+        // the last name may be preceded by the labels of generate blocks, e.g. "top.g1.u"; the parent is the
+        // longest prefix which is an instance
+        int n = findHierNode( prefix.left( dot ) );
+        while( n < 0 && dot > 0 )
+        {
+            dot = prefix.lastIndexOf( '.', dot - 1 );
+            if( dot > 0 )
+                n = findHierNode( prefix.left( dot ) );
+        }
+        if( n >= 0 )
+        {
+            expandHierNode( n );
+            const QByteArray name = prefix.mid( dot + 1 );
+            const int from = d_hier[n].d_firstChild;
+            for( int i = from; i < from + d_hier[n].d_childCount; i++ )
+            {
+                if( max > 0 && res.size() >= max )
+                    break;
+                if( d_hier[i].d_path.size() - dot - 1 >= name.size() &&
+                        ::memcmp( d_hier[i].d_path.constData() + dot + 1, name.constData(), name.size() ) == 0 )
+                    res.append( toInstance( i ) );
+            }
+        }
+    }
+    d_hierLock.unlock();
+    d_lock.unlock();
+    return res;
+}
+
+int CrossRefModel::findHierNode(const QByteArray& path) const
+{
+    QHash<QByteArray,int>::const_iterator i = d_hierPaths.find( path );
+    if( i != d_hierPaths.end() )
+        return i.value();
+    if( d_topMod.isEmpty() )
+        return -1;
+    if( d_hier.isEmpty() )
+    {
+        HierNode top;
+        top.d_path = d_topMod;
+        const IdentDecl* id = findNameInScope( &d_global, Atoms::find(d_topMod), false, false );
+        if( id )
+            top.d_cell = id->decl()->toScope();
+        d_hier.append( top );
+        d_hierPaths.insert( d_topMod, 0 );
+        if( path == d_topMod )
+            return 0;
+    }
+    if( path.size() <= d_topMod.size() || !path.startsWith( d_topMod ) || path[d_topMod.size()] != '.' )
+        return -1;
+
+    // walk down from the top module and expand each level along the path once
+    int n = 0;
+    int pos = d_topMod.size();
+    while( pos < path.size() )
+    {
+        expandHierNode( n );
+        if( d_hier[n].d_cell == 0 )
+            return -1;
+        // the children are in the order of the instances of the cell
+        const CellInsts& insts = cellInstances( d_hier[n].d_cell );
+        const int k = matchInstance( insts, path, pos );
+        if( k == -1 )
+            return -1;
+        pos += insts[k].d_name.size() + 1;
+        n = d_hier[n].d_firstChild + k;
+    }
+    return n;
+}
+
+void CrossRefModel::expandHierNode(int n) const
+{
+    if( d_hier[n].d_firstChild != -1 )
+        return;
+    d_hier[n].d_firstChild = d_hier.size();
+    const Scope* cell = d_hier[n].d_cell;
+    if( cell == 0 )
+        return;
+    const CellInsts insts = cellInstances( cell );
+    const QByteArray prefix = d_hier[n].d_path + '.';
+    foreach( const CellInst& inst, insts )
+    {
+        HierNode sub;
+        sub.d_path = prefix + inst.d_name;
+        sub.d_inst = inst.d_inst;
+        sub.d_cell = findCellOfInstance( inst.d_inst, &d_global );
+        sub.d_parent = n;
+        d_hierPaths.insert( sub.d_path, d_hier.size() );
+        d_hier.append( sub );
+    }
+    d_hier[n].d_childCount = insts.size();
+}
+
+CrossRefModel::Instance CrossRefModel::toInstance(int n) const
+{
+    Instance res;
+    res.d_path = d_hier[n].d_path;
+    const int parent = d_hier[n].d_parent;
+    res.d_name = parent == -1 ? d_hier[n].d_path : d_hier[n].d_path.mid( d_hier[parent].d_path.size() + 1 );
+    res.d_inst = d_hier[n].d_inst;
+    res.d_cell = d_hier[n].d_cell;
+    return res;
+}
+
+void CrossRefModel::clearHierarchy()
+{
+    d_hier.clear();
+    d_hierPaths.clear();
+    d_cellInsts.clear();
+}
+
+CrossRefModel::SymRefList CrossRefModel::getGlobalSyms(const QString& file) const
+{
+    SymRefList res;
+    d_lock.lockForRead();
+    if( file.isEmpty() )
+        res = d_global.d_children;
+    else
+        res = d_files.value(file).d_cells;
+    d_lock.unlock();
+    return res;
+}
+
+static bool lessByName( const CrossRefModel::IdentDecl* lhs, const CrossRefModel::IdentDecl* rhs )
+{
+    return lhs->tok().d_val < rhs->tok().d_val;
+}
+
+CrossRefModel::IdentDeclRefList CrossRefModel::getGlobalNames(const QString& file) const
+{
+    IdentDeclRefList res;
+    d_lock.lockForRead();
+
+    QList<const IdentDecl*> names;
+    if( file.isEmpty() )
+        names = d_global.d_names.sortedValues();
+    else
+    {
+        names = d_files.value(file).d_names;
+        std::sort( names.begin(), names.end(), lessByName );
+    }
+    foreach( const IdentDecl* id, names )
+        res.append( IdentDeclRef( id ) );
+    d_lock.unlock();
+    return res;
+}
+
+QList<Token> CrossRefModel::findTokenByPos(const QString& line, int col, int* pos, bool supportSv)
+{
+    PpLexer l;
+    l.setIgnoreAttrs(false);
+    l.setPackAttrs(false);
+    l.setIgnoreComments(false);
+    l.setPackComments(false);
+    l.setSupportSvExt(supportSv);
+
+    QList<Token> res = l.tokens(line);
+    if( pos )
+    {
+        *pos = -1;
+        for( int i = 0; i < res.size(); i++ )
+        {
+            const Token& t = res[i];
+            if( t.d_colNr <= col && col < ( t.d_colNr + t.d_len ) )
+            {
+                *pos = i;
+            }
+        }
+    }
+    return res;
+}
+
+QString CrossRefModel::qualifiedName(const CrossRefModel::TreePath& path, bool skipFirst)
+{
+    return qualifiedNameParts(path,skipFirst).join(QChar('.') );
+}
+
+QStringList CrossRefModel::qualifiedNameParts(const CrossRefModel::TreePath& path, bool skipFirst)
+{
+    QStringList res;
+    for( int i = path.size() - 1; i >= 0; i-- )
+    {
+        QByteArray name = path[i]->d_tok.d_val;
+        if( path[i]->d_tok.d_type == SynTree::R_module_or_udp_instantiation_ )
+            name.clear();
+
+        if( !name.isEmpty() && ( i != 0 || !skipFirst ) )
+        {
+            res << QString::fromLatin1( name );
+        }
+    }
+    return res;
+}
+
+const CrossRefModel::Scope*CrossRefModel::closestScope(const CrossRefModel::TreePath& path)
+{
+    for( int i = 0; i < path.size(); i++ )
+    {
+        Q_ASSERT(path[i]);
+        const Scope* s = path[i]->toScope();
+        if( s )
+            return s;
+    }
+    return 0;
+}
+
+const CrossRefModel::Branch*CrossRefModel::closestBranch(const CrossRefModel::TreePath& path)
+{
+    for( int i = 0; i < path.size(); i++ )
+    {
+        Q_ASSERT(path[i]);
+        const Branch* s = path[i]->toBranch();
+        if( s )
+            return s;
+    }
+    return 0;
+}
+
+const CrossRefModel::IdentDecl* CrossRefModel::findNameInScope(const Scope* scope, const QByteArray& name, bool recursiv, bool ports)
+{
+    const IdentDecl* res = scope->d_names.value(name);
+    if( res )
+        return res;
+    if( ports && scope->d_tok.d_type == SynTree::R_module_declaration )
+    {
+        if( const Scope* lop = scope->d_lop )
+        {
+            res = lop->d_names.value(name);
+            if( res )
+                return res;
+        }
+    }
+    if( scope->d_super && recursiv )
+        return findNameInScope( scope->d_super->toScope(), name, recursiv, ports );
+    else
+        return 0;
+}
+
+const CrossRefModel::Scope* CrossRefModel::findCellOfInstance(const IdentDecl* inst, const Scope* globScope)
+{
+    // shared by the resolution of hierarchical paths and the design hierarchy
+    const Branch* instance = inst->d_decl;
+    if( instance == 0 || instance->d_tok.d_type != SynTree::R_module_or_udp_instance_ || instance->d_super == 0 )
+        return 0;
+    // the instantiation knows the name of the cell, see fillAst
+    const IdentDecl* cellId = findNameInScope( globScope, instance->d_super->d_tok.d_val, false, false );
+    if( cellId != 0 )
+        return cellId->decl()->toScope();
+    else
+        return 0;
+}
+
+void CrossRefModel::resetViews(const Symbol* sym)
+{
+    // a view is built from the view of the super scope, so there is none below a scope without one
+    if( sym == 0 )
+        return;
+    if( const Scope* s = Scope::toScope( sym ) )
+    {
+        if( s->d_visible.loadAcquire() == 0 )
+            return;
+        delete s->d_visible.fetchAndStoreOrdered( 0 );
+    }
+    foreach( const SymRef& sub, sym->children() )
+        resetViews( sub.constData() );
+}
+
+void CrossRefModel::findInstances(const Symbol* sym, const QByteArray& prefix, CellInsts& insts)
+{
+    foreach( const SymRef& sub, sym->children() )
+    {
+        if( sub.constData() == 0 )
+            continue;
+        if( sub->d_tok.d_type == SynTree::R_module_or_udp_instance_ )
+        {
+            foreach( const SymRef& name, sub->children() )
+            {
+                if( const IdentDecl* id = ( name.constData() ? name->toIdentDecl() : 0 ) )
+                {
+                    CellInst ci; // unnamed udp instances have no decl
+                    ci.d_name = prefix + id->d_tok.d_val;
+                    ci.d_inst = id;
+                    insts.append( ci );
+                    break;
+                }
+            }
+        }else if( sub->d_tok.d_type == SynTree::R_generate_block && sub->toScope() != 0 &&
+                  !sub->d_tok.d_val.isEmpty() && sub->d_tok.d_val != "." )
+            // a named generate block is a level of the hierarchy; in a loop generate it would be g[i].u, but
+            // the index is only known after elaboration, so all iterations share g.u
+            findInstances( sub.constData(), prefix + sub->d_tok.d_val + '.', insts );
+        else
+            findInstances( sub.constData(), prefix, insts );
+    }
+}
+
+static void findTokensOnSameLine( QList<const SynTree*>& res, const SynTree* st, int line, const QString& path )
+{
+    foreach( const SynTree* sub, st->d_children )
+    {
+        if( sub->d_tok.d_sourcePath == path && sub->d_tok.d_lineNr > quint32(line))
+            return;
+        if( sub->d_tok.d_type < SynTree::R_First )
+            res << sub;
+        else
+            findTokensOnSameLine(res, sub, line, path );
+    }
+}
+
+quint16 CrossRefModel::calcTextLenOfDecl(const SynTree* st)
+{
+    QList<const SynTree*> tokens;
+    findTokensOnSameLine( tokens, st, st->d_tok.d_lineNr, st->d_tok.d_sourcePath );
+    int i = 0;
+    while( i < tokens.size() )
+    {
+        const SynTree* cur = tokens[i];
+        switch( cur->d_tok.d_type )
+        {
+        case Tok_Semi:
+        case Tok_Hash:
         case Tok_Lpar:
         case Tok_Ident:
             return cur->d_tok.d_colNr - st->d_tok.d_colNr;
@@ -487,32 +1413,176 @@ bool CrossRefModel::findSymbolBySourcePosImp(CrossRefModel::TreePath& path, quin
     return false;
 }
 
-void CrossRefModel::runUpdater(CrossRefModel* mdl)
+bool CrossRefModel::lessPosRef(const PosRef& lhs, const PosRef& rhs)
 {
-    QStringList files;
-    mdl->d_lock.lockForWrite();
-    if( !mdl->d_work.isEmpty() )
+    return lhs.d_line < rhs.d_line || ( lhs.d_line == rhs.d_line && lhs.d_col < rhs.d_col );
+}
+
+void CrossRefModel::findSymbolsImp(TreePath& path, const QString& file, const QVector<PosRef>& refs,
+                                   QList<PosHit>& res, int& open, bool onlyIdents)
+{
+    // same visiting order as findSymbolBySourcePosImp, so the first hit of a position is the same
+    foreach( const SymRef& sub, path.front()->children() )
     {
-        files = mdl->d_work;
-        mdl->d_work.clear();
+        if( open == 0 )
+            return;
+        path.push_front(sub);
+        const Token& t = sub->d_tok;
+        if( ( t.d_type == Tok_Ident || !onlyIdents ) && !t.d_substituted && t.d_sourcePath == file )
+        {
+            // all positions on the line between d_colNr and d_colNr + d_len, see isHit
+            PosRef from;
+            from.d_line = t.d_lineNr;
+            from.d_col = t.d_colNr;
+            QVector<PosRef>::const_iterator i = std::lower_bound( refs.begin(), refs.end(), from, lessPosRef );
+            for( ; i != refs.end() && (*i).d_line == t.d_lineNr && (*i).d_col <= t.d_colNr + t.d_len; ++i )
+            {
+                PosHit& hit = res[(*i).d_index];
+                if( hit.d_path.isEmpty() )
+                {
+                    hit.d_path = path;
+                    open--;
+                }
+            }
+        }
+        findSymbolsImp( path, file, refs, res, open, onlyIdents );
+        path.pop_front();
     }
-    mdl->d_lock.unlock();
+}
 
-    ScopeRefList scopes;
-    IfDefOutLists idols;
-    SectionLists secs;
+QList<CrossRefModel::PosHit> CrossRefModel::findSymbolsBySourcePos(const QList<SourcePos>& poss, bool onlyIdents) const
+{
+    QList<PosHit> res;
+    QHash<QString,QVector<PosRef> > byFile;
+    for( int i = 0; i < poss.size(); i++ )
+    {
+        res.append( PosHit() );
+        PosRef r;
+        r.d_line = poss[i].d_line;
+        r.d_col = poss[i].d_col;
+        r.d_index = i;
+        byFile[poss[i].d_file].append( r );
+    }
 
-    Errors errs(0,true);
-    errs.setShowWarnings(false);
-    errs.setReportToConsole(false);
-    errs.setRecord(true);
+    d_lock.lockForRead();
+    QHash<QString,QVector<PosRef> >::iterator f;
+    for( f = byFile.begin(); f != byFile.end(); ++f )
+    {
+        Files::const_iterator fd = d_files.find( f.key() );
+        if( fd == d_files.end() )
+            continue;
+        QVector<PosRef>& refs = f.value();
+        for( int i = 0; i < refs.size(); i++ )
+            refs[i].d_line = symbolLine( fd.value(), refs[i].d_line );
+        std::sort( refs.begin(), refs.end(), lessPosRef );
+        int open = refs.size();
+        foreach( const SymRef& cell, fd.value().d_cells )
+        {
+            if( open == 0 )
+                break;
+            if( cell->d_tok.d_sourcePath != f.key() )
+                continue;
+            TreePath path;
+            path.push_front( cell );
+            findSymbolsImp( path, f.key(), refs, res, open, onlyIdents );
+        }
+    }
+    for( int i = 0; i < res.size(); i++ )
+    {
+        if( !res[i].d_path.isEmpty() )
+            res[i].d_decl = IdentDeclRef( const_cast<IdentDecl*>( d_index.value( res[i].d_path.first().data() ) ) );
+    }
+    d_lock.unlock();
+    return res;
+}
 
-    if( mdl->d_break )
-        return;
-    parseFiles( files, scopes, idols, secs, &errs, mdl->d_syms, mdl->d_incs, mdl->d_fcache, &mdl->d_break );
-    if( mdl->d_break )
-        return;
-    mdl->insertFiles( files, scopes, idols, secs, &errs );
+void CrossRefModel::enqueue(const QString& file, quint8 prio)
+{
+    QHash<QString,quint8>::iterator i = d_queued.find(file);
+    if( i != d_queued.end() )
+    {
+        if( i.value() >= prio )
+            return; // coalesced with the pending request
+        d_work[i.value()].removeOne(file);
+        i.value() = prio;
+    }else
+        d_queued.insert( file, prio );
+    d_work[prio].append(file);
+}
+
+bool CrossRefModel::takeBatch(QStringList& files, quint8& prio)
+{
+    for( int p = PrioCount - 1; p >= 0; p-- )
+    {
+        if( d_work[p].isEmpty() )
+            continue;
+        files = d_work[p];
+        prio = p;
+        d_work[p].clear();
+        foreach( const QString& f, files )
+            d_queued.remove(f);
+        return true;
+    }
+    return false;
+}
+
+void CrossRefModel::runUpdater(CrossRefModel* mdl)
+{
+    while( !mdl->d_break )
+    {
+        QStringList files;
+        quint8 prio = 0;
+        {
+            VL_TRACE( "CrossRefModel::waitForWriteLock" );
+            mdl->d_lock.lockForWrite();
+        }
+        const bool hasBatch = mdl->takeBatch( files, prio );
+        mdl->d_running = files.toSet();
+        mdl->d_runningPrio = prio;
+        mdl->d_cancel = 0;
+        Reparse reparse;
+        reparse.d_keepToks = mdl->d_keepToks;
+        reparse.d_indexNames = mdl->d_indexNames;
+        mdl->d_lock.unlock();
+        if( !hasBatch )
+            return;
+
+        ScopeRefList scopes;
+        IfDefOutLists idols;
+        SectionLists secs;
+
+        Errors errs(0,true);
+        errs.setShowWarnings(false);
+        errs.setReportToConsole(false);
+        errs.setRecord(true);
+
+        mdl->reparseFiles( files, scopes, idols, secs, reparse, &errs, &mdl->d_cancel );
+        if( mdl->d_break )
+            return;
+        mdl->d_lock.lockForWrite();
+        const bool dropped = mdl->d_running.isEmpty(); // by clear()
+        if( mdl->d_cancel && !dropped )
+        {
+            // Only the files not finished before the cancel go back to their former priority, behind the request
+            // which caused it. The finished ones are inserted below, even if a new request superseded them; it is
+            // queued already and replaces them with the next batch.
+            const QSet<QString> done = reparse.d_done.toSet();
+            foreach( const QString& f, files )
+            {
+                if( !done.contains(f) )
+                    mdl->enqueue( f, prio );
+            }
+        }
+        mdl->d_running.clear();
+        mdl->d_lock.unlock();
+        if( dropped )
+            continue;
+        files = reparse.d_done;
+        foreach( const QString& f, reparse.d_unchanged )
+            files.removeOne(f);
+        if( !files.isEmpty() )
+            mdl->insertFiles( files, scopes, idols, secs, &errs, true, &reparse );
+    }
 
 //    qDebug() << files.size() << "updated" << mdl->d_global.d_names.size() << "global names"
 //             << mdl->d_global.d_children.size() << "global children"
@@ -552,8 +1622,9 @@ void CrossRefModel::dump(const CrossRefModel::Symbol* node, int level, bool recu
 
 void CrossRefModel::onWorkFinished()
 {
+    syncWatcher();
     d_lock.lockForRead();
-    bool runAgain = !d_work.isEmpty();
+    bool runAgain = hasWork();
     d_lock.unlock();
     if( runAgain )
         d_worker->start();
@@ -569,6 +1640,17 @@ CrossRefModel::ScopeRefNc CrossRefModel::createAst(const SynTree* top, Errors* e
     return res;
 }
 
+void CrossRefModel::fillAstTop(Scope* top, const SynTree* st, Errors* err)
+{
+    // Top level productions are independent of each other, so they can be added to top one by one
+    SynTree root;
+    root.d_children.append( const_cast<SynTree*>(st) );
+    SynTreePath synTree;
+    synTree.push_front(&root);
+    fillAst( top, top, synTree, err );
+    root.d_children.clear();
+}
+
 static bool hasScope(const SynTree* st)
 {
     // Laut Std sind Scopes: module_declaration, (udp_declaration)
@@ -711,6 +1793,9 @@ void CrossRefModel::fillAst(Branch* parentAst, Scope* superScope, SynTreePath& s
 #endif
             curScope->d_tok.d_len = calcKeyWordLen(curChildSt);
             parentAst->d_children.append( SymRef(curScope) );
+            if( curScope->d_tok.d_type == SynTree::R_list_of_ports && parentAst == superScope &&
+                    superScope->d_lop == 0 )
+                superScope->d_lop = curScope; // same as findFirst(superScope,R_list_of_ports)
 
             synPath.push_front(curChildSt);
             fillAst( curScope, curScope, synPath, err );
@@ -732,12 +1817,9 @@ void CrossRefModel::fillAst(Branch* parentAst, Scope* superScope, SynTreePath& s
                 id->d_tok = label;
                 branch->d_children.append(SymRef(id));
                 id->d_decl = branch;
-                const IdentDecl*& slot = superScope->d_names[id->d_tok.d_val];
-                if( slot != 0 )
+                if( superScope->d_names.insert( id->d_tok.d_val, id ) != 0 )
                     err->error(Errors::Semantics, id->d_tok.d_sourcePath, id->d_tok.d_lineNr,id->d_tok.d_colNr,
-                                  tr("duplicate name: %1").arg(id->d_tok.d_val.data()) );
-                else
-                    slot = id;
+                                  Errors::Msg_DuplicateName, id->d_tok.d_val );
             }
 
             synPath.push_front(curChildSt);
@@ -880,12 +1962,9 @@ void CrossRefModel::fillAst(Branch* parentAst, Scope* superScope, SynTreePath& s
             if( IdentDecl* id = const_cast<IdentDecl*>( sym->toIdentDecl() ) )
             {
                 id->d_decl = parentAst;
-                const IdentDecl*& slot = scope->d_names[id->d_tok.d_val];
-                if( slot != 0 )
+                if( scope->d_names.insert( id->d_tok.d_val, id ) != 0 )
                     err->error(Errors::Semantics, id->d_tok.d_sourcePath, id->d_tok.d_lineNr,id->d_tok.d_colNr,
-                                  tr("duplicate name: %1").arg(id->d_tok.d_val.data()) );
-                else
-                    slot = id;
+                                  Errors::Msg_DuplicateName, id->d_tok.d_val );
             }
         }else if( curChildSt->d_tok.d_type > SynTree::R_First )
         {
@@ -900,6 +1979,21 @@ void CrossRefModel::fillAst(Branch* parentAst, Scope* superScope, SynTreePath& s
 
 void CrossRefModel::checkNumber(const SynTree* number, Errors* err)
 {
+    // Numbers consisting of one token were already validated by the lexer; only the ones composed of
+    // several tokens (e.g. with a macro as size) and the invalid ones are parsed again
+    const SynTree* single = 0;
+    int count = 0;
+    foreach( const SynTree* child, number->d_children )
+    {
+        if( !child->d_tok.d_prePp )
+        {
+            single = child;
+            count++;
+        }
+    }
+    if( count == 1 && single->d_tok.d_numValidity == NumLex::Valid )
+        return;
+
     QByteArray str;
     foreach( const SynTree* child, number->d_children )
     {
@@ -911,28 +2005,28 @@ void CrossRefModel::checkNumber(const SynTree* number, Errors* err)
     if( !lex.parse(true) )
     {
         err->error(Errors::Syntax, number->d_tok.d_sourcePath, number->d_tok.d_lineNr,number->d_tok.d_colNr,
-                      tr("number %1: %2").arg(str.data()).arg(lex.getError()) );
+                      Errors::Msg_InvalidNumber, str, lex.getError().toUtf8() );
     }
 }
 
 bool CrossRefModel::checkLop(CrossRefModel::Scope* superScope, const SynTree* id, Errors* err)
 {
-    const Scope* lop = Symbol::toScope( findFirst(superScope, SynTree::R_list_of_ports) );
+    const Scope* lop = superScope->d_lop;
     if( lop == 0 )
     {
         err->error(Errors::Semantics, id->d_tok.d_sourcePath, id->d_tok.d_lineNr,id->d_tok.d_colNr,
-                      tr("port_declaration not allowed here if list_of_ports declaration is not used") );
+                      Errors::Msg_PortDeclWithoutLop );
         return false;
     }
     if( !lop->d_names.contains( id->d_tok.d_val ) )
     {
         err->error(Errors::Semantics, id->d_tok.d_sourcePath, id->d_tok.d_lineNr,id->d_tok.d_colNr,
-                      tr("port_declaration must correspond to one in the list_of_ports: %1").arg(id->d_tok.d_val.data()) );
+                      Errors::Msg_PortDeclNotInLop, id->d_tok.d_val );
         return false;
     }else if( lop->d_names.contains( char(1) + id->d_tok.d_val ) )
     {
         err->error(Errors::Semantics, id->d_tok.d_sourcePath, id->d_tok.d_lineNr,id->d_tok.d_colNr,
-                      tr("duplicate port_declaration: %1").arg(id->d_tok.d_val.data()) );
+                      Errors::Msg_DuplicatePortDecl, id->d_tok.d_val );
         return false;
     }
     return true;
@@ -1149,7 +2243,7 @@ int CrossRefModel::parseFiles(const QStringList& files, ScopeRefList& scopes, If
         int e = errs->getErrCount();
         int w = errs->getWrnCount();
         //qDebug() << "start parseFiles" << file;
-        parseStream( 0, file, scopes, idol, sec, errs, syms, incs, fcache );
+        parseStream( 0, file, scopes, idol, sec, errs, syms, incs, fcache, stop );
         //qDebug() << "end parseFiles" << file;
         secs[file] = sec;
         IfDefOutLists::const_iterator i;
@@ -1173,84 +2267,628 @@ int CrossRefModel::parseFiles(const QStringList& files, ScopeRefList& scopes, If
     return esum;
 }
 
+int CrossRefModel::reparseFiles(const QStringList& files, ScopeRefList& scopes, IfDefOutLists& idols,
+                                 SectionLists& secs, Reparse& res, Errors* errs, const QAtomicInt* stop)
+{
+    QElapsedTimer t;
+    t.start();
+    int esum = 0;
+    foreach( const QString& file, files )
+    {
+        if( stop && *stop )
+            break;
+        const int e = errs->getErrCount();
+        const int n = scopes.size();
+        reparseFile( file, scopes, idols, secs, res, errs, stop );
+        if( stop && *stop )
+        {
+            // the results of the interrupted file are incomplete; it is parsed again with a later batch
+            while( scopes.size() > n )
+                scopes.removeLast();
+            idols.remove( file );
+            secs.remove( file );
+            res.d_chunks.remove( file );
+            res.d_digests.remove( file );
+            res.d_counts.remove( file );
+            res.d_toks.remove( file );
+            res.d_unchanged.removeOne( file );
+            errs->clearFiles( QStringList() << file );
+            break;
+        }
+        res.d_done.append( file );
+        esum += errs->getErrCount() - e;
+        res.d_stats.d_files++;
+    }
+    res.d_stats.d_parseMs = t.elapsed();
+    return esum;
+}
+
+void CrossRefModel::reparseFile(const QString& file, ScopeRefList& scopes, IfDefOutLists& idols, SectionLists& secs,
+                                Reparse& res, Errors* errs, const QAtomicInt* stop)
+{
+    VL_TRACE_FILE( "CrossRefModel::reparseFile", file );
+    QByteArray text;
+    const bool found = readFile( file, d_fcache, text );
+    Digest& digest = res.d_digests[file];
+    digest.d_hash = found ? Hash::xx64( text ) : 0;
+    digest.d_incDirs = d_incs->getHash();
+    if( digest.d_hash != 0 && isUnchanged( file, digest, res.d_keepToks, res.d_indexNames ) )
+    {
+        res.d_digests.remove(file);
+        res.d_unchanged.append(file);
+        res.d_stats.d_filesUnchanged++;
+        return;
+    }
+    ChunkList layout;
+    QList<int> offsets;
+    if( !found || !scanChunks( text, layout, offsets ) )
+    {
+        // Compiler directives or other top level constructs; the file can only be parsed as a whole
+        IfDefOutLists idol;
+        QBuffer in( &text );
+        in.open(QIODevice::ReadOnly);
+        TokenTable* toks = 0;
+        if( res.d_keepToks )
+            toks = &res.d_toks[file];
+        parseStream( found ? &in : 0, file, scopes, idol, secs[file], errs, d_syms, d_incs, d_fcache, stop,
+                     &res.d_counts[file], toks, &digest );
+        if( toks )
+            toks->squeeze();
+        IfDefOutLists::const_iterator i;
+        for( i = idol.begin(); i != idol.end(); ++i )
+        {
+            idols.insert( i.key(), i.value() );
+            // the lexer reports each source it read, so these are the includes
+            QByteArray inc;
+            if( i.key() != file )
+                digest.d_deps[i.key()] = readFile( i.key(), d_fcache, inc ) ? Hash::xx64( inc ) : 0;
+        }
+        res.d_chunks[file] = ChunkList();
+        return;
+    }
+
+    // Each chunk with the same text as a chunk of the previous parse of the file takes over its symbols as they
+    // are; they are shared with the published model and keep their lines, only d_shift changes if the chunk moved.
+    // The hash has 64 bits, so a collision of two different chunks is not expected.
+    QVector<bool> reused( layout.size() );
+    QList<LineShift> used; // the lines of the symbols of the reused chunks
+    quint32 free = layout.isEmpty() ? 1 : layout.last().d_lineTo + 1; // the first line not used by any symbol
+    d_lock.lockForRead();
+    Files::const_iterator fd = d_files.find(file);
+    if( fd != d_files.end() && !fd.value().d_chunks.isEmpty() )
+    {
+        const ChunkList& old = fd.value().d_chunks;
+        QMultiHash<quint64,int> oldByHash;
+        for( int j = old.size() - 1; j >= 0; j-- ) // QMultiHash returns the last inserted first
+            oldByHash.insert( old[j].d_hash, j );
+        for( int i = 0; i < layout.size(); i++ )
+        {
+            QMultiHash<quint64,int>::iterator j = oldByHash.find( layout[i].d_hash );
+            if( j == oldByHash.end() )
+                continue;
+            const Chunk& c = old[j.value()];
+            if( res.d_keepToks && c.d_toks.isEmpty() )
+                continue; // parsed before the tokens were kept
+            oldByHash.erase(j);
+            const quint32 from = layout[i].d_lineFrom;
+            const quint32 to = layout[i].d_lineTo;
+            layout[i] = c;
+            layout[i].d_shift = c.d_shift + qint32(from) - qint32(c.d_lineFrom);
+            layout[i].d_lineFrom = from;
+            layout[i].d_lineTo = to;
+            LineShift u;
+            u.d_from = c.d_lineFrom - c.d_shift;
+            u.d_to = c.d_lineTo - c.d_shift;
+            used.append( u );
+            free = qMax( free, u.d_to + 1 );
+            reused[i] = true;
+            res.d_stats.d_chunksReused++;
+        }
+    }
+    d_lock.unlock();
+
+    // A chunk parsed anew gets its current lines, unless a reused chunk already has symbols on one of them; then
+    // it is parsed on lines no chunk uses, so the line of a symbol always identifies its chunk.
+    for( int i = 0; i < layout.size(); i++ )
+    {
+        if( reused[i] )
+            continue;
+        Chunk& c = layout[i];
+        bool clash = false;
+        foreach( const LineShift& u, used )
+        {
+            if( u.d_from <= c.d_lineTo && c.d_lineFrom <= u.d_to )
+            {
+                clash = true;
+                break;
+            }
+        }
+        if( clash )
+        {
+            c.d_shift = qint32(c.d_lineFrom) - qint32(free);
+            free += c.d_lineTo - c.d_lineFrom + 1;
+        }
+    }
+
+    Errors cerrs(0,true);
+    cerrs.setShowWarnings( errs->showWarnings() );
+    cerrs.setReportToConsole( errs->reportToConsole() );
+    cerrs.setRecord(true);
+    for( int i = 0; i < layout.size(); i++ )
+    {
+        if( reused[i] )
+            continue;
+        if( stop && *stop )
+            return;
+        Chunk& c = layout[i];
+        QByteArray part = QByteArray::fromRawData( text.constData() + offsets[i], c.d_len );
+        QBuffer in( &part );
+        in.open(QIODevice::ReadOnly);
+        IfDefOutLists idol;
+        FileStats counts;
+        cerrs.clear();
+        c.d_toks.clear();
+        ScopeRefNc top = parseFragment( &in, file, c.d_lineFrom - c.d_shift, idol, c.d_sectionToks, &cerrs,
+                                        d_syms, d_incs, d_fcache, stop, &counts,
+                                        res.d_keepToks ? &c.d_toks : 0 );
+        c.d_toks.squeeze();
+        res.d_stats.d_chunksParsed++;
+        c.d_tokens = counts.d_tokens;
+        c.d_synTreeNodes = counts.d_synTreeNodes;
+        c.d_cells = top->d_children;
+        c.d_names = top->d_names.values();
+        c.d_errs = cerrs.getErrors(file);
+        c.d_wrns = cerrs.getWarnings(file);
+    }
+
+    // compose the result of the file as if it was parsed as a whole
+    ScopeRefNc top( new Scope() );
+    QList<Token> sectionToks;
+    FileStats& counts = res.d_counts[file];
+    foreach( const Chunk& c, layout )
+    {
+        top->d_children += c.d_cells;
+        counts.d_tokens += c.d_tokens;
+        counts.d_synTreeNodes += c.d_synTreeNodes;
+        foreach( const IdentDecl* id, c.d_names )
+        {
+            if( top->d_names.insert( id->d_tok.d_val, id ) != 0 )
+                errs->error(Errors::Semantics, id->d_tok.d_sourcePath, id->d_tok.d_lineNr + c.d_shift,
+                              id->d_tok.d_colNr, Errors::Msg_DuplicateName, id->d_tok.d_val );
+        }
+        foreach( const Errors::Entry& e, c.d_errs )
+            errs->error( Errors::Source(e.d_source), file, e.d_line + c.d_shift, e.d_col, Errors::MsgId(e.d_id),
+                         e.d_arg1, e.d_arg2 );
+        foreach( const Errors::Entry& e, c.d_wrns )
+            errs->warning( Errors::Source(e.d_source), file, e.d_line + c.d_shift, e.d_col, Errors::MsgId(e.d_id),
+                         e.d_arg1, e.d_arg2 );
+        foreach( Token t, c.d_sectionToks )
+        {
+            t.d_lineNr += c.d_shift;
+            sectionToks.append( t );
+        }
+    }
+    scopes.append(top);
+    fillSections( sectionToks, file, secs[file] );
+    idols.insert( file, IfDefOutList() );
+    res.d_chunks[file] = layout;
+}
+
+bool CrossRefModel::readFile(const QString& path, FileCache* fcache, QByteArray& text)
+{
+    bool found = false;
+    if( fcache )
+        text = fcache->getFile( path, &found );
+    if( !found )
+    {
+        QFile f(path);
+        if( f.open(QIODevice::ReadOnly) )
+        {
+            text = f.readAll();
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool CrossRefModel::isUnchanged(const QString& file, const Digest& cur, bool withToks, bool withNames) const
+{
+    d_lock.lockForRead();
+    Files::const_iterator fd = d_files.find(file);
+    const bool same = fd != d_files.end() && fd.value().d_digest.d_hash == cur.d_hash &&
+            fd.value().d_digest.d_incDirs == cur.d_incDirs && ( !withToks || fd.value().d_withToks ) &&
+            ( !withNames || fd.value().d_withNames );
+    const Digest old = same ? fd.value().d_digest : Digest();
+    d_lock.unlock();
+    if( !same )
+        return false;
+    QMap<QString,quint64>::const_iterator i;
+    for( i = old.d_deps.begin(); i != old.d_deps.end(); ++i )
+    {
+        // an include which was not found has hash 0, as long as it is still missing
+        QByteArray text;
+        const quint64 hash = readFile( i.key(), d_fcache, text ) ? Hash::xx64( text ) : 0;
+        if( hash != i.value() )
+            return false;
+    }
+    QMap<QByteArray,quint64>::const_iterator j;
+    for( j = old.d_macros.begin(); j != old.d_macros.end(); ++j )
+    {
+        if( d_syms->getHash( j.key() ) == j.value() )
+            continue;
+        // a macro defined by the last parse of the file itself, e.g. an include guard, is not a change
+        const QString source = d_syms->getSymbol( j.key() ).d_sourcePath;
+        if( source.isEmpty() || ( source != file && !old.d_deps.contains( source ) ) )
+            return false;
+    }
+    return true;
+}
+
+void CrossRefModel::setWatchFiles(bool on)
+{
+    if( on && d_watcher == 0 )
+    {
+        d_watcher = new QFileSystemWatcher(this);
+        connect( d_watcher, SIGNAL(fileChanged(QString)), this, SLOT(onFileChanged(QString)) );
+        syncWatcher();
+    }else if( !on && d_watcher != 0 )
+    {
+        delete d_watcher;
+        d_watcher = 0;
+    }
+}
+
+void CrossRefModel::syncWatcher()
+{
+    if( d_watcher == 0 )
+        return;
+    QSet<QString> paths;
+    d_lock.lockForRead();
+    Files::const_iterator i;
+    for( i = d_files.begin(); i != d_files.end(); ++i )
+    {
+        if( i.value().d_digest.d_hash == 0 )
+            continue; // e.g. parseString
+        paths.insert( i.key() );
+        QMap<QString,quint64>::const_iterator j;
+        for( j = i.value().d_digest.d_deps.begin(); j != i.value().d_digest.d_deps.end(); ++j )
+            if( j.value() != 0 ) // missing includes can't be watched; they are checked with the next update
+                paths.insert( j.key() );
+    }
+    d_lock.unlock();
+
+    // compared with the watcher itself because it silently drops files which are deleted or replaced
+    const QSet<QString> watched = d_watcher->files().toSet();
+    QStringList removed, added;
+    foreach( const QString& p, watched )
+        if( !paths.contains(p) )
+            removed.append(p);
+    foreach( const QString& p, paths )
+        if( !watched.contains(p) )
+            added.append(p);
+    if( !removed.isEmpty() )
+        d_watcher->removePaths( removed );
+    if( !added.isEmpty() )
+        d_watcher->addPaths( added );
+}
+
+void CrossRefModel::onFileChanged(const QString& path)
+{
+    // Touched but unchanged files are recognized by their digest, so the cost is a read and a hash
+    QStringList files;
+    d_lock.lockForRead();
+    Files::const_iterator i;
+    for( i = d_files.begin(); i != d_files.end(); ++i )
+    {
+        if( i.key() == path || i.value().d_digest.d_deps.contains( path ) )
+            files.append( i.key() );
+    }
+    d_lock.unlock();
+    // git and many editors replace the file, which removes it from the watcher
+    if( QFileInfo( path ).exists() )
+        d_watcher->addPath( path );
+    if( !files.isEmpty() )
+        updateFiles( files, false, PrioProject );
+}
+
+static inline bool isSpace( char ch )
+{
+    return ch == ' ' || ch == '\t' || ch == '\r' || ch == '\n' || ch == '\f' || ch == '\v';
+}
+
+static inline bool isIdentStart( char ch )
+{
+    return ( ch >= 'a' && ch <= 'z' ) || ( ch >= 'A' && ch <= 'Z' ) || ch == '_';
+}
+
+static inline bool isIdentChar( char ch )
+{
+    return isIdentStart(ch) || ( ch >= '0' && ch <= '9' ) || ch == '$';
+}
+
+bool CrossRefModel::scanChunks(const QByteArray& text, ChunkList& chunks, QList<int>& offsets)
+{
+    // Lightweight scan for the top level descriptions; only modules and primitives are allowed on top level,
+    // and no compiler directives, because these make the meaning of the text depend on what comes before.
+    // A chunk ends with the line end after endmodule or endprimitive, including comments up to the next
+    // description; the meaning of the text of a chunk therefore doesn't depend on the other chunks.
+    const char* str = text.constData();
+    const int len = text.size();
+    quint32 line = 1;
+    int chunkStart = 0;
+    quint32 chunkLine = 1;
+    int candidate = -1; // offset after the line end where the current chunk could end
+    quint32 candidateLine = 0;
+    bool inCell = false;
+    bool afterEnd = false;
+    bool colon = false; // endmodule may be followed by ': label' on the same line (SystemVerilog)
+    int i = 0;
+    while( i < len )
+    {
+        const char ch = str[i];
+        if( ch == '\n' )
+        {
+            if( !inCell && afterEnd )
+            {
+                candidate = i + 1;
+                candidateLine = line;
+            }
+            line++;
+            i++;
+        }else if( ch == '/' && i + 1 < len && str[i+1] == '/' )
+        {
+            while( i < len && str[i] != '\n' )
+                i++;
+        }else if( ch == '/' && i + 1 < len && str[i+1] == '*' )
+        {
+            i += 2;
+            while( i < len && !( str[i] == '*' && i + 1 < len && str[i+1] == '/' ) )
+            {
+                if( str[i] == '\n' )
+                    line++;
+                i++;
+            }
+            i += 2;
+        }else if( ch == '"' )
+        {
+            if( !inCell )
+                return false;
+            i++;
+            while( i < len && str[i] != '"' )
+            {
+                if( str[i] == '\\' && i + 1 < len )
+                    i++;
+                if( str[i] == '\n' )
+                    line++;
+                i++;
+            }
+            i++;
+        }else if( ch == '`' )
+            return false;
+        else if( ch == '\\' )
+        {
+            if( !inCell )
+                return false;
+            while( i < len && !isSpace(str[i]) )
+                i++;
+        }else if( isIdentStart(ch) )
+        {
+            const int start = i;
+            while( i < len && isIdentChar(str[i]) )
+                i++;
+            const QByteArray id = QByteArray::fromRawData( str + start, i - start );
+            if( inCell )
+            {
+                if( id == "endmodule" || id == "endprimitive" )
+                {
+                    inCell = false;
+                    afterEnd = true;
+                }
+            }else if( id == "module" || id == "macromodule" || id == "primitive" )
+            {
+                if( candidate != -1 )
+                {
+                    Chunk c;
+                    c.d_lineFrom = chunkLine;
+                    c.d_lineTo = candidateLine;
+                    c.d_len = candidate - chunkStart;
+                    chunks.append(c);
+                    offsets.append(chunkStart);
+                    chunkStart = candidate;
+                    chunkLine = candidateLine + 1;
+                    candidate = -1;
+                }
+                inCell = true;
+                afterEnd = false;
+                colon = false;
+            }else if( colon )
+                colon = false;
+            else
+                return false;
+        }else if( ch == ':' && !inCell && afterEnd && candidate == -1 && !colon )
+        {
+            colon = true;
+            i++;
+        }else if( inCell && ( ( ch >= '0' && ch <= '9' ) || ch == '\'' ) )
+        {
+            // skip based numbers so that e.g. 'hend.. is not taken for an identifier
+            i++;
+            while( i < len && ( isIdentChar(str[i]) || str[i] == '\'' ) )
+                i++;
+        }else if( ch == '(' && !inCell && i + 1 < len && str[i+1] == '*' )
+        {
+            // attribute instance in front of a module
+            i += 2;
+            while( i < len && !( str[i] == '*' && i + 1 < len && str[i+1] == ')' ) )
+            {
+                if( str[i] == '\n' )
+                    line++;
+                i++;
+            }
+            i += 2;
+        }else if( inCell || isSpace(ch) )
+            i++;
+        else
+            return false;
+    }
+    Chunk c;
+    c.d_lineFrom = chunkLine;
+    c.d_lineTo = line;
+    c.d_len = len - chunkStart;
+    chunks.append(c);
+    offsets.append(chunkStart);
+    for( int n = 0; n < chunks.size(); n++ )
+        chunks[n].d_hash = Hash::xx64( str + offsets[n], chunks[n].d_len );
+    return true;
+}
+
+static void countSynTree( const SynTree* st, CrossRefModel::FileStats& counts )
+{
+    counts.d_synTreeNodes++;
+    if( st->d_tok.d_type < SynTree::R_First )
+        counts.d_tokens++;
+    foreach( const SynTree* sub, st->d_children )
+        countSynTree( sub, counts );
+}
+
 bool CrossRefModel::parseStream(QIODevice* stream, const QString& sourcePath, CrossRefModel::ScopeRefList& refs,
                                 CrossRefModel::IfDefOutLists& idols, SectionList& secs, Errors* errs, PpSymbols* syms,
-                                Includes* incs, FileCache* fcache)
+                                Includes* incs, FileCache* fcache, const QAtomicInt* stop, FileStats* counts,
+                                TokenTable* toks, Digest* deps)
+{
+    const quint32 errCount = errs->getErrCount();
+    QList<Token> sectionToks;
+    // we need a SynTree in any case even with syntax errors
+    refs.append( parseFragment( stream, sourcePath, 1, idols, sectionToks, errs, syms, incs, fcache, stop, counts,
+                                toks, deps ) );
+    fillSections( sectionToks, sourcePath, secs );
+    return errs->getErrCount() == errCount;
+}
+
+CrossRefModel::ScopeRefNc CrossRefModel::parseFragment(QIODevice* stream, const QString& sourcePath, quint32 firstLine,
+                                                       IfDefOutLists& idols, QList<Token>& sectionToks, Errors* errs,
+                                                       PpSymbols* syms, Includes* incs, FileCache* fcache,
+                                                       const QAtomicInt* stop, FileStats* counts, TokenTable* toks,
+                                                       Digest* deps)
 {
+    VL_TRACE_FILE( "CrossRefModel::parseFragment", sourcePath );
     PpLexer lex;
     lex.setErrors( errs );
     lex.setSyms( syms );
     lex.setIncs( incs );
     lex.setCache(fcache);
+    lex.setCancel(stop);
+    lex.setTokenTable(toks);
     lex.setIgnoreAttrs(false);
     lex.setPackAttrs(false);
     lex.setSendMacroUsage(true);
-
-    lex.setStream( stream, sourcePath );
-
-    Parser p(&lex, errs);
-
-    int errCount = errs->getErrCount();
-    p.RunParser();
-    errCount = errs->getErrCount() - errCount;
-
-    if( true ) // res ) // we need a SynTree in any case even with syntax errors
-    {
-        SynTree root;
-        root.d_children = p.d_root.d_children;
-        p.d_root.d_children.clear();
-        ScopeRef top = createAst( &root, errs );
-//        qDebug() << "*** parsed" << sourcePath;
-//        foreach( const SymRef& sym, top->children() )
-//            qDebug() << sym->d_tok.d_val << sym->d_tok.d_lineNr;
-        refs.append(top);
-        idols = lex.getIdols();
-        QList<int> stack;
-        foreach( Token tok, p.d_sections )
-        {
-            if( tok.d_sourcePath != sourcePath )
-                continue;
-            if( tok.d_type == Tok_Section )
-            {
-                Section s;
-                s.d_lineFrom = s.d_lineTo = tok.d_lineNr;
-                s.d_title = tok.d_val;
-                secs.append(s);
-                stack.push_back( secs.size() - 1 );
-            }else if( tok.d_type == Tok_SectionEnd )
-            {
-                if( !stack.isEmpty() )
-                {
-                    int i = stack.back();
-                    stack.pop_back();
-                    Q_ASSERT( i < secs.size() );
-                    secs[i].d_lineTo = tok.d_lineNr;
-                }
-            }
+    QStringList missing;
+    if( deps )
+        lex.setDeps( &deps->d_macros, &missing );
+
+    lex.setStream( stream, sourcePath, false, firstLine );
+
+    // The symbols are built directly from each top level production as soon as the parser completes it;
+    // so only the SynTree of one module at a time is alive instead of the one of the whole file.
+    struct AstBuilder : public ParserSink
+    {
+        Scope* d_top;
+        Errors* d_errs;
+        FileStats* d_counts;
+        void onTopLevel( SynTree* st )
+        {
+            VL_TRACE_FILE( "CrossRefModel::fillAstTop", st->d_tok.d_sourcePath );
+            if( d_counts )
+                countSynTree( st, *d_counts );
+            fillAstTop( d_top, st, d_errs );
+            delete st;
         }
+    };
+    ScopeRefNc top( new Scope() );
+    AstBuilder builder;
+    builder.d_top = top.data();
+    builder.d_errs = errs;
+    builder.d_counts = counts;
+
+    Parser p(&lex, errs);
+#ifndef _DUMP_ST
+    p.setSink( &builder );
+#endif
+
+    p.RunParser();
 
 #ifdef _DUMP_ST
-        dumpSt( sourcePath, &root );
+    // only in this case the SynTree of the whole file is materialized
+    dumpSt( sourcePath, &p.d_root );
+    foreach( const SynTree* st, p.d_root.d_children )
+    {
+        if( counts )
+            countSynTree( st, *counts );
+        fillAstTop( top.data(), st, errs );
+    }
 #endif
+    idols = lex.getIdols();
+    if( deps )
+    {
+        foreach( const QString& path, missing )
+            deps->d_deps[path] = 0;
+    }
+    foreach( const Token& tok, p.d_sections )
+    {
+        if( tok.d_sourcePath == sourcePath )
+            sectionToks.append(tok);
+    }
 #ifdef _DUMP_AST
-        dumpAst( sourcePath, top.constData() );
+    dumpAst( sourcePath, top.constData() );
 #endif
 //        qDebug() << "************** name table of" << file;
 //        Scope::Names::const_iterator n;
 //        for( n = top->d_names.begin(); n != top->d_names.end(); ++n )
 //            qDebug() << n.key() << SynTree::rToStr(n.value()->d_tok.d_type) << n.value()->d_tok.d_lineNr;
+    return top;
+}
+
+void CrossRefModel::fillSections(const QList<Token>& sectionToks, const QString& sourcePath, SectionList& secs)
+{
+    QList<int> stack;
+    foreach( const Token& tok, sectionToks )
+    {
+        if( tok.d_sourcePath != sourcePath )
+            continue;
+        if( tok.d_type == Tok_Section )
+        {
+            Section s;
+            s.d_lineFrom = s.d_lineTo = tok.d_lineNr;
+            s.d_title = tok.d_val;
+            secs.append(s);
+            stack.push_back( secs.size() - 1 );
+        }else if( tok.d_type == Tok_SectionEnd )
+        {
+            if( !stack.isEmpty() )
+            {
+                int i = stack.back();
+                stack.pop_back();
+                Q_ASSERT( i < secs.size() );
+                secs[i].d_lineTo = tok.d_lineNr;
+            }
+        }
     }
-    return errCount == 0;
 }
 
 void CrossRefModel::insertFiles(const QStringList& files, const ScopeRefList& scopes,
-                                const IfDefOutLists& idols, const SectionLists& secs, Errors* errs, bool lock )
+                                const IfDefOutLists& idols, const SectionLists& secs, Errors* errs, bool lock,
+                                const Reparse* reparse )
 {
+    VL_TRACE( "CrossRefModel::insertFiles" );
     if( lock )
         d_lock.lockForRead();
-    Scope newGlobal = d_global;
+    // only implicitly shared copies; only the partitions of the updated files are detached and modified
+    Scope newGlobal;
+    newGlobal.d_names = d_global.d_names;
+    Files newFiles = d_files;
     IfDefOutLists newIdols = d_idols;
-    SectionLists newSecs = d_sections;
+    const int threads = d_resolverThreads > 0 ? d_resolverThreads : QThread::idealThreadCount();
+    const bool indexNames = d_indexNames;
     if( lock )
         d_lock.unlock();
 
@@ -1259,60 +2897,123 @@ void CrossRefModel::insertFiles(const QStringList& files, const ScopeRefList& sc
 
     int errCount = errs->getErrCount();
 
+    // the semantic tokens of the other files only change if the names or kinds of the decls in the updated
+    // files change; only the decls of reused chunks stay the same objects
+    QSet<QByteArray> oldKinds, newKinds;
+    foreach( const QString& file, files )
+        foreach( const IdentDecl* id, newFiles.value(file).d_names )
+            collectDeclKinds( id, oldKinds );
+
     // Lösche zuerst alles, was die neu geparsten Files betrifft, aus dem existierenden Global
     foreach( const QString& file, files )
-        clearFile(&newGlobal,file);
+        clearFile(&newGlobal,newFiles,file);
+
+    // the chunks first, the messages below need the line shifts
+    UpdateStats stats;
+    if( reparse )
+    {
+        stats = reparse->d_stats;
+        ChunkLists::const_iterator k;
+        for( k = reparse->d_chunks.begin(); k != reparse->d_chunks.end(); ++k )
+        {
+            newFiles[k.key()].d_chunks = k.value();
+            newFiles[k.key()].d_shifts = lineShifts( k.value() );
+        }
+        QMap<QString,FileStats>::const_iterator c;
+        for( c = reparse->d_counts.begin(); c != reparse->d_counts.end(); ++c )
+        {
+            // one entry for each parsed file
+            FileData& fd = newFiles[c.key()];
+            fd.d_tokens = c.value().d_tokens;
+            fd.d_synTreeNodes = c.value().d_synTreeNodes;
+            fd.d_toks = reparse->d_toks.value( c.key() );
+            fd.d_withToks = reparse->d_keepToks;
+        }
+        QMap<QString,Digest>::const_iterator d;
+        for( d = reparse->d_digests.begin(); d != reparse->d_digests.end(); ++d )
+            newFiles[d.key()].d_digest = d.value();
+    }
 
     // scopes enthält für jedes geparste File einen Scope
+    QSet<QString> touched;
+    QList<Branch*> attached; // the new cells; the ones of reused chunks already point to d_global
     foreach( const ScopeRef& scope, scopes )
     {
         // Prüfe, ob die Namen in scope allenfalls schon existieren, ansonsten füge sie in Global
-        Scope::Names::const_iterator scopeIter;
-        for( scopeIter = scope->d_names.begin(); scopeIter != scope->d_names.end(); ++scopeIter )
+        foreach( const IdentDecl* newDecl, scope->d_names.values() )
         {
-            Scope::Names::const_iterator globalIter = newGlobal.d_names.find( scopeIter.key() );
-            if( globalIter != newGlobal.d_names.end() )
-            {
-                const IdentDecl* newDecl = scopeIter.value();
-                const IdentDecl* existingDecl = globalIter.value();
+            const IdentDecl* existingDecl = newGlobal.d_names.insert( newDecl->d_tok.d_val, newDecl );
+            if( existingDecl != 0 )
                 errs->error(Errors::Semantics, newDecl->d_decl->d_tok.d_sourcePath,
-                            newDecl->d_decl->d_tok.d_lineNr, newDecl->d_decl->d_tok.d_colNr,
-                              tr("duplicate cell name '%1' already declared in %2")
-                            .arg( newDecl->d_tok.d_val.data() )
-                            .arg( existingDecl->d_tok.d_sourcePath ) );
-            }else
-                newGlobal.d_names.insert( scopeIter.key(), scopeIter.value() );
-
+                            currentLine( newFiles.value( newDecl->d_decl->d_tok.d_sourcePath ).d_shifts,
+                                         newDecl->d_decl->d_tok.d_lineNr ), newDecl->d_decl->d_tok.d_colNr,
+                            Errors::Msg_DuplicateCell, newDecl->d_tok.d_val,
+                            existingDecl->d_tok.d_sourcePath.toUtf8() );
+            else
+                newFiles[newDecl->d_tok.d_sourcePath].d_names.append(newDecl);
         }
         // Alle children von scope werden übernommen und auf den neuen Global angepasst
         foreach( const SymRef& s, scope->children() )
         {
             Branch* b = const_cast<Branch*>( s->toBranch() );
-            b->d_super = &newGlobal;
+            if( b->d_super != &d_global )
+            {
+                b->d_super = &newGlobal;
+                attached.append( b );
+            }
+            newFiles[s->d_tok.d_sourcePath].d_cells.append(s);
+            touched.insert(s->d_tok.d_sourcePath);
         }
-        newGlobal.d_children += scope->d_children;
+    }
 
+    SectionLists::const_iterator j;
+    for( j = secs.begin(); j != secs.end(); ++j )
+        newFiles[j.key()].d_sections = j.value();
+    if( indexNames )
+    {
+        // only the updated files are indexed again, the others keep their index
+        foreach( const QString& file, files + touched.toList() )
+        {
+            Files::iterator fd = newFiles.find( file );
+            if( fd == newFiles.end() || fd.value().d_withNames )
+                continue;
+            fd.value().d_withNames = true;
+            foreach( const SymRef& cell, fd.value().d_cells )
+                collectDecls( cell.constData(), fd.value().d_nameIdx );
+            fd.value().d_nameIdx.build();
+        }
     }
 
+    // one pass over the partitions; no source path comparisons needed
+    Files::const_iterator f;
+    for( f = newFiles.begin(); f != newFiles.end(); ++f )
+        newGlobal.d_children += f.value().d_cells;
+
     Index index;
     RevIndex revIndex;
+    QList<const Scope*> cells;
     foreach( const SymRef& sub, newGlobal.d_children )
     {
         const Scope* cell = sub->toScope();
         // NOTE: the d_super of all scopes not in files still point to d_global! We don't care since this is
         // the only thread causing mutations and the mutations are serialized
         if( cell ) // sub may be 0!
-            resolveIdents( index, revIndex, cell, 0, cell, &newGlobal, errs );
+            cells.append(cell);
     }
+    stats.d_mergeMs = t.restart();
+    Errors rerrs(0,true);
+    rerrs.setShowWarnings( errs->showWarnings() );
+    rerrs.setReportToConsole( false );
+    rerrs.setRecord( true );
+    resolveCells( index, revIndex, cells, &newGlobal, &rerrs, threads );
+    shiftErrors( rerrs, newFiles, errs );
+    revIndex.build();
+    stats.d_resolveMs = t.elapsed();
 
     IfDefOutLists::const_iterator i;
     for( i = idols.begin(); i != idols.end(); ++i )
         newIdols.insert( i.key(), i.value() );
 
-    SectionLists::const_iterator j;
-    for( j = secs.begin(); j != secs.end(); ++j )
-        newSecs.insert( j.key(), j.value() );
-
     errCount = errs->getErrCount() - errCount;
 
 //    if( errs->reportToConsole() )
@@ -1320,22 +3021,48 @@ void CrossRefModel::insertFiles(const QStringList& files, const ScopeRefList& sc
 //                 << "ms with" << errCount << "errors";
 
     if( lock )
+    {
+        VL_TRACE( "CrossRefModel::waitForWriteLock" );
         d_lock.lockForWrite();
+    }
     t.restart();
+    VL_TRACE( "CrossRefModel::swap" );
     d_index = index;
     d_revIndex = revIndex;
     d_idols = newIdols;
-    d_sections = newSecs;
+    d_files = newFiles;
+    // the views of all scopes include the global names; most updates don't change them
+    const bool globalsChanged = !( d_global.d_names == newGlobal.d_names );
     d_global.d_names = newGlobal.d_names;
     d_global.d_children = newGlobal.d_children;
-    foreach( const SymRef& sub, d_global.d_children )
+    d_global.resetCaches();
+    if( globalsChanged )
     {
-        Scope* cell = const_cast<Scope*>( sub->toScope());
-        if( cell ) // sub may be 0
-            cell->d_super = &d_global;
+        Files::const_iterator f;
+        for( f = d_files.begin(); f != d_files.end(); ++f )
+            foreach( const SymRef& cell, f.value().d_cells )
+                resetViews( cell.constData() );
     }
+    d_hierLock.lock();
+    clearHierarchy();
+    d_hierLock.unlock();
+    foreach( const QString& file, files )
+        foreach( const IdentDecl* id, d_files.value(file).d_names )
+            collectDeclKinds( id, newKinds );
+    d_semLock.lock();
+    if( oldKinds != newKinds )
+        d_semToks.clear();
+    else
+        foreach( const QString& file, files )
+            d_semToks.remove( file );
+    d_semLock.unlock();
+    foreach( Branch* b, attached )
+        b->d_super = &d_global; // only the new cells point to newGlobal
     d_errs->clearFiles(files);
     d_errs->update( *errs );
+    stats.d_swapMs = t.elapsed();
+    d_lastUpdate = stats;
+    d_allUpdates.add( stats );
 //    if( errs->reportToConsole() )
 //        qDebug() << "### Replaced global scope in" << t.elapsed() << "ms";
     if( lock )
@@ -1346,23 +3073,50 @@ void CrossRefModel::insertFiles(const QStringList& files, const ScopeRefList& sc
         emit sigFileUpdated(file);
 }
 
-void CrossRefModel::clearFile(Scope* global, const QString& file)
+void CrossRefModel::resolveCells(Index& index, RevIndex& revIndex, const QList<const Scope*>& cells,
+                                 const Scope* globScope, Errors* errs, int threads)
 {
-    SymRefList children = global->d_children;
-    global->d_children.clear();
-    for( int i = 0; i < children.size(); i++ )
+    VL_TRACE( "CrossRefModel::resolveCells" );
+    // From here on globScope and all cells are only read, so the cells can be resolved independently.
+    // Each Resolver works on a contiguous chunk with its own Index, RevIndex and Errors, which are merged
+    // in chunk order afterwards so that the result does not depend on thread scheduling.
+    const int minCellsPerThread = 16;
+    const int n = qBound( 1, cells.size() / minCellsPerThread, qMax( 1, threads ) );
+    if( n == 1 )
     {
-        if( children[i]->d_tok.d_sourcePath != file )
-            global->d_children.append(children[i]);
+        foreach( const Scope* cell, cells )
+            resolveIdents( index, revIndex, cell, 0, cell, globScope, errs );
+        return;
     }
-    Scope::Names::iterator i = global->d_names.begin();
-    while( i != global->d_names.end() )
+    QList<Resolver*> resolvers;
+    const int chunk = ( cells.size() + n - 1 ) / n;
+    for( int i = 0; i < cells.size(); i += chunk )
     {
-        if( i.value()->d_tok.d_sourcePath == file )
-            i = global->d_names.erase(i);
-        else
-            ++i;
+        Resolver* r = new Resolver(errs);
+        r->d_global = globScope;
+        r->d_cells = cells.mid( i, chunk );
+        resolvers.append(r);
+        r->start();
     }
+    foreach( Resolver* r, resolvers )
+    {
+        r->wait();
+        index.unite( r->d_index );
+        revIndex.merge( r->d_revIndex );
+        errs->merge( r->d_errs );
+        delete r;
+    }
+}
+
+void CrossRefModel::clearFile(Scope* global, Files& files, const QString& file)
+{
+    // Only touches what the file owns; global->d_children is rebuilt from the partitions afterwards
+    Files::iterator i = files.find(file);
+    if( i == files.end() )
+        return;
+    foreach( const IdentDecl* id, i.value().d_names )
+        global->d_names.remove( id->d_tok.d_val );
+    files.erase(i);
 }
 
 void CrossRefModel::resolveIdents(Index& index, RevIndex& revIndex, const Symbol* leaf, const Branch* parent,
@@ -1378,7 +3132,7 @@ void CrossRefModel::resolveIdents(Index& index, RevIndex& revIndex, const Symbol
             revIndex.insert( id, use );
         }else if( parent->tok().d_type != Tok_Attribute )
             errs->error(Errors::Semantics, use->d_tok.d_sourcePath, use->d_tok.d_lineNr, use->d_tok.d_colNr,
-                          tr("unknown identifier: %1").arg(use->d_tok.d_val.data()) );
+                          Errors::Msg_UnknownIdent, use->d_tok.d_val );
     }else if( const PathIdent* use = leaf->toPathIdent() )
     {
         // Jeder hierarchical_identifier/_x enthält als children die ganze Kette von Idents
@@ -1411,22 +3165,19 @@ void CrossRefModel::resolveIdents(Index& index, RevIndex& revIndex, const Symbol
                         if( id->d_decl->d_tok.d_type == SynTree::R_module_or_udp_instance_ )
                         {
                             Q_ASSERT( id->d_decl->d_super != 0 && id->d_decl->d_super->d_tok.d_type == SynTree::R_module_or_udp_instantiation_ );
-
-                            const IdentDecl* cellId = findNameInScope( globScope, id->d_decl->d_super->d_tok.d_val, false, false );
-                            if( cellId != 0 )
-                                scope = cellId->decl()->toScope();
+                            scope = findCellOfInstance( id, globScope );
                         }else
                             scope = id->d_decl->toScope();
                         if( scope == 0 )
                         {
                             errs->error(Errors::Semantics, id->d_tok.d_sourcePath, id->d_tok.d_lineNr, id->d_tok.d_colNr,
-                                          tr("identifier is not a name space: %1").arg(id->d_tok.d_val.data()) );
+                                          Errors::Msg_NotANameSpace, id->d_tok.d_val );
                             break;
                         }
                     }
                 }else
                     errs->error(Errors::Semantics, path[i]->d_tok.d_sourcePath, path[i]->d_tok.d_lineNr, path[i]->d_tok.d_colNr,
-                                  tr("unknown identifier: %1").arg(path[i]->d_tok.d_val.data()) );
+                                  Errors::Msg_UnknownIdent, path[i]->d_tok.d_val );
             }
         }
     }else if( const PortRef* ref = leaf->toPortRef() )
@@ -1455,7 +3206,7 @@ void CrossRefModel::resolveIdents(Index& index, RevIndex& revIndex, const Symbol
                 revIndex.insert( id, ref );
             }else
                 errs->error(Errors::Semantics, ref->d_tok.d_sourcePath, ref->d_tok.d_lineNr, ref->d_tok.d_colNr,
-                              tr("unknown port or parameter: %1").arg(ref->d_tok.d_val.data()) );
+                              Errors::Msg_UnknownPortOrParam, ref->d_tok.d_val );
         }
     }else if( const CellRef* ref = leaf->toCellRef() )
     {
@@ -1466,7 +3217,7 @@ void CrossRefModel::resolveIdents(Index& index, RevIndex& revIndex, const Symbol
             revIndex.insert( cellId, ref );
         }else
             errs->error(Errors::Elaboration, ref->d_tok.d_sourcePath, ref->d_tok.d_lineNr, ref->d_tok.d_colNr,
-                          tr("unknown module or udp: %1").arg(ref->d_tok.d_val.data()) );
+                          Errors::Msg_UnknownModule, ref->d_tok.d_val );
     }
     foreach( const SymRef& sub, leaf->children() )
     {
@@ -1484,44 +3235,577 @@ CrossRefModel::Branch::Branch():d_super(0)
 
 CrossRefModel::Scope::Names2 CrossRefModel::Scope::getNames2(bool recursive) const
 {
+    if( recursive )
+        return visibleNames(); // shares the cached map
     Names2 res;
+    addOwnNames( res );
+    return res;
+}
+
+void CrossRefModel::Scope::addOwnNames(Names2& res) const
+{
+    if( d_tok.d_type == SynTree::R_module_declaration && d_lop != 0 )
+    {
+        foreach( const IdentDecl* id, d_lop->d_names.values() )
+            res.insert( id->d_tok.d_val, IdentDeclRef(id) );
+    }
+
+    foreach( const IdentDecl* id, d_names.values() )
+        res.insert( id->d_tok.d_val, IdentDeclRef(id) );
+}
+
+const CrossRefModel::Scope::Names2& CrossRefModel::Scope::visibleNames() const
+{
+    Names2* res = d_visible.loadAcquire();
+    if( res )
+        return *res;
+    // shares the view of super; the first insert below copies it once, a scope without names doesn't
     const Scope* super = d_super ? d_super->toScope() : 0;
-    if( recursive && super != 0 )
-        res = super->getNames2(recursive);
+    if( super != 0 )
+        res = new Names2( super->visibleNames() );
+    else
+        res = new Names2();
+    addOwnNames( *res );
+    // readers may race to build it; the first one is kept, like d_sorted
+    if( d_visible.testAndSetOrdered( 0, res ) )
+        return *res;
+    delete res;
+    return *d_visible.loadAcquire();
+}
+
+CrossRefModel::IdentDeclRefList CrossRefModel::Scope::getNames() const
+{
+    IdentDeclRefList res;
+    if( d_tok.d_type == SynTree::R_module_declaration && d_lop != 0 )
+    {
+        foreach( const IdentDecl* id, d_lop->d_names.sortedValues() )
+            res.append( IdentDeclRef(id) );
+    }
+    foreach( const IdentDecl* id, d_names.sortedValues() )
+        res.append( IdentDeclRef(id) );
+    return res;
+}
+
+CrossRefModel::Scope::~Scope()
+{
+    delete d_sorted.load();
+    delete d_visible.load();
+}
 
-    if( d_tok.d_type == SynTree::R_module_declaration )
+bool CrossRefModel::Scope::lessNameEntry(const NameEntry& lhs, const NameEntry& rhs)
+{
+    return ::strcmp( lhs.d_name, rhs.d_name ) < 0;
+}
+
+const CrossRefModel::Scope::SortedNames& CrossRefModel::Scope::sortedNames() const
+{
+    SortedNames* res = d_sorted.loadAcquire();
+    if( res )
+        return *res;
+    res = new SortedNames();
+    QSet<const char*> own;
+    foreach( const IdentDecl* id, d_names.values() )
+    {
+        NameEntry e;
+        e.d_name = id->d_tok.d_val.constData();
+        e.d_decl = id;
+        res->append( e );
+        own.insert( e.d_name );
+    }
+    if( d_tok.d_type == SynTree::R_module_declaration && d_lop != 0 )
     {
-        const Scope* lop = Symbol::toScope( findFirst( this, SynTree::R_list_of_ports) );
-        if( lop )
+        // like getNames2, the own names hide the port names
+        foreach( const IdentDecl* id, d_lop->d_names.values() )
         {
-            Names::const_iterator i;
-            for( i = lop->d_names.begin(); i != lop->d_names.end(); ++i )
-                res.insert( i.key(), IdentDeclRef(i.value()) );
+            NameEntry e;
+            e.d_name = id->d_tok.d_val.constData();
+            e.d_decl = id;
+            if( !own.contains( e.d_name ) )
+                res->append( e );
         }
     }
+    std::sort( res->begin(), res->end(), lessNameEntry );
+    res->squeeze();
+    // readers may race to build it; the first one is kept
+    if( d_sorted.testAndSetOrdered( 0, res ) )
+        return *res;
+    delete res;
+    return *d_sorted.loadAcquire();
+}
 
-    Names::const_iterator i;
-    for( i = d_names.begin(); i != d_names.end(); ++i )
-        res.insert( i.key(), IdentDeclRef(i.value()) );
+void CrossRefModel::Scope::resetCaches()
+{
+    delete d_sorted.fetchAndStoreOrdered( 0 );
+    delete d_visible.fetchAndStoreOrdered( 0 );
+}
+
+const CrossRefModel::IdentDecl* CrossRefModel::Scope::Names::value(const QByteArray& atom) const
+{
+    if( d_count == 0 || atom.isEmpty() )
+        return 0;
+    return d_slots[ lookup( atom.constData() ) ].d_decl;
+}
+
+const CrossRefModel::IdentDecl* CrossRefModel::Scope::Names::insert(const QByteArray& atom, const IdentDecl* id)
+{
+    Q_ASSERT( id != 0 && Atoms::find(atom).constData() == atom.constData() );
+    if( ( d_count + 1 ) * 4 > d_slots.size() * 3 ) // max load factor 0.75
+        rehash( d_slots.isEmpty() ? 8 : d_slots.size() * 2 );
+    Slot& s = d_slots[ lookup( atom.constData() ) ];
+    if( s.d_decl != 0 )
+        return s.d_decl;
+    s.d_atom = atom.constData();
+    s.d_decl = id;
+    d_count++;
+    return 0;
+}
+
+void CrossRefModel::Scope::Names::clear()
+{
+    d_slots.clear();
+    d_count = 0;
+}
+
+QList<const CrossRefModel::IdentDecl*> CrossRefModel::Scope::Names::values() const
+{
+    QList<const IdentDecl*> res;
+    res.reserve(d_count);
+    for( int i = 0; i < d_slots.size(); i++ )
+    {
+        if( d_slots[i].d_decl )
+            res.append( d_slots[i].d_decl );
+    }
+    return res;
+}
 
+QList<const CrossRefModel::IdentDecl*> CrossRefModel::Scope::Names::sortedValues() const
+{
+    // the same order as the former QMap based table
+    QList<const IdentDecl*> res = values();
+    std::sort( res.begin(), res.end(), lessByName );
     return res;
 }
 
-CrossRefModel::IdentDeclRefList CrossRefModel::Scope::getNames() const
+uint CrossRefModel::Scope::Names::hashOf(const char* atom)
 {
-    IdentDeclRefList res;
-    if( d_tok.d_type == SynTree::R_module_declaration )
+    return uint( ( quintptr(atom) >> 3 ) * 2654435761u ); // pointer hash (Knuth)
+}
+
+bool CrossRefModel::Scope::Names::operator==(const Names& rhs) const
+{
+    if( d_count != rhs.d_count )
+        return false;
+    foreach( const Slot& s, d_slots )
+    {
+        if( s.d_decl != 0 && rhs.d_slots[ rhs.lookup( s.d_atom ) ].d_decl != s.d_decl )
+            return false;
+    }
+    return true;
+}
+
+bool CrossRefModel::Scope::Names::remove(const QByteArray& atom)
+{
+    if( d_count == 0 )
+        return false;
+    const int mask = d_slots.size() - 1;
+    int i = lookup( atom.constData() );
+    if( d_slots[i].d_decl == 0 )
+        return false;
+    // backward shift deletion, so no tombstones are needed
+    int j = i;
+    while( true )
+    {
+        j = ( j + 1 ) & mask;
+        if( d_slots[j].d_decl == 0 )
+            break;
+        const int k = hashOf( d_slots[j].d_atom ) & mask; // home slot of j
+        if( ( i <= j ) ? ( i < k && k <= j ) : ( i < k || k <= j ) )
+            continue; // j can stay where it is
+        d_slots[i] = d_slots[j];
+        i = j;
+    }
+    d_slots[i] = Slot();
+    d_count--;
+    return true;
+}
+
+int CrossRefModel::Scope::Names::lookup(const char* atom) const
+{
+    Q_ASSERT( !d_slots.isEmpty() );
+    const int mask = d_slots.size() - 1;
+    int i = hashOf( atom ) & mask;
+    while( d_slots[i].d_decl != 0 )
+    {
+        if( d_slots[i].d_atom == atom )
+            return i;
+        i = ( i + 1 ) & mask;
+    }
+    return i;
+}
+
+void CrossRefModel::Scope::Names::rehash(int capacity)
+{
+    QVector<Slot> old = d_slots;
+    d_slots = QVector<Slot>( capacity );
+    for( int i = 0; i < old.size(); i++ )
+    {
+        if( old[i].d_decl )
+            d_slots[ lookup( old[i].d_atom ) ] = old[i];
+    }
+}
+
+void CrossRefModel::RevIndex::insert(const Symbol* decl, const Symbol* ref)
+{
+    Pending p;
+    p.d_decl = decl;
+    p.d_ref = ref;
+    p.d_file = 0;
+    d_pending.append(p);
+}
+
+bool CrossRefModel::RevIndex::lessPending( const Pending& lhs, const Pending& rhs )
+{
+    if( lhs.d_decl != rhs.d_decl )
+        return lhs.d_decl < rhs.d_decl;
+    return lhs.d_file < rhs.d_file;
+}
+
+void CrossRefModel::RevIndex::merge(const RevIndex& rhs)
+{
+    d_pending += rhs.d_pending;
+}
+
+void CrossRefModel::RevIndex::build()
+{
+    d_decls.clear();
+    d_firstPart.clear();
+    d_parts.clear();
+    d_refs.clear();
+    d_fileIds.clear();
+
+    // The paths of a file usually share the same QString data and the pairs arrive file by file, so the hash is
+    // only consulted when the data pointer differs from the one of the previous pair
+    const QChar* lastPath = 0;
+    quint32 lastId = 0;
+    for( int i = 0; i < d_pending.size(); i++ )
+    {
+        const QString& path = d_pending[i].d_ref->tok().d_sourcePath;
+        if( lastPath == 0 || path.constData() != lastPath )
+        {
+            QHash<QString,quint32>::const_iterator f = d_fileIds.find( path );
+            if( f == d_fileIds.end() )
+                f = d_fileIds.insert( path, d_fileIds.size() );
+            lastPath = path.constData();
+            lastId = f.value();
+        }
+        d_pending[i].d_file = lastId;
+    }
+    // the pairs arrive in the order of the cells and of the symbols within them, i.e. by position within each file;
+    // the lines of the symbols of a reused chunk are not the current ones, so only the order of arrival is used
+    std::stable_sort( d_pending.begin(), d_pending.end(), lessPending );
+
+    d_refs.reserve( d_pending.size() );
+    for( int i = 0; i < d_pending.size(); i++ )
     {
-        const Scope* lop = Symbol::toScope( findFirst( this, SynTree::R_list_of_ports) );
-        if( lop )
+        const Pending& p = d_pending[i];
+        if( d_decls.isEmpty() || d_decls.last() != p.d_decl )
+        {
+            d_decls.append( p.d_decl );
+            d_firstPart.append( d_parts.size() );
+        }
+        if( d_parts.size() == int(d_firstPart.last()) || d_parts.last().d_file != p.d_file )
         {
-            Names::const_iterator i;
-            for( i = lop->d_names.begin(); i != lop->d_names.end(); ++i )
-                res.append( IdentDeclRef(i.value()) );
+            Part part;
+            part.d_file = p.d_file;
+            part.d_start = d_refs.size();
+            d_parts.append( part );
         }
+        d_refs.append( p.d_ref );
     }
-    Names::const_iterator i;
-    for( i = d_names.begin(); i != d_names.end(); ++i )
-        res.append( IdentDeclRef(i.value()) );
+    d_firstPart.append( d_parts.size() );
+    Part sentinel;
+    sentinel.d_file = 0;
+    sentinel.d_start = d_refs.size();
+    d_parts.append( sentinel );
+    d_pending.clear();
+    d_pending.squeeze();
+}
+
+void CrossRefModel::RevIndex::clear()
+{
+    *this = RevIndex();
+}
+
+quint64 CrossRefModel::RevIndex::byteSize() const
+{
+    return d_pending.capacity() * sizeof(Pending) + d_decls.capacity() * sizeof(const Symbol*) +
+            d_firstPart.capacity() * sizeof(quint32) + d_parts.capacity() * sizeof(Part) +
+            d_refs.capacity() * sizeof(const Symbol*) +
+            d_fileIds.size() * ( sizeof(QString) + sizeof(quint32) + 2 * sizeof(void*) );
+}
+
+int CrossRefModel::RevIndex::findDecl(const Symbol* decl) const
+{
+    QVector<const Symbol*>::const_iterator i = std::lower_bound( d_decls.begin(), d_decls.end(), decl );
+    if( i == d_decls.end() || *i != decl )
+        return -1;
+    else
+        return i - d_decls.begin();
+}
+
+QList<const CrossRefModel::Symbol*> CrossRefModel::RevIndex::slice(const QVector<const Symbol*>& refs,
+                                                                   quint32 from, quint32 to)
+{
+    QList<const Symbol*> res;
+    res.reserve( to - from );
+    for( quint32 i = from; i < to; i++ )
+        res.append( refs[i] );
     return res;
 }
+
+QList<const CrossRefModel::Symbol*> CrossRefModel::RevIndex::values(const Symbol* decl) const
+{
+    const int i = findDecl(decl);
+    if( i < 0 )
+        return QList<const Symbol*>();
+    return slice( d_refs, d_parts[ d_firstPart[i] ].d_start, d_parts[ d_firstPart[i+1] ].d_start );
+}
+
+QList<const CrossRefModel::Symbol*> CrossRefModel::RevIndex::values(const Symbol* decl, const QString& file) const
+{
+    const int i = findDecl(decl);
+    if( i < 0 )
+        return QList<const Symbol*>();
+    const quint32 fileId = d_fileIds.value( file, quint32(-1) );
+    if( fileId == quint32(-1) )
+        return QList<const Symbol*>();
+    // the parts of a decl are sorted by file id
+    QVector<Part>::const_iterator begin = d_parts.begin() + d_firstPart[i];
+    QVector<Part>::const_iterator end = d_parts.begin() + d_firstPart[i+1];
+    QVector<Part>::const_iterator j = std::lower_bound( begin, end, fileId, lessPartFile );
+    if( j == end || j->d_file != fileId )
+        return QList<const Symbol*>();
+    return slice( d_refs, j->d_start, (j+1)->d_start );
+}
+
+CrossRefModel::NameIndex::Query::Query(const QByteArray& pattern, bool fuzzy):d_pattern(pattern),d_fuzzy(fuzzy)
+{
+    d_lower = pattern.toLower();
+    trigrams( d_lower, d_grams );
+    std::sort( d_grams.begin(), d_grams.end() );
+    d_grams.erase( std::unique( d_grams.begin(), d_grams.end() ), d_grams.end() );
+}
+
+bool CrossRefModel::NameIndex::Hit::operator<(const Hit& rhs) const
+{
+    if( d_match != rhs.d_match )
+        return d_match < rhs.d_match;
+    if( d_dist != rhs.d_dist )
+        return d_dist < rhs.d_dist;
+    if( d_len != rhs.d_len )
+        return d_len < rhs.d_len;
+    return d_name != rhs.d_name && ::strcmp( d_name, rhs.d_name ) < 0;
+}
+
+void CrossRefModel::NameIndex::trigrams(const QByteArray& lower, QVector<quint32>& res)
+{
+    const uchar* s = reinterpret_cast<const uchar*>( lower.constData() );
+    for( int i = 0; i + 2 < lower.size(); i++ )
+        res.append( ( quint32(s[i]) << 16 ) | ( quint32(s[i+1]) << 8 ) | s[i+2] );
+}
+
+bool CrossRefModel::NameIndex::lessDecl(const IdentDecl* lhs, const IdentDecl* rhs)
+{
+    return lhs->d_tok.d_val.constData() < rhs->d_tok.d_val.constData();
+}
+
+void CrossRefModel::NameIndex::build()
+{
+    d_names.clear();
+    d_firstDecl.clear();
+    d_grams.clear();
+    d_firstPost.clear();
+    d_posts.clear();
+
+    // atoms are unique, so grouping by pointer groups by name; the decls were inserted in order of position
+    std::stable_sort( d_decls.begin(), d_decls.end(), lessDecl );
+    for( int i = 0; i < d_decls.size(); i++ )
+    {
+        const char* name = d_decls[i]->d_tok.d_val.constData();
+        if( d_names.isEmpty() || d_names.last() != name )
+        {
+            d_names.append( name );
+            d_firstDecl.append( i );
+        }
+    }
+    d_firstDecl.append( d_decls.size() );
+
+    // gram in the upper, name id in the lower half; sorting also orders the postings of each gram
+    QVector<quint64> pairs;
+    QVector<quint32> grams;
+    for( int n = 0; n < d_names.size(); n++ )
+    {
+        grams.clear();
+        trigrams( QByteArray( d_names[n] ).toLower(), grams );
+        foreach( quint32 g, grams )
+            pairs.append( ( quint64(g) << 32 ) | quint32(n) );
+    }
+    std::sort( pairs.begin(), pairs.end() );
+    pairs.erase( std::unique( pairs.begin(), pairs.end() ), pairs.end() );
+    d_posts.reserve( pairs.size() );
+    for( int i = 0; i < pairs.size(); i++ )
+    {
+        const quint32 g = quint32( pairs[i] >> 32 );
+        if( d_grams.isEmpty() || d_grams.last() != g )
+        {
+            d_grams.append( g );
+            d_firstPost.append( d_posts.size() );
+        }
+        d_posts.append( quint32( pairs[i] ) );
+    }
+    d_firstPost.append( d_posts.size() );
+    d_decls.squeeze();
+    d_names.squeeze();
+    d_firstDecl.squeeze();
+    d_grams.squeeze();
+    d_firstPost.squeeze();
+}
+
+quint64 CrossRefModel::NameIndex::byteSize() const
+{
+    return d_decls.capacity() * sizeof(const IdentDecl*) + d_names.capacity() * sizeof(const char*) +
+            ( d_firstDecl.capacity() + d_grams.capacity() + d_firstPost.capacity() + d_posts.capacity() ) *
+            sizeof(quint32);
+}
+
+static int findNoCase( const char* name, int len, const QByteArray& lower )
+{
+    const int n = lower.size();
+    for( int i = 0; i + n <= len; i++ )
+    {
+        int j = 0;
+        while( j < n && toLower( name[i+j] ) == lower[j] )
+            j++;
+        if( j == n )
+            return i;
+    }
+    return -1;
+}
+
+CrossRefModel::NameIndex::Match CrossRefModel::NameIndex::classify(const Query& q, const char* name, int len)
+{
+    const int pos = findNoCase( name, len, q.d_lower );
+    if( pos < 0 )
+        return NoMatch;
+    if( pos > 0 )
+        return isWordStart( name, pos ) ? WordMatch : SubstringMatch;
+    if( len == q.d_lower.size() )
+        return ::strcmp( name, q.d_pattern.constData() ) == 0 ? ExactMatch : NoCaseMatch;
+    return PrefixMatch;
+}
+
+void CrossRefModel::NameIndex::add(quint32 name, quint8 match, quint16 dist, Hits& best, int max) const
+{
+    Hit h;
+    h.d_name = d_names[name];
+    h.d_match = match;
+    h.d_dist = dist;
+    h.d_len = quint16( qMin( ::strlen( h.d_name ), size_t(0xffff) ) );
+    // all decls of a name have the same rank; if the first does not fit, none does
+    if( best.size() >= max && !( h < best.last() ) )
+        return;
+    for( quint32 i = d_firstDecl[name]; i < d_firstDecl[name+1]; i++ )
+    {
+        h.d_decl = d_decls[i];
+        Hits::iterator pos = std::upper_bound( best.begin(), best.end(), h );
+        if( best.size() >= max && pos == best.end() )
+            break;
+        best.insert( pos, h );
+        if( best.size() > max )
+            best.removeLast();
+    }
+}
+
+void CrossRefModel::NameIndex::find(const Query& q, Hits& best, int max) const
+{
+    if( d_names.isEmpty() || q.d_lower.isEmpty() )
+        return;
+    if( q.d_grams.isEmpty() )
+    {
+        // too short for a trigram; the distinct names are much fewer than the decls
+        for( int n = 0; n < d_names.size(); n++ )
+        {
+            const Match m = classify( q, d_names[n], int(::strlen( d_names[n] )) );
+            if( m != NoMatch )
+                add( n, m, 0, best, max );
+        }
+        return;
+    }
+    // the postings of each gram of the pattern; a gram missing in this file has an empty range
+    QVarLengthArray<QPair<quint32,quint32>,16> ranges;
+    int shortest = 0;
+    foreach( quint32 g, q.d_grams )
+    {
+        QVector<quint32>::const_iterator i = std::lower_bound( d_grams.begin(), d_grams.end(), g );
+        QPair<quint32,quint32> r( 0, 0 );
+        if( i != d_grams.end() && *i == g )
+        {
+            const int gi = i - d_grams.begin();
+            r = qMakePair( d_firstPost[gi], d_firstPost[gi+1] );
+        }
+        ranges.append( r );
+        if( r.second - r.first < ranges[shortest].second - ranges[shortest].first )
+            shortest = ranges.size() - 1;
+    }
+    if( !q.d_fuzzy )
+    {
+        // a substring contains all grams of the pattern; the candidates of the rarest gram are checked against
+        // the others and finally against the name itself, since the grams may be at the wrong places
+        const QPair<quint32,quint32> r = ranges[shortest];
+        for( quint32 p = r.first; p < r.second; p++ )
+        {
+            const quint32 n = d_posts[p];
+            bool all = true;
+            for( int k = 0; k < ranges.size() && all; k++ )
+            {
+                if( k != shortest )
+                    all = std::binary_search( d_posts.begin() + ranges[k].first,
+                                              d_posts.begin() + ranges[k].second, n );
+            }
+            if( !all )
+                continue;
+            const Match m = classify( q, d_names[n], int(::strlen( d_names[n] )) );
+            if( m != NoMatch )
+                add( n, m, 0, best, max );
+        }
+        return;
+    }
+    // fuzzy: count the shared grams of each name; at least half of the pattern's grams have to be present
+    const int total = q.d_grams.size();
+    QVector<quint16> counts( d_names.size() );
+    QVector<quint32> seen; // the names with at least one gram, in order of appearance
+    for( int k = 0; k < ranges.size(); k++ )
+        for( quint32 p = ranges[k].first; p < ranges[k].second; p++ )
+        {
+            if( counts[ d_posts[p] ]++ == 0 )
+                seen.append( d_posts[p] );
+        }
+    foreach( quint32 n, seen )
+    {
+        const int shared = counts[n];
+        if( 2 * shared < total )
+            continue;
+        const char* name = d_names[n];
+        const int len = int(::strlen( name ));
+        Match m = shared == total ? classify( q, name, len ) : NoMatch;
+        quint16 dist = 0;
+        if( m == NoMatch )
+        {
+            // Jaccard distance of the gram sets, assuming the grams of the name are distinct
+            const int union_ = total + qMax( 0, len - 2 ) - shared;
+            dist = quint16( 1000 - 1000 * shared / qMax( 1, union_ ) );
+            m = FuzzyMatch;
+        }
+        add( n, m, dist, best, max );
+    }
+}
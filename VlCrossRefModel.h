@@ -23,9 +23,17 @@
 #include <QObject>
 #include <QSharedData>
 #include <QMap>
+#include <QVector>
 #include <QReadWriteLock>
+#include <QMutex>
 #include <QStringList>
+#include <QSet>
+#include <QAtomicPointer>
 #include <Verilog/VlToken.h>
+#include <Verilog/VlErrors.h>
+#include <Verilog/VlTokenTable.h>
+
+class QFileSystemWatcher;
 
 namespace Vl
 {
@@ -153,23 +161,160 @@ namespace Vl
         class Scope : public Branch
         {
         public:
+            Scope():d_lop(0),d_sorted(0),d_visible(0) {}
+            ~Scope();
             typedef QMap<QByteArray,IdentDeclRef> Names2;
+            // The recursive view is cached per scope and built from the cached view of the super scope; the views
+            // are dropped when the names of the root scope change, see CrossRefModel::resetViews
             Names2 getNames2(bool recursive = true) const;
-            IdentDeclRefList getNames() const;
+            IdentDeclRefList getNames() const; // ordered by name
         protected:
             int getType() const Q_DECL_OVERRIDE { return ClassScope; }
         private:
             friend class CrossRefModel;
-            typedef QMap<QByteArray,const IdentDecl*> Names; // TODO: Hash
+            class Names
+            {
+                // Flat hash table with open addressing and linear probing. The key is the d_val of the decl,
+                // which is an atom (see Atoms), so keys are hashed and compared by their constData() pointer.
+                // Iteration order is undefined; use sortedValues() where the order is visible.
+            public:
+                Names():d_count(0) {}
+                const IdentDecl* value( const QByteArray& atom ) const;
+                bool contains( const QByteArray& atom ) const { return value(atom) != 0; }
+                const IdentDecl* insert( const QByteArray& atom, const IdentDecl* ); // returns existing or 0
+                bool remove( const QByteArray& atom );
+                void clear();
+                bool operator==( const Names& ) const; // same atoms with the same decls
+                int size() const { return d_count; }
+                int byteSize() const { return d_slots.size() * sizeof(Slot); }
+                QList<const IdentDecl*> values() const;
+                QList<const IdentDecl*> sortedValues() const;
+            private:
+                struct Slot
+                {
+                    const char* d_atom;
+                    const IdentDecl* d_decl; // 0 if slot is empty
+                    Slot():d_atom(0),d_decl(0) {}
+                };
+                int lookup( const char* atom ) const; // index of match or of empty slot
+                static inline uint hashOf( const char* atom );
+                void rehash( int capacity );
+                QVector<Slot> d_slots; // size is zero or a power of two
+                int d_count;
+            };
+            struct NameEntry
+            {
+                const char* d_name; // the atom
+                const IdentDecl* d_decl;
+            };
+            typedef QVector<NameEntry> SortedNames;
+            static bool lessNameEntry( const NameEntry& lhs, const NameEntry& rhs );
+            const SortedNames& sortedNames() const; // own and port names ordered by name, built on first use
+            void addOwnNames( Names2& ) const; // the port names first, so the own names hide them
+            const Names2& visibleNames() const; // the cached view, see getNames2
+            void resetCaches(); // only for scopes whose names change, under the write lock
             Names d_names;
+            const Scope* d_lop; // list_of_ports of a module, if present; avoids findFirst on each lookup
+            mutable QAtomicPointer<SortedNames> d_sorted; // scopes are immutable once published, except d_global
+            mutable QAtomicPointer<Names2> d_visible; // getNames2(true)
         };
         typedef QExplicitlySharedDataPointer<const Scope> ScopeRef;
 
+        struct Instance
+        {
+            QByteArray d_path; // instance names separated by '.', starting with the name of the top module
+            // the segment of d_path added by this instance; instances in named generate blocks are prefixed
+            // with the block labels, e.g. "g1.u", so d_path may have more dots than levels
+            QByteArray d_name;
+            IdentDeclRef d_inst; // the declaration of the instance name; null for the top module
+            ScopeRef d_cell; // the instantiated module or udp; null if unknown
+        };
+        typedef QList<Instance> InstanceList;
+
+        struct FileStats
+        {
+            quint32 d_tokens; // the terminals which went into the SynTree
+            quint32 d_synTreeNodes; // including the terminals; only the tree of one top level production is alive
+            quint32 d_symbols;
+            quint32 d_names; // top level names
+            quint32 d_chunks; // see reparseFile
+            quint64 d_bytes; // approximate footprint of the symbols and their name tables
+            FileStats():d_tokens(0),d_synTreeNodes(0),d_symbols(0),d_names(0),d_chunks(0),d_bytes(0){}
+            void add( const FileStats& );
+        };
+        struct UpdateStats
+        {
+            quint32 d_files, d_filesUnchanged, d_chunksParsed, d_chunksReused;
+            qint64 d_parseMs, d_mergeMs, d_resolveMs, d_swapMs; // duration of the stages of the last update
+            UpdateStats():d_files(0),d_filesUnchanged(0),d_chunksParsed(0),d_chunksReused(0),
+                d_parseMs(0),d_mergeMs(0),d_resolveMs(0),d_swapMs(0){}
+            void add( const UpdateStats& );
+        };
+        struct Stats
+        {
+            QMap<QString,FileStats> d_files;
+            FileStats d_total;
+            quint32 d_globalNames, d_indexEntries, d_revIndexEntries, d_instances;
+            quint64 d_indexBytes, d_revIndexBytes; // approximate
+            quint32 d_cachedFiles, d_defines, d_atoms;
+            quint64 d_cachedBytes;
+            quint64 d_tokenTableBytes;
+            quint64 d_nameIndexBytes;
+            UpdateStats d_lastUpdate;
+            UpdateStats d_allUpdates; // the sum of all updates since construction or clear()
+            Stats():d_globalNames(0),d_indexEntries(0),d_revIndexEntries(0),d_instances(0),
+                d_indexBytes(0),d_revIndexBytes(0),d_cachedFiles(0),d_defines(0),d_atoms(0),d_cachedBytes(0),
+                d_tokenTableBytes(0),d_nameIndexBytes(0){}
+        };
+
+
+        struct SemanticToken
+        {
+            quint32 d_lineNr;
+            quint16 d_colNr, d_len;
+            quint16 d_declKind; // SynTree::R_.. of the declaration the symbol refers to, 0 if unresolved
+            quint8 d_class; // ClassIdentDecl, ClassIdentUse, ClassPathIdent, ClassCellRef or ClassPortRef
+            bool d_isDecl;
+        };
+        typedef QVector<SemanticToken> SemanticTokens; // ordered by position
+
+        struct SourcePos
+        {
+            QString d_file;
+            quint32 d_line;
+            quint16 d_col;
+            SourcePos( const QString& file = QString(), quint32 line = 0, quint16 col = 0 ):
+                d_file(file),d_line(line),d_col(col){}
+        };
+        struct PosHit
+        {
+            TreePath d_path; // as findSymbolBySourcePos; empty if nothing was hit
+            IdentDeclRef d_decl; // the declaration of d_path.first(), if any
+        };
+
+
+        // Update requests are served highest priority first; a request for a higher priority than the
+        // one of the running batch, or for a file which is just being parsed, cancels the running batch.
+        enum Priority { PrioLibrary, PrioProject, PrioOpen, PrioActive, PrioCount };
 
         explicit CrossRefModel(QObject *parent = 0, FileCache* = 0);
         ~CrossRefModel();
 
-        bool updateFiles( const QStringList&, bool synchronous = false );
+        bool updateFiles( const QStringList&, bool synchronous = false, Priority = PrioProject );
+        // A file is only reparsed if its content or the content of one of its includes changed since the last parse.
+        // If watching, the parsed files and their includes are queued by the model itself when they change on disk.
+        void setWatchFiles( bool );
+        bool isWatchingFiles() const { return d_watcher != 0; }
+        // If on, the raw tokens of each file are kept from the parse (see TokenTable) for the token queries below;
+        // files parsed before are reparsed with their next update. Off by default.
+        void setKeepTokens( bool );
+        bool isKeepingTokens() const;
+        // If on, the declared names of each file are indexed by trigrams for findNames; files inserted before
+        // are indexed with their next update. Off by default.
+        void setIndexNames( bool );
+        bool isIndexingNames() const;
+        void setResolverThreads( int ); // 0 means QThread::idealThreadCount()
+        int getResolverThreads() const;
         bool parseString( const QString& code, const QString& sourcePath = QString() );
         void clear();
 
@@ -184,6 +329,9 @@ namespace Vl
                                        bool onlyIdents = true, bool hitEmpty = false ) const;
         IdentDeclRef findDeclarationOfSymbolAtSourcePos(const QString& file, quint32 line, quint16 col) const;
         IdentDeclRef findDeclarationOfSymbol(const Symbol* ) const;
+        // Many positions under one read lock; the symbols of each file are walked only once for all its positions.
+        // The result has the order of the positions.
+        QList<PosHit> findSymbolsBySourcePos( const QList<SourcePos>&, bool onlyIdents = true ) const;
         SymRefList findAllReferencingSymbols(const Symbol* ) const;
         SymRefList findReferencingSymbolsByFile(const Symbol*, const QString& file ) const;
         IfDefOutList getIfDefOutsByFile( const QString& file ) const;
@@ -191,8 +339,38 @@ namespace Vl
         Section findSectionBySourcePos( const QString& file, quint32 line, quint16 col ) const;
         SymRef findGlobal( const QByteArray& name ) const;
         SymRefList getGlobalSyms( const QString& file = QString() ) const;
+
+        // The design hierarchy below the top module is expanded on demand and cached until the next update;
+        // findInstance also resolves paths starting with another module, but without caching them
+        void setTopModule( const QByteArray& );
+        QByteArray getTopModule() const;
+        Instance findInstance( const QByteArray& path ) const;
+        InstanceList getSubInstances( const QByteArray& path ) const;
+        InstanceList findInstancesByPrefix( const QByteArray& prefix, int max = 0 ) const; // "a.b.c" -> a.b.c*
+
         IdentDeclRefList getGlobalNames( const QString& file = QString() ) const;
+        // All named symbols of the file from one traversal, e.g. for semantic highlighting; cached until the file
+        // or the top level names of any file change
+        SemanticTokens getSemanticTokens( const QString& file ) const;
+        // The names visible in the scope (0 is global) which match the pattern, best first: exact, prefix,
+        // case insensitive prefix and, if fuzzy, word starts like "awd" or "AxWD" for axi_wr_data; inner scopes
+        // first. Only the max best candidates are kept, so nothing is copied per visible name.
+        IdentDeclRefList findCompletions( const Scope*, const QByteArray& pattern, int max = 20, bool fuzzy = true ) const;
+        IdentDeclRefList findCompletionsAtSourcePos( const QString& file, quint32 line, quint16 col,
+                                                     const QByteArray& pattern, int max = 20, bool fuzzy = true ) const;
+        // The decls in all files whose name contains the pattern (case insensitive), best first: exact, case
+        // insensitive, prefix, at a word start, anywhere; if fuzzy also names sharing at least half of the trigrams
+        // of the pattern, by similarity. Only files inserted while setIndexNames was on are searched.
+        IdentDeclRefList findNames( const QByteArray& pattern, int max = 100, bool fuzzy = false ) const;
+        Stats getStats() const; // walks all symbols; not intended for frequent calls
+        // The symbols of a chunk reused by an incremental reparse keep the lines of the parse which created them
+        // (see Chunk); this returns the token of a symbol with its current line
+        Token currentTok( const Token& ) const;
         static QList<Token> findTokenByPos(const QString& line, int col, int* pos, bool supportSv = false );
+        // served from the kept tokens without lexing; an invalid token or an empty list if there are none
+        Token findTokenBySourcePos( const QString& file, quint32 line, quint16 col ) const;
+        QList<Token> getTokens( const QString& file, quint32 fromLine, quint32 toLine ) const; // inclusive
+        bool hasTokens( const QString& file ) const;
         static QString qualifiedName( const TreePath&, bool skipFirst = false );
         static QStringList qualifiedNameParts( const TreePath&, bool skipFirst = false );
         static const Scope* closestScope( const TreePath& );
@@ -209,11 +387,157 @@ namespace Vl
         typedef QMap<QString,SectionList> SectionLists; // file -> list
         typedef QList<ScopeRef> ScopeRefList;
         typedef QHash<const Symbol*,const IdentDecl*> Index; // ident use -> ident declaration
-        typedef QMultiHash<const Symbol*, const Symbol*> RevIndex;
+        class RevIndex
+        {
+            // Compact (CSR like) reverse index decl -> referencing symbols. insert() only collects the pairs;
+            // build() sorts them so that the references of each decl are contiguous and partitioned by file,
+            // ordered by position within each file. Queries are only valid after build().
+        public:
+            RevIndex() {}
+            void insert( const Symbol* decl, const Symbol* ref );
+            void merge( const RevIndex& ); // adds the not yet built pairs of rhs
+            void build();
+            void clear();
+            int size() const { return d_refs.size(); }
+            quint64 byteSize() const;
+            QList<const Symbol*> values( const Symbol* decl ) const;
+            QList<const Symbol*> values( const Symbol* decl, const QString& file ) const;
+        private:
+            struct Pending
+            {
+                const Symbol* d_decl;
+                const Symbol* d_ref;
+                quint32 d_file;
+            };
+            struct Part
+            {
+                quint32 d_file;
+                quint32 d_start; // index into d_refs; the part ends where the next one starts
+            };
+            int findDecl( const Symbol* ) const;
+            static bool lessPending( const Pending&, const Pending& );
+            static bool lessPartFile( const Part& lhs, quint32 file ) { return lhs.d_file < file; }
+            static QList<const Symbol*> slice( const QVector<const Symbol*>&, quint32 from, quint32 to );
+            QVector<Pending> d_pending;
+            QVector<const Symbol*> d_decls; // sorted
+            QVector<quint32> d_firstPart; // per decl index into d_parts, plus one sentinel
+            QVector<Part> d_parts; // plus one sentinel
+            QVector<const Symbol*> d_refs;
+            QHash<QString,quint32> d_fileIds;
+        };
+        class NameIndex
+        {
+            // Trigram index over the decls of one file. The decls are grouped by name (atom); the trigrams of the
+            // lower case names map to the ascending ids of the names which contain them (CSR like, as RevIndex),
+            // so a name shared by many decls costs its postings only once. Queries are only valid after build().
+        public:
+            enum Match { ExactMatch, NoCaseMatch, PrefixMatch, WordMatch, SubstringMatch, FuzzyMatch, NoMatch };
+            struct Query
+            {
+                QByteArray d_pattern, d_lower;
+                QVector<quint32> d_grams; // distinct, ascending
+                bool d_fuzzy;
+                Query( const QByteArray& pattern, bool fuzzy );
+            };
+            struct Hit
+            {
+                const IdentDecl* d_decl;
+                const char* d_name;
+                quint8 d_match;
+                quint16 d_dist; // 0 unless FuzzyMatch, then 1000 * (1 - trigram similarity)
+                quint16 d_len;
+                bool operator<( const Hit& ) const;
+            };
+            typedef QList<Hit> Hits; // ordered, best first
+
+            void insert( const IdentDecl* id ) { d_decls.append(id); }
+            void build();
+            bool isEmpty() const { return d_decls.isEmpty(); }
+            int size() const { return d_decls.size(); }
+            quint64 byteSize() const;
+            void find( const Query&, Hits& best, int max ) const; // adds the hits of this file to best
+            static void trigrams( const QByteArray& lower, QVector<quint32>& );
+        private:
+            static bool lessDecl( const IdentDecl*, const IdentDecl* );
+            static Match classify( const Query&, const char* name, int len );
+            void add( quint32 name, quint8 match, quint16 dist, Hits& best, int max ) const;
+            QVector<const IdentDecl*> d_decls; // grouped by name, ordered by position within a group
+            QVector<const char*> d_names; // the distinct atoms
+            QVector<quint32> d_firstDecl; // per name index into d_decls, plus one sentinel
+            QVector<quint32> d_grams; // ascending
+            QVector<quint32> d_firstPost; // per gram index into d_posts, plus one sentinel
+            QVector<quint32> d_posts; // name ids
+        };
         typedef QExplicitlySharedDataPointer<Scope> ScopeRefNc;
         typedef QExplicitlySharedDataPointer<Symbol> SymRefNc;
+        struct Chunk
+        {
+            // A range of whole lines with complete top level descriptions (module or primitive) which is
+            // lexed and parsed on its own, so unchanged chunks of an edited file can be reused as they are.
+            // A reused chunk shares its symbols with the previous model, so they keep the lines of the parse
+            // which created them, as do d_sectionToks, d_errs, d_wrns and d_toks; the current line is the one
+            // of the symbol plus d_shift. Each chunk of a file is parsed in a line range no other chunk of the
+            // file uses (see reparseFile), so the line of a symbol also identifies its chunk.
+            quint32 d_lineFrom, d_lineTo; // inclusive, current
+            quint32 d_len; // of the text of the lines
+            quint64 d_hash; // Hash::xx64 of the lines
+            qint32 d_shift;
+            SymRefList d_cells;
+            QList<const IdentDecl*> d_names; // all top level decls of the chunk, even if they are duplicates
+            QList<Token> d_sectionToks;
+            Errors::EntryList d_errs, d_wrns; // of the chunk's own parse
+            TokenTable d_toks; // empty if the tokens were not kept
+            quint32 d_tokens, d_synTreeNodes;
+            Chunk():d_lineFrom(0),d_lineTo(0),d_len(0),d_hash(0),d_shift(0),d_tokens(0),d_synTreeNodes(0){}
+        };
+        typedef QList<Chunk> ChunkList;
+        struct LineShift
+        {
+            quint32 d_from, d_to; // the lines of the symbols of a chunk, inclusive
+            qint32 d_shift; // see Chunk
+        };
+        typedef QVector<LineShift> LineShifts; // ordered by d_from; only the chunks with d_shift != 0
+        typedef QMap<QString,ChunkList> ChunkLists; // file -> list
+        struct Digest
+        {
+            quint64 d_hash; // Hash::xx64 of the content the file was parsed from, 0 if unknown
+            QMap<QString,quint64> d_deps; // included file -> its hash at the time, 0 if it was not found
+            QMap<QByteArray,quint64> d_macros; // macros used before defined -> PpSymbols::getHash at the time
+            quint64 d_incDirs; // Includes::getHash at the time
+            Digest():d_hash(0),d_incDirs(0){}
+        };
+        struct Reparse
+        {
+            // what reparseFiles produces besides the symbols
+            ChunkLists d_chunks;
+            QMap<QString,FileStats> d_counts; // only d_tokens and d_synTreeNodes
+            QMap<QString,Digest> d_digests;
+            QStringList d_unchanged; // not parsed because their digest is still valid
+            QStringList d_done; // the files with complete results, in order; all files unless cancelled
+            QMap<QString,TokenTable> d_toks; // of the files parsed as a whole
+            bool d_keepToks, d_indexNames; // as they were when the batch was taken
+            UpdateStats d_stats;
+            Reparse():d_keepToks(false),d_indexNames(false){}
+        };
+        struct FileData
+        {
+            SymRefList d_cells; // the children of d_global with d_sourcePath of this file
+            QList<const IdentDecl*> d_names; // the entries of d_global.d_names with d_sourcePath of this file
+            SectionList d_sections;
+            ChunkList d_chunks; // empty if the file can only be parsed as a whole
+            LineShifts d_shifts; // empty if all symbols of the file have their current lines
+            Digest d_digest;
+            TokenTable d_toks; // if parsed as a whole, otherwise the tokens are in the chunks
+            bool d_withToks; // the tokens were kept when the file was parsed
+            NameIndex d_nameIdx; // empty if the names were not indexed
+            bool d_withNames; // d_nameIdx was built, even if the file has no names
+            quint32 d_tokens, d_synTreeNodes;
+            FileData():d_withToks(false),d_withNames(false),d_tokens(0),d_synTreeNodes(0){}
+        };
+        typedef QMap<QString,FileData> Files; // file -> data owned by the file
 
         static ScopeRefNc createAst( const SynTree*, Vl::Errors* ); // returns a global scope
+        static void fillAstTop( Scope* top, const SynTree*, Vl::Errors* ); // adds one top level production
         static void fillAst( Branch* parentAst, Scope* superScope, SynTreePath& synPath, Vl::Errors* );
         static void checkNumber( const SynTree*, Vl::Errors* );
         static bool checkLop(Scope* superScope, const SynTree* id, Vl::Errors* );
@@ -222,18 +546,90 @@ namespace Vl
         static int parseFiles(const QStringList& files, ScopeRefList&, IfDefOutLists&, SectionLists&,
                                 Vl::Errors* errs, PpSymbols* syms, Vl::Includes* incs , Vl::FileCache* fcache, QAtomicInt* );
         static bool parseStream(QIODevice* stream, const QString& sourcePath, ScopeRefList&, IfDefOutLists&, SectionList&,
-                              Vl::Errors* errs, PpSymbols* syms, Vl::Includes* incs , Vl::FileCache* fcache);
-        void insertFiles(const QStringList& files, const ScopeRefList&, const IfDefOutLists&, const SectionLists&, Vl::Errors* errs , bool lock = true); // write lock
-        static void clearFile(Scope*, const QString& file);
+                              Vl::Errors* errs, PpSymbols* syms, Vl::Includes* incs , Vl::FileCache* fcache,
+                              const QAtomicInt* stop = 0, FileStats* counts = 0, TokenTable* toks = 0,
+                              Digest* deps = 0 );
+        static ScopeRefNc parseFragment(QIODevice* stream, const QString& sourcePath, quint32 firstLine, IfDefOutLists&,
+                                        QList<Token>& sectionToks, Vl::Errors* errs, PpSymbols* syms,
+                                        Vl::Includes* incs , Vl::FileCache* fcache, const QAtomicInt* stop,
+                                        FileStats* counts = 0, TokenTable* toks = 0, Digest* deps = 0 );
+        static void fillSections( const QList<Token>& sectionToks, const QString& sourcePath, SectionList& );
+        int reparseFiles(const QStringList& files, ScopeRefList&, IfDefOutLists&, SectionLists&, Reparse&,
+                         Vl::Errors* errs, const QAtomicInt* stop ); // read lock to reuse chunks
+        void reparseFile(const QString& file, ScopeRefList&, IfDefOutLists&, SectionLists&, Reparse&,
+                         Vl::Errors* errs, const QAtomicInt* stop );
+        static bool readFile( const QString& path, Vl::FileCache*, QByteArray& text );
+        bool isUnchanged( const QString& file, const Digest& cur, bool withToks, bool withNames ) const; // read lock
+        void syncWatcher(); // read lock
+        static bool scanChunks( const QByteArray& text, ChunkList&, QList<int>& offsets );
+        static int chunkOfLine( const ChunkList&, quint32 line ); // -1 if no chunk has the current line
+        // 0 if no chunk has the current line; shift is the one of the chunk
+        static const TokenTable* tokensOfLine( const FileData&, quint32 line, qint32& shift );
+        static LineShifts lineShifts( const ChunkList& );
+        static bool lessLineShift( const LineShift& lhs, const LineShift& rhs ) { return lhs.d_from < rhs.d_from; }
+        static bool lessLine( quint32 line, const LineShift& rhs ) { return line < rhs.d_from; }
+        static quint32 currentLine( const LineShifts&, quint32 line ); // line of a symbol -> current line
+        static quint32 symbolLine( const FileData&, quint32 line ); // current line -> line of the symbols
+        static void shiftErrors( const Errors& from, const Files&, Errors* to );
+        void insertFiles(const QStringList& files, const ScopeRefList&, const IfDefOutLists&, const SectionLists&,
+                         Vl::Errors* errs , bool lock = true, const Reparse* = 0 ); // write lock
+        static void clearFile(Scope*, Files&, const QString& file);
         static void resolveIdents( Index&, RevIndex&, const Symbol*, const Branch*, const Scope*, const Scope*, Vl::Errors* );
-        static const IdentDecl* findNameInScope( const Scope*, const QByteArray& name, bool recursiv = true, bool ports = false );
+        static void resolveCells( Index&, RevIndex&, const QList<const Scope*>&, const Scope*, Vl::Errors*, int threads );
+        static const IdentDecl* findNameInScope( const Scope*, const QByteArray& atom, bool recursiv = true, bool ports = false );
+        static const Scope* findCellOfInstance( const IdentDecl* inst, const Scope* globScope );
+        struct CellInst
+        {
+            QByteArray d_name; // see Instance::d_name
+            const IdentDecl* d_inst;
+        };
+        typedef QList<CellInst> CellInsts;
+        static void findInstances( const Symbol*, const QByteArray& prefix, CellInsts& );
+        static void countSymbols( const Symbol*, FileStats& );
+        static void collectSemanticTokens( const Symbol*, const QString& file, const Index&, SemanticTokens& );
+        static void collectDecls( const Symbol*, NameIndex& );
+        static void resetViews( const Symbol* ); // the Scope::d_visible below the symbol, under the write lock
+        static void collectDeclKinds( const IdentDecl* cell, QSet<QByteArray>& ); // "cell.name:kind"
+        static void collectDeclKinds( const Symbol*, const QByteArray& prefix, QSet<QByteArray>& );
+        static bool lessSemanticToken( const SemanticToken& lhs, const SemanticToken& rhs );
+        struct HierNode
+        {
+            QByteArray d_path;
+            const IdentDecl* d_inst;
+            const Scope* d_cell;
+            int d_parent; // -1 for the top module
+            int d_firstChild; // -1 if not yet expanded
+            int d_childCount;
+            HierNode():d_inst(0),d_cell(0),d_parent(-1),d_firstChild(-1),d_childCount(0){}
+        };
+        int findHierNode( const QByteArray& path ) const; // read lock and d_hierLock
+        void expandHierNode( int ) const; // read lock and d_hierLock
+        Instance walkInstance( const QByteArray& path ) const; // read lock and d_hierLock
+        const CellInsts& cellInstances( const Scope* ) const; // read lock and d_hierLock
+        static int matchInstance( const CellInsts&, const QByteArray& path, int pos ); // index or -1
+        Instance toInstance( int ) const;
+        void clearHierarchy(); // d_hierLock
         static quint16 calcTextLenOfDecl( const SynTree* );
         static quint16 calcKeyWordLen( const SynTree* );
         static bool findSymbolBySourcePosImp(TreePath& path, quint32 line, quint16 col, bool onlyIdents , bool hitEmpty);
+        struct PosRef
+        {
+            quint32 d_line;
+            quint16 d_col;
+            int d_index; // into the result
+        };
+        static bool lessPosRef( const PosRef& lhs, const PosRef& rhs );
+        static void findSymbolsImp( TreePath& path, const QString& file, const QVector<PosRef>&, QList<PosHit>&,
+                                    int& open, bool onlyIdents );
         static void runUpdater(CrossRefModel* );
+        void enqueue( const QString& file, quint8 prio ); // write lock
+        bool takeBatch( QStringList& files, quint8& prio ); // write lock
+        bool hasWork() const { return !d_queued.isEmpty(); }
     protected slots:
         void onWorkFinished();
+        void onFileChanged( const QString& );
     private:
+        friend class IndexFile;
         Vl::Errors* d_errs;
         PpSymbols* d_syms;
         Vl::Includes* d_incs;
@@ -241,15 +637,33 @@ namespace Vl
 
         Scope d_global;
         IfDefOutLists d_idols;
-        SectionLists d_sections;
+        Files d_files; // d_global.d_children is the concatenation of all d_cells
         Index d_index;
         RevIndex d_revIndex;
 
         mutable QReadWriteLock d_lock;
-        QStringList d_work; // no set because order may be relevant
+        QStringList d_work[PrioCount]; // no set because order may be relevant
+        QHash<QString,quint8> d_queued; // file -> priority, each file is queued only once
+        QSet<QString> d_running; // the batch currently parsed by the worker
+        quint8 d_runningPrio;
         class Worker;
         Worker* d_worker;
+        class Resolver;
+        int d_resolverThreads;
+        bool d_keepToks;
+        bool d_indexNames;
         QAtomicInt d_break;
+        QAtomicInt d_cancel; // interrupts the running batch; the worker requeues the files not yet finished
+
+        QByteArray d_topMod;
+        mutable QMutex d_hierLock;
+        mutable QVector<HierNode> d_hier; // 0 is the top module; the children of a node are contiguous
+        mutable QHash<QByteArray,int> d_hierPaths; // instance path -> index in d_hier
+        mutable QHash<const Scope*,CellInsts> d_cellInsts; // cell -> its instances in source order
+        UpdateStats d_lastUpdate, d_allUpdates;
+        QFileSystemWatcher* d_watcher;
+        mutable QMutex d_semLock;
+        mutable QHash<QString,SemanticTokens> d_semToks; // file -> tokens; d_semLock, cleared under write lock
     };
 }
 Q_DECLARE_METATYPE(Vl::CrossRefModel::SymRef)
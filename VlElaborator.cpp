@@ -0,0 +1,496 @@
+/*
+* Copyright 2018-2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Verilog parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "VlElaborator.h"
+#include "VlCrossRefModel.h"
+#include "VlSynTree.h"
+#include "VlPpLexer.h"
+#include "VlParser.h"
+#include "VlPpSymbols.h"
+#include "VlErrors.h"
+#include <QMutexLocker>
+#include <QtDebug>
+#include <algorithm>
+using namespace Vl;
+
+Elaborator::Elaborator(CrossRefModel* mdl, QObject* parent):QObject(parent),d_mdl(mdl),d_hits(0),d_misses(0)
+{
+    Q_ASSERT( mdl != 0 );
+    connect( mdl, SIGNAL(sigFileUpdated(QString)), this, SLOT(onFileUpdated(QString)) );
+    connect( mdl, SIGNAL(sigModelUpdated()), this, SLOT(onModelUpdated()) );
+}
+
+Elaborator::~Elaborator()
+{
+    clear();
+}
+
+Elaborator::Specialisation Elaborator::specialise(const QByteArray& module, const Params& overrides)
+{
+    QMutexLocker lock(&d_lock);
+    return specialiseImp( module, overrides );
+}
+
+Elaborator::Specialisation Elaborator::findByInstance(const QByteArray& path)
+{
+    QMutexLocker lock(&d_lock);
+    return findByInstanceImp( path );
+}
+
+Elaborator::Stats Elaborator::getStats() const
+{
+    QMutexLocker lock(&d_lock);
+    Stats s;
+    s.d_modules = d_modules.size();
+    s.d_specs = d_specs.size();
+    s.d_paths = d_paths.size();
+    s.d_hits = d_hits;
+    s.d_misses = d_misses;
+    return s;
+}
+
+void Elaborator::clear()
+{
+    QMutexLocker lock(&d_lock);
+    foreach( Module* m, d_modules )
+    {
+        delete m->d_st;
+        delete m;
+    }
+    d_modules.clear();
+    d_specs.clear();
+    d_paths.clear();
+    d_parsed.clear();
+}
+
+QByteArray Elaborator::normalise(const QByteArray& module, const Params& overrides)
+{
+    // the values are in canonical form and converted to the declared types, see toDeclaredTypes
+    if( overrides.isEmpty() )
+        return module;
+    QList<QByteArray> names = overrides.keys();
+    std::sort( names.begin(), names.end() );
+    QByteArray res = module + "#(";
+    for( int i = 0; i < names.size(); i++ )
+    {
+        if( i != 0 )
+            res += ',';
+        res += names[i] + '=' + overrides.value( names[i] ).toString();
+    }
+    res += ')';
+    return res;
+}
+
+void Elaborator::onFileUpdated(const QString& file)
+{
+    QMutexLocker lock(&d_lock);
+    d_parsed.remove( file );
+    QSet<QByteArray> gone;
+    QHash<QByteArray,Module*>::iterator i = d_modules.begin();
+    while( i != d_modules.end() )
+    {
+        if( i.value()->d_file == file )
+        {
+            gone.insert( i.key() );
+            delete i.value()->d_st;
+            delete i.value();
+            i = d_modules.erase( i );
+        }else
+            ++i;
+    }
+    QHash<QByteArray,Specialisation>::iterator j = d_specs.begin();
+    while( j != d_specs.end() )
+    {
+        if( gone.contains( j.value().d_module ) )
+            j = d_specs.erase( j );
+        else
+            ++j;
+    }
+}
+
+void Elaborator::onModelUpdated()
+{
+    // the instances and the cells they refer to may have changed anywhere
+    QMutexLocker lock(&d_lock);
+    d_paths.clear();
+}
+
+const Elaborator::Module* Elaborator::module(const QByteArray& name)
+{
+    Module* m = d_modules.value( name );
+    if( m )
+        return m;
+    CrossRefModel::SymRef sym = d_mdl->findGlobal( name );
+    if( sym.constData() == 0 || d_parsed.contains( sym->tok().d_sourcePath ) )
+        return 0;
+    parseFile( sym->tok().d_sourcePath );
+    return d_modules.value( name );
+}
+
+void Elaborator::parseFile(const QString& file)
+{
+    d_parsed.insert( file );
+
+    // errors were already reported by the model when it parsed the file
+    Errors errs( 0, true );
+    errs.setReportToConsole( false );
+    // the file may (un)define macros; these must not leak into the table of the model
+    PpSymbols syms;
+    foreach( const PpSymbols::Define& d, d_mdl->getSyms()->getDefines() )
+        syms.addSymbol( d );
+    PpLexer lex;
+    lex.setErrors( &errs );
+    lex.setSyms( &syms );
+    lex.setIncs( d_mdl->getIncs() );
+    lex.setCache( d_mdl->getFcache() );
+    lex.setIgnoreAttrs( false );
+    lex.setPackAttrs( false );
+    lex.setSendMacroUsage( true );
+    if( !lex.setStream( file, false ) )
+        return;
+
+    // like CrossRefModel::parseFragment only the module declarations are kept, the rest is deleted right away
+    struct Collector : public ParserSink
+    {
+        QList<SynTree*> d_modules;
+        void onTopLevel( SynTree* st )
+        {
+            if( st->d_tok.d_type == SynTree::R_module_declaration )
+                d_modules.append( st );
+            else
+            {
+                for( int i = st->d_children.size() - 1; i >= 0; i-- )
+                {
+                    if( st->d_children[i]->d_tok.d_type == SynTree::R_module_declaration )
+                        d_modules.append( st->d_children.takeAt(i) );
+                }
+                delete st;
+            }
+        }
+    };
+    Collector collector;
+    Parser p( &lex, &errs );
+    p.setSink( &collector );
+    p.RunParser();
+
+    foreach( SynTree* st, collector.d_modules )
+    {
+        QByteArray name;
+        foreach( const SynTree* sub, st->d_children )
+        {
+            if( sub->d_tok.d_type == Tok_Ident )
+            {
+                name = sub->d_tok.d_val;
+                break;
+            }
+        }
+        if( name.isEmpty() || d_modules.contains( name ) )
+        {
+            delete st; // duplicates are reported by the model
+            continue;
+        }
+        Module* m = new Module();
+        m->d_st = st;
+        m->d_file = file;
+        bool hasPortList = false;
+        collectParams( st, m->d_overridable, m->d_decls, hasPortList );
+        d_modules.insert( name, m );
+    }
+}
+
+void Elaborator::collectParams(const SynTree* st, QList<QByteArray>& names, QHash<QByteArray,const SynTree*>& decls,
+                               bool& hasPortList)
+{
+    // with a module_parameter_port_list the parameters of the body are local (IEEE 1364-2005 12.2)
+    foreach( const SynTree* sub, st->d_children )
+    {
+        switch( sub->d_tok.d_type )
+        {
+        case SynTree::R_module_parameter_port_list:
+            names.clear();
+            decls.clear();
+            hasPortList = true;
+            collectParams( sub, names, decls, hasPortList );
+            break;
+        case SynTree::R_parameter_declaration:
+            if( hasPortList && st->d_tok.d_type != SynTree::R_module_parameter_port_list )
+                break;
+            foreach( const SynTree* list, sub->d_children )
+            {
+                if( list->d_tok.d_type != SynTree::R_list_of_param_assignments )
+                    continue;
+                foreach( const SynTree* pa, list->d_children )
+                {
+                    if( pa->d_tok.d_type != SynTree::R_param_assignment )
+                        continue;
+                    foreach( const SynTree* id, pa->d_children )
+                    {
+                        if( id->d_tok.d_type == Tok_Ident )
+                        {
+                            names.append( id->d_tok.d_val );
+                            decls.insert( id->d_tok.d_val, sub );
+                            break;
+                        }
+                    }
+                }
+            }
+            break;
+        case SynTree::R_function_declaration:
+        case SynTree::R_task_declaration:
+        case SynTree::R_loop_generate_construct:
+        case SynTree::R_conditional_generate_construct:
+        case SynTree::R_case_generate_construct:
+            break;
+        default:
+            if( sub->d_tok.d_type > SynTree::R_First )
+                collectParams( sub, names, decls, hasPortList );
+            break;
+        }
+    }
+}
+
+Elaborator::Params Elaborator::toDeclaredTypes(const Module* m, const Params& overrides)
+{
+    // the key must not depend on how a value was written, e.g. 16 and 8'd16 for a parameter [7:0] or 32'hffffffff
+    // and -1 for an integer parameter, so the overrides are converted to the declared types first
+    Params res = overrides;
+    ConstEval ev( &overrides );
+    bool complete = true;
+    Params::iterator i;
+    for( i = res.begin(); i != res.end(); ++i )
+    {
+        const SynTree* decl = m->d_decls.value( i.key() );
+        if( decl == 0 )
+            continue; // reported by specialiseImp
+        quint32 width;
+        bool sgn;
+        if( !ev.evalParamType( decl, width, sgn ) )
+        {
+            complete = false;
+            break;
+        }
+        i.value() = ConstEval::toParamType( i.value(), width, sgn );
+    }
+    if( complete )
+        return res;
+
+    // the range depends on a parameter which is not overridden, or the type is real; take the converted values
+    // from the evaluation of the whole module
+    Params all;
+    for( i = res.begin(); i != res.end(); ++i )
+    {
+        if( m->d_decls.contains( i.key() ) )
+            all.insert( i.key(), overrides.value( i.key() ) );
+    }
+    ConstEval().evalParams( m->d_st, all );
+    res = overrides;
+    for( i = res.begin(); i != res.end(); ++i )
+    {
+        if( m->d_decls.contains( i.key() ) && all.contains( i.key() ) )
+            i.value() = all.value( i.key() );
+    }
+    return res;
+}
+
+Elaborator::Specialisation Elaborator::specialiseImp(const QByteArray& name, const Params& raw)
+{
+    const Module* m = module( name );
+    const Params overrides = m ? toDeclaredTypes( m, raw ) : raw;
+    const QByteArray key = normalise( name, overrides );
+    QHash<QByteArray,Specialisation>::const_iterator i = d_specs.find( key );
+    if( i != d_specs.end() )
+    {
+        d_hits++;
+        return i.value();
+    }
+    d_misses++;
+
+    Specialisation res;
+    res.d_module = name;
+    res.d_key = key;
+    if( m == 0 )
+    {
+        res.d_error = tr("module '%1' not found").arg( name.constData() );
+        return res; // not cached, the module might show up with the next update
+    }
+    res.d_params = overrides;
+    Params::const_iterator j;
+    for( j = overrides.begin(); j != overrides.end(); ++j )
+    {
+        if( !m->d_overridable.contains( j.key() ) )
+        {
+            res.d_params.remove( j.key() );
+            if( res.d_error.isEmpty() )
+            {
+                res.d_error = tr("module '%1' has no parameter '%2'").arg( name.constData() ).
+                        arg( j.key().constData() );
+                res.d_errorPos = m->d_st->d_tok;
+            }
+        }
+    }
+    ConstEval ev;
+    if( !ev.evalParams( m->d_st, res.d_params ) && res.d_error.isEmpty() )
+    {
+        res.d_error = ev.getError();
+        res.d_errorPos = ev.getErrorPos();
+    }
+    d_specs.insert( key, res );
+    return res;
+}
+
+const SynTree* Elaborator::findInstantiation(const SynTree* st, const Token& instName)
+{
+    foreach( const SynTree* sub, st->d_children )
+    {
+        if( sub->d_tok.d_type == SynTree::R_module_or_udp_instantiation_ )
+        {
+            foreach( const SynTree* inst, sub->d_children )
+            {
+                if( inst->d_tok.d_type != SynTree::R_module_or_udp_instance_ )
+                    continue;
+                foreach( const SynTree* id, inst->d_children )
+                {
+                    if( id->d_tok.d_type == Tok_Ident && id->d_tok.d_lineNr == instName.d_lineNr &&
+                            id->d_tok.d_colNr == instName.d_colNr )
+                        return sub;
+                }
+            }
+        }else if( sub->d_tok.d_type > SynTree::R_First )
+        {
+            const SynTree* res = findInstantiation( sub, instName );
+            if( res )
+                return res;
+        }
+    }
+    return 0;
+}
+
+void Elaborator::evalOverrides(const SynTree* instantiation, const Module* cell, const Specialisation& parent,
+                               Params& overrides, Specialisation& res)
+{
+    // parameter_value_assignment_or_delay2_ ::= '#' '(' ( mintypmax_expression { ',' mintypmax_expression }
+    //                                                   | named_parameter_assignment { ',' ... } ) ')'
+    const SynTree* pva = 0;
+    foreach( const SynTree* sub, instantiation->d_children )
+    {
+        if( sub->d_tok.d_type == SynTree::R_parameter_value_assignment_or_delay2_ )
+            pva = sub;
+    }
+    if( pva == 0 )
+        return;
+    ConstEval ev( &parent.d_params );
+    int pos = 0;
+    foreach( const SynTree* sub, pva->d_children )
+    {
+        QByteArray name;
+        const SynTree* expr = 0;
+        if( sub->d_tok.d_type == SynTree::R_mintypmax_expression )
+        {
+            if( pos < cell->d_overridable.size() )
+                name = cell->d_overridable[pos];
+            expr = sub;
+            pos++;
+            if( name.isEmpty() )
+            {
+                if( res.d_error.isEmpty() )
+                {
+                    res.d_error = tr("too many parameter values");
+                    res.d_errorPos = sub->d_tok;
+                }
+                continue;
+            }
+        }else if( sub->d_tok.d_type == SynTree::R_named_parameter_assignment )
+        {
+            foreach( const SynTree* s, sub->d_children )
+            {
+                if( s->d_tok.d_type == Tok_Ident )
+                    name = s->d_tok.d_val;
+                else if( s->d_tok.d_type == SynTree::R_mintypmax_expression )
+                    expr = s;
+            }
+        }
+        if( name.isEmpty() || expr == 0 )
+            continue; // .P() keeps the default
+        const ConstEval::Value v = ev.eval( expr );
+        if( v.isValid() )
+            overrides.insert( name, v );
+        else if( res.d_error.isEmpty() )
+        {
+            // e.g. a genvar in a generate loop; the parameter keeps its default
+            res.d_error = ev.getError();
+            res.d_errorPos = ev.getErrorPos();
+        }
+    }
+}
+
+Elaborator::Specialisation Elaborator::findByInstanceImp(const QByteArray& path)
+{
+    QHash<QByteArray,QByteArray>::const_iterator i = d_paths.find( path );
+    if( i != d_paths.end() )
+    {
+        QHash<QByteArray,Specialisation>::const_iterator j = d_specs.find( i.value() );
+        if( j != d_specs.end() )
+        {
+            d_hits++;
+            return j.value();
+        }
+    }
+
+    const CrossRefModel::Instance inst = d_mdl->findInstance( path );
+    Specialisation res;
+    if( inst.d_cell.constData() == 0 )
+    {
+        res.d_error = tr("instance '%1' not found").arg( path.constData() );
+        return res;
+    }
+    const QByteArray cellName = inst.d_cell->tok().d_val;
+    if( inst.d_inst.constData() == 0 )
+        res = specialiseImp( cellName, Params() ); // the top module
+    else
+    {
+        // the instances in named generate blocks have more than one name, e.g. "top.g1.u"
+        const Specialisation parent = findByInstanceImp( path.left( path.size() - inst.d_name.size() - 1 ) );
+        const Module* pm = module( parent.d_module );
+        const Module* cell = module( cellName );
+        if( pm == 0 || cell == 0 )
+        {
+            res.d_error = tr("module '%1' not found").arg( ( pm == 0 ? parent.d_module : cellName ).constData() );
+            return res;
+        }
+        Params overrides;
+        Specialisation err;
+        const SynTree* instantiation = findInstantiation( pm->d_st, d_mdl->currentTok( inst.d_inst->tok() ) );
+        if( instantiation )
+            evalOverrides( instantiation, cell, parent, overrides, err );
+        res = specialiseImp( cellName, overrides );
+        if( !err.d_error.isEmpty() )
+        {
+            // the error belongs to the instance, not to the specialisation; the path is not cached
+            if( res.d_error.isEmpty() )
+            {
+                res.d_error = err.d_error;
+                res.d_errorPos = err.d_errorPos;
+            }
+            return res;
+        }
+    }
+    if( d_specs.contains( res.d_key ) )
+        d_paths.insert( path, res.d_key );
+    return res;
+}
@@ -0,0 +1,102 @@
+#ifndef VLELABORATOR_H
+#define VLELABORATOR_H
+
+/*
+* Copyright 2018-2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Verilog parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QObject>
+#include <QMutex>
+#include <QStringList>
+#include <QSet>
+#include <Verilog/VlConstEval.h>
+
+namespace Vl
+{
+    class CrossRefModel;
+
+    class Elaborator : public QObject
+    {
+        // this class is thread-safe
+        // Memoised parameter elaboration on top of a CrossRefModel. A specialisation is a module together with the
+        // values of its parameter overrides; it is elaborated once and shared by all instances with equal overrides,
+        // so the work on a hierarchy grows with the number of distinct specialisations, not with the instances.
+        // The SynTrees of the modules are parsed on demand from their files and kept until the file is updated;
+        // defparam is not considered.
+        Q_OBJECT
+    public:
+        typedef ConstEval::Params Params;
+        struct Specialisation
+        {
+            QByteArray d_module;
+            QByteArray d_key; // see normalise
+            Params d_params; // all parameters and localparams of the module
+            QString d_error; // the first error; the affected parameters are missing in d_params
+            Token d_errorPos;
+            bool isValid() const { return !d_module.isEmpty(); }
+        };
+        struct Stats
+        {
+            quint32 d_modules, d_specs, d_paths, d_hits, d_misses;
+            Stats():d_modules(0),d_specs(0),d_paths(0),d_hits(0),d_misses(0){}
+        };
+
+        explicit Elaborator(CrossRefModel*, QObject *parent = 0);
+        ~Elaborator();
+
+        Specialisation specialise( const QByteArray& module, const Params& overrides = Params() );
+        // path as in CrossRefModel::findInstance; the overrides are evaluated in the specialisation of the parent
+        Specialisation findByInstance( const QByteArray& path );
+        Stats getStats() const;
+        void clear();
+
+        static QByteArray normalise( const QByteArray& module, const Params& overrides ); // e.g. fifo#(DEPTH=32'sh10)
+    protected slots:
+        void onFileUpdated( const QString& );
+        void onModelUpdated();
+    protected:
+        struct Module
+        {
+            SynTree* d_st; // R_module_declaration, owned
+            QString d_file;
+            QList<QByteArray> d_overridable; // parameters in order of declaration, for ordered overrides
+            QHash<QByteArray,const SynTree*> d_decls; // overridable parameter -> its parameter_declaration in d_st
+            Module():d_st(0){}
+        };
+        const Module* module( const QByteArray& ); // d_lock
+        void parseFile( const QString& ); // d_lock
+        Specialisation specialiseImp( const QByteArray& module, const Params& overrides ); // d_lock
+        Specialisation findByInstanceImp( const QByteArray& path ); // d_lock
+        static void collectParams( const SynTree*, QList<QByteArray>&, QHash<QByteArray,const SynTree*>&,
+                                   bool& hasPortList );
+        static Params toDeclaredTypes( const Module*, const Params& overrides );
+        static const SynTree* findInstantiation( const SynTree*, const Token& instName );
+        void evalOverrides( const SynTree* instantiation, const Module*, const Specialisation& parent,
+                            Params& overrides, Specialisation& res );
+    private:
+        CrossRefModel* d_mdl;
+        mutable QMutex d_lock;
+        QHash<QByteArray,Module*> d_modules; // module name -> parsed module
+        QHash<QByteArray,Specialisation> d_specs; // normalised key -> specialisation
+        QHash<QByteArray,QByteArray> d_paths; // instance path -> key; depends on the whole hierarchy
+        QSet<QString> d_parsed; // files already parsed, also if they had no modules
+        quint32 d_hits, d_misses;
+    };
+}
+
+#endif // VLELABORATOR_H
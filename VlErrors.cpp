@@ -32,50 +32,64 @@ Errors::Errors(QObject *parent, bool threadExclusive) :
 
 void Errors::error(Errors::Source s, const QString& file, int line, int col, const QString& msg)
 {
-    if( !d_threadExclusive ) d_lock.lockForWrite();
-    bool inserted = true;
-    if( d_record )
-    {
-        Entry e;
-        e.d_col = col;
-        e.d_line = line;
-        e.d_msg = msg;
-        e.d_source = s;
-        EntryList& l = d_errs[file];
-        const int count = l.size();
-        l.insert(e);
-        inserted = count != l.size();
-    }
-    if( d_reportToConsole && inserted )
-    {
-        qCritical() << QFileInfo(file).fileName() << ":" << line << ":" << col << ": error:" << msg;
-        d_numOfErrs++;
-    }
-    if( !d_threadExclusive ) d_lock.unlock();
+    report( true, s, file, line, col, Msg_Text, msg.toUtf8(), QByteArray() );
 }
 
 void Errors::warning(Errors::Source s, const QString& file, int line, int col, const QString& msg)
+{
+    report( false, s, file, line, col, Msg_Text, msg.toUtf8(), QByteArray() );
+}
+
+void Errors::error(Errors::Source s, const QString& file, int line, int col, Errors::MsgId id,
+                   const QByteArray& arg1, const QByteArray& arg2)
+{
+    report( true, s, file, line, col, id, arg1, arg2 );
+}
+
+void Errors::warning(Errors::Source s, const QString& file, int line, int col, Errors::MsgId id,
+                     const QByteArray& arg1, const QByteArray& arg2)
+{
+    report( false, s, file, line, col, id, arg1, arg2 );
+}
+
+void Errors::report(bool err, Errors::Source s, const QString& file, int line, int col, quint8 id,
+                    const QByteArray& arg1, const QByteArray& arg2)
 {
     if( !d_threadExclusive ) d_lock.lockForWrite();
     bool inserted = true;
-    if( d_showWarnings )
+    if( err || d_showWarnings )
     {
         if( d_record )
         {
             Entry e;
             e.d_col = col;
             e.d_line = line;
-            e.d_msg = msg;
             e.d_source = s;
-            EntryList& l = d_wrns[file];
+            e.d_id = id;
+            e.d_arg1 = arg1;
+            e.d_arg2 = arg2;
+            EntryList& l = err ? d_errs[file] : d_wrns[file];
             const int count = l.size();
             l.insert(e);
             inserted = count != l.size();
         }
+        // Text is only formatted here if it is actually shown; recorded entries are formatted on demand
         if( d_reportToConsole && inserted )
-            qWarning() << QFileInfo(file).fileName() << ":" << line << ":" << col << ": warning:" << msg;
+        {
+            if( err )
+                qCritical() << QFileInfo(file).fileName() << ":" << line << ":" << col << ": error:" <<
+                               formatMsg( id, arg1, arg2 );
+            else
+                qWarning() << QFileInfo(file).fileName() << ":" << line << ":" << col << ": warning:" <<
+                              formatMsg( id, arg1, arg2 );
+        }
     }
-    if( inserted )
+    // counted the same whether shown or not, so that merge() which counts the recorded entries agrees
+    if( err )
+    {
+        if( inserted )
+            d_numOfErrs++;
+    }else if( inserted && d_showWarnings )
         d_numOfWrns++;
     if( !d_threadExclusive ) d_lock.unlock();
 }
@@ -240,6 +254,35 @@ void Errors::update(const Errors& rhs, bool overwrite)
     if( !d_threadExclusive ) d_lock.unlock();
 }
 
+void Errors::merge(const Errors& rhs)
+{
+    if( !d_threadExclusive ) d_lock.lockForWrite();
+    if( !rhs.d_threadExclusive ) rhs.d_lock.lockForRead();
+
+    if( d_record )
+    {
+        // duplicates are only counted once, as in report()
+        EntriesByFile::const_iterator i;
+        for( i = rhs.d_errs.begin(); i != rhs.d_errs.end(); ++i )
+            d_errs[ i.key() ].unite( i.value() );
+        d_numOfErrs = 0;
+        for( i = d_errs.begin(); i != d_errs.end(); ++i )
+            d_numOfErrs += i.value().size();
+        for( i = rhs.d_wrns.begin(); i != rhs.d_wrns.end(); ++i )
+            d_wrns[ i.key() ].unite( i.value() );
+        d_numOfWrns = 0;
+        for( i = d_wrns.begin(); i != d_wrns.end(); ++i )
+            d_numOfWrns += i.value().size();
+    }else
+    {
+        d_numOfErrs += rhs.d_numOfErrs;
+        d_numOfWrns += rhs.d_numOfWrns;
+    }
+
+    if( !rhs.d_threadExclusive ) rhs.d_lock.unlock();
+    if( !d_threadExclusive ) d_lock.unlock();
+}
+
 const char* Errors::sourceName(int s)
 {
     switch(s)
@@ -257,3 +300,52 @@ const char* Errors::sourceName(int s)
     }
 }
 
+static inline QString ctxStr( const QByteArray& ctx )
+{
+    if( ctx.isEmpty() )
+        return QString();
+    else
+        return Errors::tr(" in %1").arg( ctx.constData() );
+}
+
+QString Errors::formatMsg(quint8 id, const QByteArray& arg1, const QByteArray& arg2)
+{
+    switch( id )
+    {
+    case Msg_Text:
+        return QString::fromUtf8(arg1);
+    case Msg_DuplicateName:
+        return tr("duplicate name: %1").arg(arg1.constData());
+    case Msg_DuplicateCell:
+        return tr("duplicate cell name '%1' already declared in %2").arg(arg1.constData())
+                .arg(QString::fromUtf8(arg2));
+    case Msg_DuplicatePortDecl:
+        return tr("duplicate port_declaration: %1").arg(arg1.constData());
+    case Msg_PortDeclWithoutLop:
+        return tr("port_declaration not allowed here if list_of_ports declaration is not used");
+    case Msg_PortDeclNotInLop:
+        return tr("port_declaration must correspond to one in the list_of_ports: %1").arg(arg1.constData());
+    case Msg_UnknownIdent:
+        return tr("unknown identifier: %1").arg(arg1.constData());
+    case Msg_NotANameSpace:
+        return tr("identifier is not a name space: %1").arg(arg1.constData());
+    case Msg_UnknownPortOrParam:
+        return tr("unknown port or parameter: %1").arg(arg1.constData());
+    case Msg_UnknownModule:
+        return tr("unknown module or udp: %1").arg(arg1.constData());
+    case Msg_InvalidNumber:
+        return tr("number %1: %2").arg(arg1.constData()).arg(QString::fromUtf8(arg2));
+    case Msg_LiteralExpected:
+        return tr("'%2' expected%1").arg(ctxStr(arg2)).arg(arg1.constData());
+    case Msg_TokenExpected:
+        return tr("%2 expected%1").arg(ctxStr(arg2)).arg(arg1.constData());
+    default:
+        return QString();
+    }
+}
+
+QString Errors::Entry::getMsg() const
+{
+    return formatMsg( d_id, d_arg1, d_arg2 );
+}
+
@@ -32,14 +32,34 @@ namespace Vl
         // class is thread-safe
     public:
         enum Source { Preprocessor, Lexer, Syntax, Semantics, Elaboration };
+        enum MsgId { // the text is only formatted on demand, see Entry::getMsg
+            Msg_Text,                   // arg1: free text in UTF-8
+            Msg_DuplicateName,          // arg1: ident
+            Msg_DuplicateCell,          // arg1: ident, arg2: file of existing cell in UTF-8
+            Msg_DuplicatePortDecl,      // arg1: ident
+            Msg_PortDeclWithoutLop,
+            Msg_PortDeclNotInLop,       // arg1: ident
+            Msg_UnknownIdent,           // arg1: ident
+            Msg_NotANameSpace,          // arg1: ident
+            Msg_UnknownPortOrParam,     // arg1: ident
+            Msg_UnknownModule,          // arg1: ident
+            Msg_InvalidNumber,          // arg1: number, arg2: reason in UTF-8
+            Msg_LiteralExpected,        // arg1: token string, arg2: context
+            Msg_TokenExpected,          // arg1: token string, arg2: context
+            Msg_Max
+        };
         struct Entry
         {
             quint32 d_line;
             quint16 d_col;
-            quint16 d_source;
-            QString d_msg;
+            quint8 d_source;
+            quint8 d_id; // MsgId
+            QByteArray d_arg1; // usually the d_val of a Token, i.e. implicitly shared and not copied
+            QByteArray d_arg2;
+            QString getMsg() const;
             bool operator==( const Entry& rhs )const { return d_line == rhs.d_line && d_col == rhs.d_col &&
-                        d_source == rhs.d_source && d_msg == rhs.d_msg; }
+                        d_source == rhs.d_source && d_id == rhs.d_id &&
+                        d_arg1 == rhs.d_arg1 && d_arg2 == rhs.d_arg2; }
         };
         typedef QSet<Entry> EntryList;
         typedef QHash<QString,EntryList> EntriesByFile;
@@ -48,6 +68,10 @@ namespace Vl
 
         void error( Source, const QString& file, int line, int col, const QString& msg );
         void warning( Source, const QString& file, int line, int col, const QString& msg );
+        void error( Source, const QString& file, int line, int col, MsgId,
+                    const QByteArray& arg1 = QByteArray(), const QByteArray& arg2 = QByteArray() );
+        void warning( Source, const QString& file, int line, int col, MsgId,
+                    const QByteArray& arg1 = QByteArray(), const QByteArray& arg2 = QByteArray() );
 
         bool showWarnings() const;
         void setShowWarnings(bool on);
@@ -67,9 +91,13 @@ namespace Vl
         void clearFile( const QString& file );
         void clearFiles( const QStringList& files );
         void update( const Errors&, bool overwrite = false );
+        void merge( const Errors& ); // adds all entries of rhs, unlike update which replaces them per file
 
         static const char* sourceName(int);
+        static QString formatMsg( quint8 id, const QByteArray& arg1, const QByteArray& arg2 );
     private:
+        void report( bool err, Source, const QString& file, int line, int col, quint8 id,
+                     const QByteArray& arg1, const QByteArray& arg2 );
         mutable QReadWriteLock d_lock;
         quint32 d_numOfErrs;
         quint32 d_numOfWrns;
@@ -82,7 +110,8 @@ namespace Vl
     };
 
     inline uint qHash(const Errors::Entry & e, uint seed = 0) {
-        return ::qHash(e.d_msg,seed) ^ ::qHash(e.d_line,seed) ^ ::qHash(e.d_col,seed) ^ ::qHash(e.d_source,seed);
+        return ::qHash(e.d_arg1,seed) ^ ::qHash(e.d_line,seed) ^ ::qHash(e.d_col,seed) ^
+                ::qHash( quint16( e.d_source << 8 | e.d_id ), seed );
     }
 }
 
@@ -82,6 +82,25 @@ QByteArray FileCache::getFile(const QString& path, bool* found) const
     return res;
 }
 
+int FileCache::getFileCount() const
+{
+    d_lock.lockForRead();
+    const int res = d_files.size();
+    d_lock.unlock();
+    return res;
+}
+
+quint64 FileCache::getByteCount() const
+{
+    quint64 res = 0;
+    d_lock.lockForRead();
+    Files::const_iterator i;
+    for( i = d_files.begin(); i != d_files.end(); ++i )
+        res += i.key().size() * sizeof(QChar) + i.value().size();
+    d_lock.unlock();
+    return res;
+}
+
 void FileCache::setSupportSvExt(bool b)
 {
     d_lock.lockForWrite();
@@ -38,6 +38,8 @@ namespace Vl
         void addFile( const QString& path, const QByteArray& content );
         void removeFile( const QString& path );
         QByteArray getFile( const QString& path, bool* found = 0) const;
+        int getFileCount() const;
+        quint64 getByteCount() const;
 
         void setSupportSvExt( bool b );
         bool supportSvExt() const;
@@ -0,0 +1,117 @@
+/*
+* Copyright 2018-2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Verilog parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "VlHash.h"
+#include <string.h>
+using namespace Vl;
+
+static const quint64 s_prime1 = 0x9E3779B185EBCA87ULL;
+static const quint64 s_prime2 = 0xC2B2AE3D27D4EB4FULL;
+static const quint64 s_prime3 = 0x165667B19E3779F9ULL;
+static const quint64 s_prime4 = 0x85EBCA77C2B2AE63ULL;
+static const quint64 s_prime5 = 0x27D4EB2F165667C5ULL;
+
+static inline quint64 rotl( quint64 x, int r )
+{
+    return ( x << r ) | ( x >> ( 64 - r ) );
+}
+
+static inline quint64 read64( const char* p )
+{
+    quint64 v;
+    ::memcpy( &v, p, sizeof(v) ); // unaligned
+    return v;
+}
+
+static inline quint32 read32( const char* p )
+{
+    quint32 v;
+    ::memcpy( &v, p, sizeof(v) );
+    return v;
+}
+
+static inline quint64 round( quint64 acc, quint64 input )
+{
+    acc += input * s_prime2;
+    acc = rotl( acc, 31 );
+    return acc * s_prime1;
+}
+
+static inline quint64 mergeRound( quint64 acc, quint64 val )
+{
+    acc ^= round( 0, val );
+    return acc * s_prime1 + s_prime4;
+}
+
+quint64 Hash::xx64(const char* data, quint32 len, quint64 seed)
+{
+    const char* p = data;
+    const char* const end = data + len;
+    quint64 h;
+
+    if( len >= 32 )
+    {
+        const char* const limit = end - 32;
+        quint64 v1 = seed + s_prime1 + s_prime2;
+        quint64 v2 = seed + s_prime2;
+        quint64 v3 = seed;
+        quint64 v4 = seed - s_prime1;
+        do
+        {
+            v1 = round( v1, read64(p) ); p += 8;
+            v2 = round( v2, read64(p) ); p += 8;
+            v3 = round( v3, read64(p) ); p += 8;
+            v4 = round( v4, read64(p) ); p += 8;
+        }while( p <= limit );
+        h = rotl( v1, 1 ) + rotl( v2, 7 ) + rotl( v3, 12 ) + rotl( v4, 18 );
+        h = mergeRound( h, v1 );
+        h = mergeRound( h, v2 );
+        h = mergeRound( h, v3 );
+        h = mergeRound( h, v4 );
+    }else
+        h = seed + s_prime5;
+
+    h += len;
+
+    while( p + 8 <= end )
+    {
+        h ^= round( 0, read64(p) );
+        h = rotl( h, 27 ) * s_prime1 + s_prime4;
+        p += 8;
+    }
+    if( p + 4 <= end )
+    {
+        h ^= quint64( read32(p) ) * s_prime1;
+        h = rotl( h, 23 ) * s_prime2 + s_prime3;
+        p += 4;
+    }
+    while( p < end )
+    {
+        h ^= quint64( quint8(*p) ) * s_prime5;
+        h = rotl( h, 11 ) * s_prime1;
+        p++;
+    }
+
+    h ^= h >> 33;
+    h *= s_prime2;
+    h ^= h >> 29;
+    h *= s_prime3;
+    h ^= h >> 32;
+    return h;
+}
@@ -0,0 +1,40 @@
+#ifndef VLHASH_H
+#define VLHASH_H
+
+/*
+* Copyright 2018-2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Verilog parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QByteArray>
+
+namespace Vl
+{
+    class Hash
+    {
+        // XXH64 (see github.com/Cyan4973/xxHash), a fast non-cryptographic hash; used to recognize unchanged
+        // file contents. The input is read in host byte order, so the values must not be stored persistently.
+    public:
+        static quint64 xx64( const char* data, quint32 len, quint64 seed = 0 );
+        static quint64 xx64( const QByteArray& data, quint64 seed = 0 )
+            { return xx64( data.constData(), data.size(), seed ); }
+    private:
+        Hash() {}
+    };
+}
+
+#endif // VLHASH_H
@@ -18,6 +18,7 @@
 */
 
 #include "VlIncludes.h"
+#include "VlHash.h"
 #include <QFileInfo>
 #include <QtDebug>
 using namespace Vl;
@@ -79,6 +80,33 @@ QString Includes::findPath(const QString& fileName, const QString& relativeTo)
     return fileName;
 }
 
+QStringList Includes::candidatePaths(const QString& fileName)
+{
+    QStringList res;
+    if( QFileInfo(fileName).isRelative() )
+    {
+        d_lock.lockForRead();
+        foreach( const QDir& dir, d_includes )
+            res.append( dir.absoluteFilePath(fileName) );
+        d_lock.unlock();
+    }else
+        res.append( fileName );
+    return res;
+}
+
+quint64 Includes::getHash()
+{
+    QByteArray text;
+    d_lock.lockForRead();
+    foreach( const QDir& dir, d_includes )
+    {
+        text += dir.absolutePath().toUtf8();
+        text += '\n';
+    }
+    d_lock.unlock();
+    return Hash::xx64( text );
+}
+
 void Includes::clear()
 {
     d_lock.lockForWrite();
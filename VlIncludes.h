@@ -36,6 +36,8 @@ namespace Vl
         void addDir( const QDir& h );
         QString findPath( const QString& fileName );
         QString findPath( const QString& fileName, const QString& relativeTo );
+        QStringList candidatePaths( const QString& fileName ); // where findPath(fileName) looks
+        quint64 getHash(); // of the directories in their order
         void setAutoAdd(bool on) { d_autoAdd = on; }
         bool getAutoAdd() const { return d_autoAdd; }
         void clear();
@@ -0,0 +1,334 @@
+/*
+* Copyright 2018-2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Verilog parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "VlIndexFile.h"
+#include "VlCrossRefModel.h"
+#include "VlSynTree.h"
+#include <QSaveFile>
+#include <QHash>
+#include <QVector>
+#include <QQueue>
+#include <cstring>
+using namespace Vl;
+
+static const quint32 s_byteOrder = 0x01020304;
+
+namespace
+{
+    struct Strings
+    {
+        QByteArray d_data;
+        QHash<QByteArray,quint32> d_offsets;
+        quint32 add( const QByteArray& str )
+        {
+            QHash<QByteArray,quint32>::const_iterator i = d_offsets.find( str );
+            if( i != d_offsets.end() )
+                return i.value();
+            const quint32 off = d_data.size();
+            d_data += str;
+            d_data += char(0);
+            d_offsets.insert( str, off );
+            return off;
+        }
+    };
+    struct Files
+    {
+        QVector<IndexFile::FileRec> d_recs;
+        QHash<QString,quint32> d_ids;
+        quint32 add( const QString& path, Strings& strs )
+        {
+            QHash<QString,quint32>::const_iterator i = d_ids.find( path );
+            if( i != d_ids.end() )
+                return i.value();
+            IndexFile::FileRec r;
+            r.d_path = strs.add( path.toUtf8() );
+            d_recs.append( r );
+            d_ids.insert( path, d_recs.size() - 1 );
+            return d_recs.size() - 1;
+        }
+    };
+}
+
+static bool lessByName( const CrossRefModel::IdentDeclRef& lhs, const CrossRefModel::IdentDeclRef& rhs )
+{
+    return lhs->tok().d_val < rhs->tok().d_val;
+}
+
+template<class T>
+static void writeRecs( QIODevice& out, const QVector<T>& recs )
+{
+    if( !recs.isEmpty() )
+        out.write( reinterpret_cast<const char*>( recs.constData() ), recs.size() * sizeof(T) );
+}
+
+bool IndexFile::write(const CrossRefModel* mdl, const QString& path, QString* error)
+{
+    Strings strs;
+    Files files;
+    QVector<ScopeRec> scopes;
+    QVector<DeclRec> decls;
+    QVector<RefRec> refs;
+
+    mdl->d_lock.lockForRead();
+    // Breadth first, so the names of each scope are appended en bloc and stay contiguous
+    QHash<const CrossRefModel::Scope*,quint32> scopeIds;
+    QQueue<const CrossRefModel::Scope*> queue;
+    QList<const CrossRefModel::IdentDecl*> declSyms;
+    ScopeRec global;
+    global.d_decl = Nil;
+    global.d_super = Nil;
+    global.d_firstName = global.d_nameCount = 0;
+    scopes.append( global );
+    scopeIds.insert( &mdl->d_global, 0 );
+    queue.enqueue( &mdl->d_global );
+    while( !queue.isEmpty() )
+    {
+        const CrossRefModel::Scope* scope = queue.dequeue();
+        const quint32 scopeId = scopeIds.value( scope );
+        CrossRefModel::IdentDeclRefList names = scope->getNames();
+        std::stable_sort( names.begin(), names.end(), lessByName );
+        scopes[scopeId].d_firstName = decls.size();
+        scopes[scopeId].d_nameCount = names.size();
+        foreach( const CrossRefModel::IdentDeclRef& id, names )
+        {
+            DeclRec d;
+            d.d_name = strs.add( id->tok().d_val );
+            d.d_scope = scopeId;
+            d.d_subScope = Nil;
+            d.d_file = files.add( id->tok().d_sourcePath, strs );
+            d.d_line = CrossRefModel::currentLine( mdl->d_files.value( id->tok().d_sourcePath ).d_shifts,
+                                                   id->tok().d_lineNr );
+            d.d_col = id->tok().d_colNr;
+            d.d_len = id->tok().d_len;
+            d.d_kind = 0;
+            d.d_reserved = 0;
+            d.d_firstRef = d.d_refCount = 0;
+            if( const CrossRefModel::Branch* b = id->decl() )
+            {
+                d.d_kind = b->tok().d_type;
+                // the ports are declared in the list_of_ports scope, which is not opened by a name
+                const CrossRefModel::Scope* sub = b->toScope();
+                if( sub && sub != scope && sub->tok().d_type != SynTree::R_list_of_ports &&
+                        !scopeIds.contains( sub ) )
+                {
+                    ScopeRec s;
+                    s.d_decl = decls.size();
+                    s.d_super = scopeId;
+                    s.d_firstName = s.d_nameCount = 0;
+                    d.d_subScope = scopes.size();
+                    scopeIds.insert( sub, scopes.size() );
+                    scopes.append( s );
+                    queue.enqueue( sub );
+                }
+            }
+            decls.append( d );
+            declSyms.append( id.constData() );
+        }
+    }
+    for( int i = 0; i < declSyms.size(); i++ )
+    {
+        const QList<const CrossRefModel::Symbol*> uses = mdl->d_revIndex.values( declSyms[i] );
+        decls[i].d_firstRef = refs.size();
+        decls[i].d_refCount = uses.size();
+        foreach( const CrossRefModel::Symbol* sym, uses )
+        {
+            RefRec r;
+            r.d_file = files.add( sym->tok().d_sourcePath, strs );
+            r.d_line = CrossRefModel::currentLine( mdl->d_files.value( sym->tok().d_sourcePath ).d_shifts,
+                                                   sym->tok().d_lineNr );
+            r.d_col = sym->tok().d_colNr;
+            r.d_len = sym->tok().d_len;
+            refs.append( r );
+        }
+    }
+    mdl->d_lock.unlock();
+
+    Header h;
+    ::memcpy( h.d_magic, "VLIX", 4 );
+    h.d_version = Version;
+    h.d_byteOrder = s_byteOrder;
+    h.d_fileCount = files.d_recs.size();
+    h.d_scopeCount = scopes.size();
+    h.d_declCount = decls.size();
+    h.d_refCount = refs.size();
+    h.d_stringBytes = strs.d_data.size();
+    // all records have a size which is a multiple of four; the strings go last since they need no alignment
+    h.d_files = sizeof(Header);
+    h.d_scopes = h.d_files + h.d_fileCount * sizeof(FileRec);
+    h.d_decls = h.d_scopes + h.d_scopeCount * sizeof(ScopeRec);
+    h.d_refs = h.d_decls + h.d_declCount * sizeof(DeclRec);
+    h.d_strings = h.d_refs + h.d_refCount * sizeof(RefRec);
+
+    QSaveFile out( path );
+    if( !out.open( QIODevice::WriteOnly ) )
+    {
+        if( error )
+            *error = out.errorString();
+        return false;
+    }
+    out.write( reinterpret_cast<const char*>(&h), sizeof(Header) );
+    writeRecs( out, files.d_recs );
+    writeRecs( out, scopes );
+    writeRecs( out, decls );
+    writeRecs( out, refs );
+    out.write( strs.d_data );
+    if( !out.commit() )
+    {
+        if( error )
+            *error = out.errorString();
+        return false;
+    }
+    return true;
+}
+
+IndexFile::IndexFile():d_map(0),d_hdr(0),d_files(0),d_scopes(0),d_decls(0),d_refs(0),d_strings(0)
+{
+}
+
+IndexFile::~IndexFile()
+{
+    close();
+}
+
+bool IndexFile::open(const QString& path)
+{
+    close();
+    d_file.setFileName( path );
+    if( !d_file.open( QIODevice::ReadOnly ) )
+        return fail( d_file.errorString() );
+    const qint64 size = d_file.size();
+    if( size < qint64(sizeof(Header)) )
+        return fail( "file too short" );
+    d_map = d_file.map( 0, size );
+    if( d_map == 0 )
+        return fail( d_file.errorString() );
+
+    const Header* h = reinterpret_cast<const Header*>( d_map );
+    if( ::memcmp( h->d_magic, "VLIX", 4 ) != 0 )
+        return fail( "not an index file" );
+    if( h->d_byteOrder != s_byteOrder )
+        return fail( "index file has the wrong byte order" );
+    if( h->d_version != Version )
+        return fail( QString("unsupported index file version %1").arg(h->d_version) );
+    // only the sections are checked here; string offsets and ref ranges are checked on access
+    if( h->d_files != sizeof(Header) ||
+            h->d_scopes != h->d_files + quint64(h->d_fileCount) * sizeof(FileRec) ||
+            h->d_decls != h->d_scopes + quint64(h->d_scopeCount) * sizeof(ScopeRec) ||
+            h->d_refs != h->d_decls + quint64(h->d_declCount) * sizeof(DeclRec) ||
+            h->d_strings != h->d_refs + quint64(h->d_refCount) * sizeof(RefRec) ||
+            h->d_strings + quint64(h->d_stringBytes) != quint64(size) || h->d_scopeCount == 0 ||
+            ( h->d_stringBytes != 0 && d_map[size-1] != 0 ) )
+        return fail( "index file is corrupt" );
+
+    d_files = reinterpret_cast<const FileRec*>( d_map + h->d_files );
+    d_scopes = reinterpret_cast<const ScopeRec*>( d_map + h->d_scopes );
+    d_decls = reinterpret_cast<const DeclRec*>( d_map + h->d_decls );
+    d_refs = reinterpret_cast<const RefRec*>( d_map + h->d_refs );
+    d_strings = reinterpret_cast<const char*>( d_map + h->d_strings );
+    d_hdr = h;
+    d_error.clear();
+    return true;
+}
+
+void IndexFile::close()
+{
+    if( d_map )
+        d_file.unmap( const_cast<uchar*>(d_map) );
+    d_file.close();
+    d_map = 0;
+    d_hdr = 0;
+    d_files = 0;
+    d_scopes = 0;
+    d_decls = 0;
+    d_refs = 0;
+    d_strings = 0;
+}
+
+const char* IndexFile::getString(quint32 offset) const
+{
+    if( d_hdr == 0 || offset >= d_hdr->d_stringBytes )
+        return "";
+    return d_strings + offset;
+}
+
+const IndexFile::RefRec* IndexFile::getRefs(quint32 decl, quint32* count) const
+{
+    *count = 0;
+    if( d_hdr == 0 || decl >= d_hdr->d_declCount )
+        return 0;
+    const DeclRec& d = d_decls[decl];
+    if( quint64(d.d_firstRef) + d.d_refCount > d_hdr->d_refCount )
+        return 0;
+    *count = d.d_refCount;
+    return d_refs + d.d_firstRef;
+}
+
+quint32 IndexFile::findFile(const char* path) const
+{
+    for( quint32 i = 0; i < getFileCount(); i++ )
+    {
+        if( ::strcmp( getFile(i), path ) == 0 )
+            return i;
+    }
+    return Nil;
+}
+
+quint32 IndexFile::findName(quint32 scope, const char* name) const
+{
+    if( scope >= getScopeCount() )
+        return Nil;
+    const ScopeRec& s = d_scopes[scope];
+    if( quint64(s.d_firstName) + s.d_nameCount > d_hdr->d_declCount )
+        return Nil;
+    quint32 lo = s.d_firstName;
+    quint32 hi = s.d_firstName + s.d_nameCount;
+    while( lo < hi )
+    {
+        const quint32 mid = lo + ( hi - lo ) / 2;
+        const int cmp = ::strcmp( getName(mid), name );
+        if( cmp == 0 )
+            return mid;
+        else if( cmp < 0 )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return Nil;
+}
+
+quint32 IndexFile::findQualified(const QByteArray& path) const
+{
+    const QList<QByteArray> parts = path.split('.');
+    quint32 scope = 0;
+    for( int i = 0; i < parts.size(); i++ )
+    {
+        const quint32 decl = findName( scope, parts[i].constData() );
+        if( decl == Nil || i == parts.size() - 1 )
+            return decl;
+        scope = d_decls[decl].d_subScope;
+    }
+    return Nil;
+}
+
+bool IndexFile::fail(const QString& msg)
+{
+    close();
+    d_error = msg;
+    return false;
+}
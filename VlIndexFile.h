@@ -0,0 +1,115 @@
+#ifndef VLINDEXFILE_H
+#define VLINDEXFILE_H
+
+/*
+* Copyright 2018-2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Verilog parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QFile>
+
+namespace Vl
+{
+    class CrossRefModel;
+
+    class IndexFile
+    {
+        // Read-only view of a cross-reference index exported by write(). The file is mapped into memory and
+        // all queries work directly on the mapped records, so opening costs a header check and the heap use
+        // does not depend on the size of the design. All integers are in host byte order; a file written on
+        // a machine with the other byte order is rejected by open().
+    public:
+        enum { Version = 1, Nil = 0xffffffff };
+
+        struct Header
+        {
+            char d_magic[4]; // "VLIX"
+            quint32 d_version;
+            quint32 d_byteOrder; // 0x01020304 as written
+            quint32 d_fileCount, d_scopeCount, d_declCount, d_refCount, d_stringBytes;
+            quint32 d_files, d_scopes, d_decls, d_refs, d_strings; // byte offsets from the start of the file
+        };
+        struct FileRec
+        {
+            quint32 d_path; // string offset
+        };
+        struct ScopeRec
+        {
+            // scope 0 is the global scope; its names are the modules and primitives
+            quint32 d_decl; // the declaration which opens this scope, Nil for the global scope
+            quint32 d_super; // enclosing scope, Nil for the global scope
+            quint32 d_firstName, d_nameCount; // contiguous decls, sorted by name
+        };
+        struct DeclRec
+        {
+            quint32 d_name; // string offset
+            quint32 d_scope; // the scope this name is declared in
+            quint32 d_subScope; // the scope opened by this declaration, or Nil
+            quint32 d_file, d_line;
+            quint16 d_col, d_len;
+            quint16 d_kind; // token type or parser rule of the declaration, see SynTree
+            quint16 d_reserved;
+            quint32 d_firstRef, d_refCount; // contiguous refs, grouped by file and sorted by position
+        };
+        struct RefRec
+        {
+            quint32 d_file, d_line;
+            quint16 d_col, d_len;
+        };
+
+        IndexFile();
+        ~IndexFile();
+
+        static bool write( const CrossRefModel*, const QString& path, QString* error = 0 ); // read lock
+
+        bool open( const QString& path );
+        void close();
+        bool isOpen() const { return d_hdr != 0; }
+        QString getError() const { return d_error; }
+
+        quint32 getFileCount() const { return d_hdr ? d_hdr->d_fileCount : 0; }
+        quint32 getScopeCount() const { return d_hdr ? d_hdr->d_scopeCount : 0; }
+        quint32 getDeclCount() const { return d_hdr ? d_hdr->d_declCount : 0; }
+        quint32 getRefCount() const { return d_hdr ? d_hdr->d_refCount : 0; }
+
+        const char* getString( quint32 offset ) const; // "" if out of range
+        const char* getFile( quint32 i ) const { return getString( d_files[i].d_path ); }
+        const ScopeRec& getScope( quint32 i ) const { return d_scopes[i]; }
+        const DeclRec& getDecl( quint32 i ) const { return d_decls[i]; }
+        const char* getName( quint32 decl ) const { return getString( d_decls[decl].d_name ); }
+        const RefRec* getRefs( quint32 decl, quint32* count ) const;
+
+        quint32 findFile( const char* path ) const; // linear; Nil if not found
+        quint32 findName( quint32 scope, const char* name ) const; // binary search; decl or Nil
+        quint32 findGlobal( const char* name ) const { return findName( 0, name ); }
+        quint32 findQualified( const QByteArray& path ) const; // "module.block.name" -> decl or Nil
+    private:
+        Q_DISABLE_COPY(IndexFile)
+        bool fail( const QString& );
+        QFile d_file;
+        const uchar* d_map;
+        const Header* d_hdr;
+        const FileRec* d_files;
+        const ScopeRec* d_scopes;
+        const DeclRec* d_decls;
+        const RefRec* d_refs;
+        const char* d_strings;
+        QString d_error;
+    };
+}
+
+#endif // VLINDEXFILE_H
@@ -22,7 +22,7 @@
 using namespace Vl;
 
 NumLex::NumLex(const QByteArray& str, int start):
-    d_str(str),d_start(start),d_off(start),d_kind(Unknown),d_signed(false),
+    d_str(str),d_start(start),d_off(start),d_kind(Unknown),d_validity(Unchecked),d_width(0),d_signed(false),
     d_hasSize(false),d_hasBaseFormat(false),d_hasValue(false),d_fullValidation(false)
 {
 }
@@ -98,6 +98,149 @@ bool NumLex::parse(bool fullValidation)
     }
 }
 
+enum { BinDigit = 1, OctDigit = 2, DecDigit = 4, HexDigit = 8, XzDigit = 16, AnyDigit = 31, DecOnly = 32 };
+
+static quint8 s_digits[256]; // char -> combination of the above
+
+static bool initDigits()
+{
+    for( int ch = '0'; ch <= '9'; ch++ )
+        s_digits[ch] = DecDigit | HexDigit | DecOnly | ( ch <= '7' ? OctDigit : 0 ) | ( ch <= '1' ? BinDigit : 0 );
+    for( int ch = 'a'; ch <= 'f'; ch++ )
+        s_digits[ch] = s_digits[ch - 'a' + 'A'] = HexDigit;
+    s_digits[int('x')] = s_digits[int('X')] = s_digits[int('z')] = s_digits[int('Z')] = s_digits[int('?')] = XzDigit;
+    return true;
+}
+static const bool s_digitsInit = initDigits();
+
+static inline quint8 digitClass( char ch )
+{
+    return s_digits[quint8(ch)];
+}
+
+bool NumLex::lex()
+{
+    if( lexFast() )
+        return true;
+    if( !parse() )
+        return false;
+    // validate only the text of the number, as a trailing delimiter would be reported as an invalid digit
+    NumLex full( d_str.mid( d_start, d_off ) );
+    d_validity = full.parse(true) ? Valid : Invalid;
+    if( d_hasSize && checkOnlyDigits( d_size ) )
+    {
+        const qulonglong w = d_size.toULongLong();
+        d_width = w > 0xffffffff ? 0xffffffff : w;
+    }
+    return true;
+}
+
+bool NumLex::lexFast()
+{
+    // Covers 123, 1_000, 8'hff, 4'sb10z1 without white space; everything else goes the regular way.
+    const char* str = d_str.constData() + d_start;
+    const int len = d_str.size() - d_start;
+    if( len == 0 || !( digitClass(str[0]) & DecOnly ) )
+        return false;
+    quint64 num = str[0] - '0';
+    int i = 1;
+    while( i < len )
+    {
+        const char ch = str[i];
+        if( digitClass(ch) & DecOnly )
+        {
+            if( num <= 0xffffffff )
+                num = num * 10 + ( ch - '0' );
+        }else if( ch != '_' )
+            break;
+        i++;
+    }
+    const char ch = i < len ? str[i] : 0;
+    if( ch != '\'' )
+    {
+        // no real, no digits which parse() would take for hex, no size separated by white space
+        if( ch == '.' || ( digitClass(ch) & HexDigit ) )
+            return false;
+        int j = i;
+        while( j < len && ::isspace( str[j] ) )
+            j++;
+        if( j < len && str[j] == '\'' )
+            return false;
+        d_off = i;
+        d_kind = Decimal;
+        d_validity = Valid;
+        return true;
+    }
+    if( str[0] == '0' )
+        return false; // invalid size, let parse() do the rest
+    i++;
+    bool sign = false;
+    if( i < len && ( str[i] == 's' || str[i] == 'S' ) )
+    {
+        sign = true;
+        i++;
+    }
+    quint8 allowed;
+    switch( i < len ? str[i] : 0 )
+    {
+    case 'b':
+    case 'B':
+        d_kind = Binary;
+        allowed = BinDigit | XzDigit;
+        break;
+    case 'o':
+    case 'O':
+        d_kind = Octal;
+        allowed = OctDigit | XzDigit;
+        break;
+    case 'd':
+    case 'D':
+        d_kind = Decimal;
+        allowed = DecDigit | XzDigit;
+        break;
+    case 'h':
+    case 'H':
+        d_kind = Hex;
+        allowed = HexDigit | XzDigit;
+        break;
+    default:
+        d_kind = Unknown;
+        return false;
+    }
+    i++;
+    if( i >= len || !( digitClass(str[i]) & AnyDigit ) )
+    {
+        d_kind = Unknown;
+        return false;
+    }
+    quint8 seen = 0; // union of the classes of all digits
+    quint8 valid = allowed;
+    int digits = 0;
+    while( i < len )
+    {
+        const quint8 c = digitClass(str[i]);
+        if( c & AnyDigit )
+        {
+            seen |= c;
+            valid &= ( c & allowed ) ? 0xff : 0;
+            digits++;
+        }else if( str[i] != '_' )
+            break;
+        i++;
+    }
+    // a based decimal may only consist of a single x or z digit
+    if( d_kind == Decimal && ( seen & XzDigit ) && digits != 1 )
+        valid = 0;
+    d_off = i;
+    d_signed = sign;
+    d_hasSize = true;
+    d_hasBaseFormat = true;
+    d_hasValue = true;
+    d_validity = valid ? Valid : Invalid;
+    d_width = num > 0xffffffff ? 0xffffffff : quint32(num);
+    return true;
+}
+
 const char*NumLex::getKindName() const
 {
     switch(d_kind)
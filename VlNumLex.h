@@ -29,10 +29,16 @@ namespace Vl
     {
     public:
         enum Kind { Unknown, Real, Decimal, Octal, Binary, Hex };
+        enum Validity { Unchecked, Valid, Invalid };
 
         NumLex( const QByteArray&, int start = 0 );
         const QString& getError() const { return d_error; }
         bool parse(bool fullValidation = false);
+        // Like parse(), but additionally validates the number as parse(true) would do with the text of the
+        // number only; plain decimal and sized based numbers take a fast path which doesn't fill getVal/getSize
+        bool lex();
+        Validity getValidity() const { return (Validity)d_validity; }
+        quint32 getWidth() const { return d_width; } // the size as a number; 0 if none or invalid
         int getOff() const { return d_off; }
         Kind getKind() const { return (Kind)d_kind; }
         const char* getKindName() const;
@@ -51,6 +57,7 @@ namespace Vl
         bool extendedDigit(char);
         bool unsignedNumber(bool allowHex = false);
         bool real();
+        bool lexFast();
         bool error( const QString& );
     private:
         QString d_error;
@@ -60,6 +67,8 @@ namespace Vl
         const int d_start;
         int d_off;
         quint8 d_kind;
+        quint8 d_validity;
+        quint32 d_width;
         bool d_signed;
         bool d_hasSize;
         bool d_hasBaseFormat;
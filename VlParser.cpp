@@ -46,7 +46,18 @@ void Parser::SemErr(const char* msg) {
 	errDist = 0;
 }
 
+void Parser::FlushTopLevel(bool all) {
+	// Only the last child of d_root can still be under construction; all previous ones are complete
+	const int n = d_root.d_children.size() - ( all ? 0 : 1 );
+	for( int i = 0; i < n; i++ )
+		d_sink->onTopLevel( d_root.d_children[i] );
+	if( n > 0 )
+		d_root.d_children.erase( d_root.d_children.begin(), d_root.d_children.begin() + n );
+}
+
 void Parser::Get() {
+	if( d_sink && d_root.d_children.size() > 1 )
+		FlushTopLevel(false);
 	for (;;) {
 		d_cur = d_next;
 		d_next = scanner->nextToken();
@@ -6058,6 +6069,7 @@ Parser::Parser(Vl::PpLexer *scanner, Vl::Errors* err) {
 
 	ParserInitCaller<Parser>::CallInit(this);
 	la = &d_dummy;
+	d_sink = 0;
 	minErrDist = 2;
 	errDist = minErrDist;
 	this->scanner = scanner;
@@ -6130,10 +6142,20 @@ Parser::~Parser() {
 }
 
 void Parser::SynErr(const QString& sourcePath, int line, int col, int n, Vl::Errors* err, const char* ctx, const QString& str ) {
-	QString s;
-	QString ctxStr;
-	if( ctx )
-		ctxStr = QString( " in %1" ).arg(ctx);
+    if( err && str.isEmpty() && n > 0 && n <= Vl::TT_Max )
+    {
+        // the common case; the message text is only formatted if ever displayed
+        const char* tok = Vl::tokenToString(n);
+        err->error(Vl::Errors::Syntax, sourcePath, line, col,
+                   n < Vl::TT_Specials ? Vl::Errors::Msg_LiteralExpected : Vl::Errors::Msg_TokenExpected,
+                   QByteArray::fromRawData( tok, int(::strlen(tok)) ),
+                   ctx ? QByteArray::fromRawData( ctx, int(::strlen(ctx)) ) : QByteArray() );
+        return;
+    }
+    QString s;
+    QString ctxStr;
+    if( ctx )
+        ctxStr = QString( " in %1" ).arg(ctx);
     if( n == 0 )
         s = QString("EOF expected%1").arg(ctxStr);
     else if( n < Vl::TT_Specials )
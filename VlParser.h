@@ -14,6 +14,14 @@ namespace Vl {
 
 
 
+class ParserSink
+{
+public:
+	virtual ~ParserSink() {}
+	// Receives each top level production as soon as it is complete and takes ownership of it
+	virtual void onTopLevel( Vl::SynTree* ) = 0;
+};
+
 class Parser {
 private:
 	enum {
@@ -288,6 +296,7 @@ private:
 	bool StartOf(int s);
 	void ExpectWeak(int n, int follow);
 	bool WeakSeparator(int n, int syFol, int repFol);
+	void FlushTopLevel(bool all);
     void SynErr(const QString& sourcePath, int line, int col, int n, Vl::Errors* err, const char* ctx, const QString& = QString() );
 
 public:
@@ -303,6 +312,7 @@ public:
 	TokDummy d_dummy;
 	TokDummy *la;			// lookahead token
 	QList<Vl::Token> d_sections;
+	ParserSink* d_sink; // if set d_root only holds the top level production under construction
 	
 	int peek( quint8 la = 1 );
 
@@ -311,7 +321,10 @@ public:
         d_stack.push(&d_root);
         Parse();
         d_stack.pop();
+        if( d_sink )
+            FlushTopLevel(true);
     }
+    void setSink( ParserSink* s ) { d_sink = s; }
     
 Vl::SynTree d_root;
 	QStack<Vl::SynTree*> d_stack;
@@ -24,21 +24,26 @@
 #include "VlPpSymbols.h"
 #include "VlIncludes.h"
 #include "VlFileCache.h"
+#include "VlAtoms.h"
+#include "VlTrace.h"
+#include "VlTokenTable.h"
 #include <QIODevice>
 #include <QtDebug>
 #include <QBuffer>
 #include <QFileInfo>
 #include <QDir>
+#include <QAtomicInt>
 using namespace Vl;
 
 PpLexer::PpLexer(QObject *parent) :
     QObject(parent), d_lastT(Tok_Invalid), d_err(0), d_syms(0), d_ignoreComments(true),
     d_ignoreAttrs(true), d_ignoreHidden(true), d_packAttributes(true), d_packComments(true),
-    d_filePathMode(false), d_incs(0),d_fcache(0),d_sendMacroUsage(false),d_supportSvExt(false)
+    d_filePathMode(false), d_incs(0),d_fcache(0),d_sendMacroUsage(false),d_supportSvExt(false),
+    d_cancel(0),d_toks(0),d_macroDeps(0),d_missing(0)
 {
 }
 
-bool PpLexer::setStream(QIODevice* in, const QString& sourcePath, bool reportError)
+bool PpLexer::setStream(QIODevice* in, const QString& sourcePath, bool reportError, quint32 firstLine)
 {
     if( in == 0 )
         return setStream( sourcePath, reportError );
@@ -47,6 +52,7 @@ bool PpLexer::setStream(QIODevice* in, const QString& sourcePath, bool reportErr
         InputCtx ctx;
         ctx.d_in = in;
         ctx.d_sourcePath = sourcePath;
+        ctx.d_lineNr = firstLine - 1;
         d_source.push(ctx);
         if( d_fcache != 0 && d_source.size() == 1 )
         {
@@ -214,6 +220,16 @@ int PpLexer::getLastColNr() const
 }
 
 Token PpLexer::nextTokenImp()
+{
+    // every token read from a source passes here exactly once, also comments and hidden tokens
+    const bool mainSource = d_toks != 0 && d_source.size() == 1;
+    Token t = lexToken();
+    if( mainSource && t.d_type != Tok_Eof )
+        d_toks->append( t, !txOn() );
+    return t;
+}
+
+Token PpLexer::lexToken()
 {
     if( d_source.isEmpty() )
         return d_lastT; // Token(Tok_Eof);
@@ -221,6 +237,8 @@ Token PpLexer::nextTokenImp()
 	skipWhiteSpace();
     while( d_source.top().d_colNr >= d_source.top().d_line.size() )
 	{
+        if( d_cancel && *d_cancel )
+            return cancel();
         if( d_source.top().d_in->atEnd() )
         {
             Token t = token( Tok_Eof, 0 );
@@ -316,6 +334,8 @@ Token PpLexer::nextTokenPp()
         {
             if( t.isEof() && !d_source.isEmpty() )
                 t = nextTokenImp();
+            if( t.isEof() && d_source.isEmpty() )
+                return t; // also inside an inactive `ifdef, e.g. after cancel() or a missing `endif
 
             const bool on = txOn();
             t.d_hidden = !on;
@@ -372,6 +392,9 @@ Token PpLexer::processDirective(const Token& tok )
         Token t = nextTokenImp();
         if( t.d_type != Tok_Ident )
             return error("expecting identifier after `undef");
+        useMacro( t.d_val );
+        if( d_macroDeps )
+            d_ownMacros.insert( t.d_val );
         if( d_syms && !d_syms->contains(t.d_val) )
             warning( tr("unknown macro '%1'").arg(t.d_val.data()));
         else if( d_syms )
@@ -399,20 +422,35 @@ Token PpLexer::processDirective(const Token& tok )
 
 Token PpLexer::processInclude()
 {
+    VL_TRACE_FILE( "PpLexer::processInclude", d_source.top().d_sourcePath );
     Token t = nextTokenImp();
     if( t.d_type != Tok_Str )
         return error( "expecting filename string after include directive" );
     const QString path = QString::fromLatin1(t.d_val);
     QFileInfo inc( path );
+    QStringList candidates;
     if( inc.filePath().isEmpty() || inc.isRelative() )
     {
         // no or relative path
         // try in the same directory as the current soruce
-        if( !setStream( QFileInfo( d_source.top().d_sourcePath ).dir().absoluteFilePath(path), false ) && d_incs != 0 )
-            setStream( d_incs->findPath(path), true );
-    }else
+        const QString local = QFileInfo( d_source.top().d_sourcePath ).dir().absoluteFilePath(path);
+        if( !setStream( local, false ) )
+        {
+            if( d_incs == 0 )
+                candidates << local;
+            else if( !setStream( d_incs->findPath(path), true ) )
+                candidates << local << d_incs->candidatePaths(path);
+        }
+    }else if( !setStream( path, true ) )
         // absolute path
-        setStream( path, true );
+        candidates << path;
+    if( d_missing )
+    {
+        // the include would be found if one of them was created
+        foreach( const QString& c, candidates )
+            if( !QFileInfo(c).exists() )
+                d_missing->append( c );
+    }
     return nextTokenImp();
 }
 
@@ -493,6 +531,8 @@ Token PpLexer::processDefine()
         if( t.d_type == Tok_Invalid )
             return error( tr("invalid token in macro text '%1'").arg(def.d_name.data()) );
     }
+    if( d_macroDeps )
+        d_ownMacros.insert( def.d_name );
     if( d_syms )
         d_syms->addSymbol( def );
 
@@ -541,6 +581,7 @@ Token PpLexer::processCondition(Directive d)
         Token t = nextTokenImp();
         if( t.d_type != Tok_Ident )
             return error("expecting identifier after `ifdef");
+        useMacro( t.d_val );
         const bool tx = ( d_ifState.isEmpty() || d_ifState.top().second ) &&
                 d_syms != 0 && d_syms->contains(t.d_val);
         d_ifState.push( qMakePair(quint8(tx ? IfActive : InIf),tx) );
@@ -554,6 +595,7 @@ Token PpLexer::processCondition(Directive d)
         Token t = nextTokenImp();
         if( t.d_type != Tok_Ident )
             return error("expecting identifier after `ifndef");
+        useMacro( t.d_val );
         const bool tx = ( d_ifState.isEmpty() || d_ifState.top().second ) &&
                 d_syms != 0 && !d_syms->contains(t.d_val);
         d_ifState.push( qMakePair(quint8(tx ? IfActive : InIf),tx) );
@@ -571,6 +613,7 @@ Token PpLexer::processCondition(Directive d)
             Token t = nextTokenImp();
             if( t.d_type != Tok_Ident )
                 return error("expecting identifier after `elsif");
+            useMacro( t.d_val );
             const bool tx = ( d_ifState.size() == 1 || d_ifState[d_ifState.size()-2].second ) &&
                     d_ifState.top().first != IfActive && d_syms != 0 && d_syms->contains(t.d_val);
             d_ifState.top().second = tx;
@@ -728,6 +771,7 @@ bool PpLexer::resolveAllMacroUses(const Token& codi,const QByteArray& topMacroId
                     return false;
                 }
                 PpSymbols::Define macroDef;
+                useMacro( macroId );
                 if( d_syms == 0 || !d_syms->contains(macroId) )
                 {
                     throw error( tr("unknown text macro '%1'").arg(macroId.data()), codi );
@@ -765,8 +809,10 @@ bool PpLexer::resolveAllMacroUses(const Token& codi,const QByteArray& topMacroId
 
 Token PpLexer::processMacroUse(const Token& curTok)
 {
+    VL_TRACE_FILE( "PpLexer::processMacroUse", curTok.d_sourcePath );
     const QByteArray makroId = curTok.d_val;
     PpSymbols::Define makroDef;
+    useMacro( makroId );
     if( d_syms == 0 || !d_syms->contains(makroId) )
     {
         return error( tr("unknown text macro '%1'").arg(makroId.data()), curTok );
@@ -866,6 +912,21 @@ char PpLexer::nextAfterSpace(quint32 off) const
     return 0;
 }
 
+Token PpLexer::cancel()
+{
+    // Cooperative cancellation point, checked once per line; closes all open sources including the
+    // include stack so the parser sees Tok_Eof right away and unwinds.
+    Token t = token( Tok_Eof, 0 );
+    while( !d_source.isEmpty() )
+    {
+        if( d_source.top().d_in->parent() == this )
+            d_source.top().d_in->deleteLater();
+        d_source.pop();
+    }
+    d_ifState.clear();
+    return t;
+}
+
 Token PpLexer::token(TokenType tt, int len, const QByteArray& val)
 {
     Q_ASSERT( !d_source.isEmpty() );
@@ -956,7 +1017,8 @@ Token PpLexer::ident()
 		else
 			off++;
 	}
-    const QByteArray str = d_source.top().d_line.mid(d_source.top().d_colNr, off );
+    const char* start = d_source.top().d_line.constData() + d_source.top().d_colNr;
+    const QByteArray str = QByteArray::fromRawData( start, off ); // no copy; only valid as long as d_line
     Q_ASSERT( !str.isEmpty() );
     TokenType tt = Tok_Invalid;
     if( str[0] != '`' )
@@ -968,16 +1030,16 @@ Token PpLexer::ident()
         if( tt == Tok_library || tt == Tok_include )
             d_filePathMode = true;
         if( Tok_PATHPULSE_dlr )
-            return token( tt, off, str );
+            return token( tt, off, QByteArray( start, off ) );
         else
             return token( tt, off );
     }
     else if( str[0] == '$' )
-        return token( Tok_SysName, off, str.mid(1) );
+        return token( Tok_SysName, off, QByteArray( start + 1, off - 1 ) );
     else if( str[0] == '`' )
-        return token( Tok_CoDi, off, str.mid(1) );
+        return token( Tok_CoDi, off, QByteArray( start + 1, off - 1 ) );
     else
-        return token( Tok_Ident, off, str );
+        return token( Tok_Ident, off, Atoms::intern( start, off ) );
 }
 
 Token PpLexer::extident()
@@ -992,7 +1054,7 @@ Token PpLexer::extident()
         else
             off++;
     }
-    const QByteArray str = d_source.top().d_line.mid(d_source.top().d_colNr + 1, off - 1 );
+    const QByteArray str = Atoms::intern( d_source.top().d_line.constData() + d_source.top().d_colNr + 1, off - 1 );
     return token( Tok_Ident, off, str );
 }
 
@@ -1013,20 +1075,25 @@ Token PpLexer::pathident()
         else
             off++;
     }
-    const QByteArray str = d_source.top().d_line.mid(d_source.top().d_colNr, off );
+    const QByteArray str = Atoms::intern( d_source.top().d_line.constData() + d_source.top().d_colNr, off );
     return token( Tok_Ident, off, str );
 }
 
 Token PpLexer::numeric()
 {
     NumLex np( d_source.top().d_line, d_source.top().d_colNr );
-	if( !np.parse() )
+	if( !np.lex() )
 	{
         return token( Tok_Invalid, np.getOff(), np.getError().toUtf8() );
     }else
     {
         // qDebug() << "### Parsed" << np.getKindName() << np.getSize() << np.getVal();
-        return token( np.getTokenType(), np.getOff(), d_source.top().d_line.mid( d_source.top().d_colNr, np.getOff() ) );
+        Token t = token( np.getTokenType(), np.getOff(), d_source.top().d_line.mid( d_source.top().d_colNr, np.getOff() ) );
+        t.d_numKind = np.getKind();
+        t.d_numSigned = np.getSigned();
+        t.d_numValidity = np.getValidity();
+        t.d_numWidth = np.getWidth();
+        return t;
     }
 }
 
@@ -1142,6 +1209,13 @@ void PpLexer::warning(const QString& msg)
         d_err->warning(Errors::Lexer, d_lastT.d_sourcePath, d_lastT.d_lineNr, d_lastT.d_colNr, msg );
 }
 
+void PpLexer::useMacro(const QByteArray& name)
+{
+    if( d_macroDeps == 0 || d_ownMacros.contains(name) || d_macroDeps->contains(name) )
+        return;
+    d_macroDeps->insert( name, d_syms ? d_syms->getHash(name) : 0 );
+}
+
 bool PpLexer::txOn() const
 {
     return d_syms == 0 || d_ifState.isEmpty() || d_ifState.top().second;
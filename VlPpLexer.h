@@ -23,9 +23,11 @@
 #include <QObject>
 #include <QVariant>
 #include <QStack>
+#include <QSet>
 #include <Verilog/VlToken.h>
 
 class QIODevice;
+class QAtomicInt;
 
 namespace Vl
 {
@@ -33,6 +35,7 @@ namespace Vl
     class PpSymbols;
     class Includes;
     class FileCache;
+    class TokenTable;
 
     class PpLexer : public QObject
 	{
@@ -40,6 +43,7 @@ namespace Vl
 	public:
         typedef QList<quint32> IfDefOutList; // Jeder Eintrag ist die Zeile der Änderung. Start bei On.
         typedef QMap<QString,IfDefOutList> IfDefOutLists;
+        typedef QMap<QByteArray,quint64> MacroDeps; // macro -> PpSymbols::getHash when first referenced
 
 		explicit PpLexer(QObject *parent = 0);
 
@@ -54,8 +58,14 @@ namespace Vl
         void setSyms(PpSymbols* p) { d_syms = p; }
         void setIncs(Includes* p) { d_incs = p; }
         void setCache(FileCache* p) { d_fcache = p; }
+        void setCancel(const QAtomicInt* p) { d_cancel = p; } // when set to non-zero the lexer delivers Tok_Eof
+        void setTokenTable(TokenTable* p) { d_toks = p; } // records the raw tokens of the main source
+        // Records what the result depends on besides the sources read: the macros referred to before the sources
+        // define them, and the paths of includes which were not found
+        void setDeps(MacroDeps* macros, QStringList* missing) { d_macroDeps = macros; d_missing = missing; }
 
-        bool setStream( QIODevice* in, const QString& sourcePath, bool reportError = false );
+        bool setStream( QIODevice* in, const QString& sourcePath, bool reportError = false,
+                        quint32 firstLine = 1 ); // in may be a fragment of sourcePath starting at firstLine
         bool setStream(const QString& sourcePath , bool reportError);
 
 		Token nextToken();
@@ -80,6 +90,7 @@ namespace Vl
 
     protected:
         Token nextTokenImp();
+        Token lexToken();
         Token nextTokenPp();
         Token processDirective(const Token& tok);
         Token processInclude();
@@ -91,6 +102,7 @@ namespace Vl
         bool resolveAllMacroUses(const Token& codi, const QByteArray& topId, TokenList& text );
         Token processMacroUse(const Token& tok);
         void nextLine();
+        Token cancel();
 		void skipWhiteSpace();
 		char lookAhead( quint32 ) const;
         char nextAfterSpace( quint32 ) const;
@@ -107,6 +119,7 @@ namespace Vl
         void warning( const QString& );
         bool txOn() const;
         void txlog(quint32 line);
+        void useMacro( const QByteArray& );
     private:
         Q_DISABLE_COPY(PpLexer)
         struct InputCtx
@@ -128,6 +141,11 @@ namespace Vl
         PpSymbols* d_syms;
         Includes* d_incs;
         FileCache* d_fcache;
+        const QAtomicInt* d_cancel;
+        TokenTable* d_toks;
+        MacroDeps* d_macroDeps;
+        QStringList* d_missing;
+        QSet<QByteArray> d_ownMacros; // defined or undefined by the sources themselves
         enum IfState { InIf, IfActive, InElse };
         QStack< QPair<quint8,bool> > d_ifState; // ifState, txOn
         IfDefOutLists d_idols;
@@ -18,6 +18,7 @@
 */
 
 #include "VlPpSymbols.h"
+#include "VlHash.h"
 #include <QtDebug>
 using namespace Vl;
 
@@ -65,11 +66,48 @@ const PpSymbols::Define PpSymbols::getSymbol(const QByteArray& id)
     return d;
 }
 
+quint64 PpSymbols::getHash(const QByteArray& id) const
+{
+    d_lock.lockForRead();
+    Defines::const_iterator i = d_defs.find(id);
+    QByteArray text;
+    const bool found = i != d_defs.end();
+    if( found )
+    {
+        // only what the expansion depends on, not where the macro was defined
+        foreach( const QByteArray& arg, i.value().d_args )
+        {
+            text += arg;
+            text += ',';
+        }
+        foreach( const Token& t, i.value().d_toks )
+        {
+            text += char(0);
+            text += QByteArray::number( t.d_type );
+            text += ' ';
+            text += t.d_val;
+        }
+    }
+    d_lock.unlock();
+    if( !found )
+        return 0;
+    const quint64 res = Hash::xx64( text );
+    return res != 0 ? res : 1;
+}
+
 QByteArrayList PpSymbols::getNames() const
 {
     return d_defs.keys();
 }
 
+PpSymbols::Defines PpSymbols::getDefines() const
+{
+    d_lock.lockForRead();
+    const Defines res = d_defs;
+    d_lock.unlock();
+    return res;
+}
+
 bool PpSymbols::contains(const QByteArray& id) const
 {
     d_lock.lockForRead();
@@ -78,6 +116,14 @@ bool PpSymbols::contains(const QByteArray& id) const
     return res;
 }
 
+int PpSymbols::getCount() const
+{
+    d_lock.lockForRead();
+    const int res = d_defs.size();
+    d_lock.unlock();
+    return res;
+}
+
 void PpSymbols::remove(const QByteArray& id)
 {
     d_lock.lockForWrite();
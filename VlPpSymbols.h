@@ -50,9 +50,12 @@ namespace Vl
         void addSymbol(const QByteArray&, const QByteArray&, TokenType type );
 
         const Define getSymbol( const QByteArray& id );
+        quint64 getHash( const QByteArray& id ) const; // of the definition, 0 if not defined
         QByteArrayList getNames() const;
+        Defines getDefines() const; // a snapshot
 
         bool contains( const QByteArray& id ) const;
+        int getCount() const;
         void remove( const QByteArray& id );
         void clear();
     private:
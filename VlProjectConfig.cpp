@@ -194,7 +194,9 @@ void ProjectConfig::setup(CrossRefModel* mdl, bool synchronous)
         mdl->getFcache()->setSvSuffix(d_config["SVEXT"]);
         mdl->getFcache()->setSupportSvExt(d_config["CONFIG"].contains("UseSvExtension") );
     }
-    mdl->updateFiles( d_srcFiles + d_libFiles, synchronous );
+    mdl->setTopModule( getTopMod().toUtf8() );
+    mdl->updateFiles( d_srcFiles, false, CrossRefModel::PrioProject );
+    mdl->updateFiles( d_libFiles, synchronous, CrossRefModel::PrioLibrary );
 }
 
 static void filterFiles( QStringList& in, QSet<QString>& out, QSet<QString>& filter )
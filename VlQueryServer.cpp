@@ -0,0 +1,378 @@
+/*
+* Copyright 2018-2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Verilog parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "VlQueryServer.h"
+#include "VlFileCache.h"
+#include "VlSynTree.h"
+#include "VlElaborator.h"
+#include <QLocalServer>
+#include <QLocalSocket>
+#include <QJsonDocument>
+#include <QJsonArray>
+#include <QFileInfo>
+using namespace Vl;
+
+QueryServer::QueryServer(CrossRefModel* mdl, QObject *parent) : QObject(parent),d_mdl(mdl)
+{
+    Q_ASSERT( mdl != 0 );
+    d_elab = new Elaborator(mdl,this);
+    d_server = new QLocalServer(this);
+    connect( d_server, SIGNAL(newConnection()), this, SLOT(onNewConnection()) );
+}
+
+QueryServer::~QueryServer()
+{
+    d_server->close();
+}
+
+bool QueryServer::listen(const QString& name)
+{
+    if( d_server->listen( name ) )
+        return true;
+    // a server which crashed leaves the socket file behind; only remove it if nobody answers
+    QLocalSocket probe;
+    probe.connectToServer( name );
+    if( probe.waitForConnected( 1000 ) )
+    {
+        probe.disconnectFromServer();
+        d_error = tr("a server is already running on '%1'").arg( name );
+        return false;
+    }
+    if( probe.error() != QLocalSocket::ConnectionRefusedError &&
+            probe.error() != QLocalSocket::ServerNotFoundError )
+    {
+        d_error = d_server->errorString();
+        return false;
+    }
+    QLocalServer::removeServer( name );
+    if( d_server->listen( name ) )
+        return true;
+    d_error = d_server->errorString();
+    return false;
+}
+
+QString QueryServer::getServerName() const
+{
+    return d_server->fullServerName();
+}
+
+void QueryServer::onNewConnection()
+{
+    while( d_server->hasPendingConnections() )
+    {
+        QLocalSocket* s = d_server->nextPendingConnection();
+        connect( s, SIGNAL(readyRead()), this, SLOT(onReadyRead()) );
+        connect( s, SIGNAL(disconnected()), this, SLOT(onDisconnected()) );
+    }
+}
+
+void QueryServer::onReadyRead()
+{
+    QLocalSocket* s = static_cast<QLocalSocket*>( sender() );
+    while( s->canReadLine() )
+    {
+        const QByteArray line = s->readLine().trimmed();
+        if( line.isEmpty() )
+            continue;
+        QJsonParseError err;
+        const QJsonDocument doc = QJsonDocument::fromJson( line, &err );
+        QJsonObject res;
+        if( !doc.isObject() )
+        {
+            res["ok"] = false;
+            res["error"] = QString("invalid request: %1").arg(err.errorString());
+        }else
+            res = handle( doc.object() );
+        s->write( QJsonDocument(res).toJson(QJsonDocument::Compact) );
+        s->write( "\n" );
+        if( res.value("shutdown").toBool() )
+        {
+            s->flush();
+            emit sigShutdown();
+        }
+    }
+}
+
+void QueryServer::onDisconnected()
+{
+    sender()->deleteLater();
+}
+
+QJsonObject QueryServer::location(const Token& t)
+{
+    QJsonObject res;
+    res["name"] = QString::fromUtf8( t.d_val );
+    res["file"] = t.d_sourcePath;
+    res["line"] = int(t.d_lineNr);
+    res["col"] = int(t.d_colNr);
+    res["len"] = int(t.d_len);
+    return res;
+}
+
+QJsonObject QueryServer::symLocation(const CrossRefModel::Symbol* sym) const
+{
+    // the symbols of reused chunks keep the lines of their first parse
+    return location( d_mdl->currentTok( sym->tok() ) );
+}
+
+QJsonObject QueryServer::symbolAt(const QJsonObject& req, CrossRefModel::TreePath& path) const
+{
+    const QString file = QFileInfo( req.value("file").toString() ).absoluteFilePath();
+    path = d_mdl->findSymbolBySourcePos( file, req.value("line").toInt(), req.value("col").toInt() );
+    if( path.isEmpty() )
+        return QJsonObject();
+    return symLocation( path.first().constData() );
+}
+
+QJsonObject QueryServer::handle(const QJsonObject& req)
+{
+    const QString cmd = req.value("cmd").toString();
+    QJsonObject res;
+    if( req.contains("id") )
+        res["id"] = req.value("id");
+    res["ok"] = true;
+
+    if( cmd == "decl" )
+    {
+        CrossRefModel::TreePath path;
+        symbolAt( req, path );
+        CrossRefModel::IdentDeclRef decl;
+        if( !path.isEmpty() )
+            decl = d_mdl->findDeclarationOfSymbol( path.first().data() );
+        res["result"] = decl.constData() ? QJsonValue( symLocation( decl.constData() ) ) : QJsonValue();
+    }else if( cmd == "refs" )
+    {
+        CrossRefModel::TreePath path;
+        symbolAt( req, path );
+        QJsonArray refs;
+        if( !path.isEmpty() )
+        {
+            CrossRefModel::IdentDeclRef decl = d_mdl->findDeclarationOfSymbol( path.first().data() );
+            const CrossRefModel::Symbol* sym = decl.constData() ? decl.constData() : path.first().constData();
+            foreach( const CrossRefModel::SymRef& ref, d_mdl->findAllReferencingSymbols( sym ) )
+                refs.append( symLocation( ref.constData() ) );
+        }
+        res["result"] = refs;
+    }else if( cmd == "symbol" )
+    {
+        CrossRefModel::TreePath path;
+        QJsonObject sym = symbolAt( req, path );
+        if( !path.isEmpty() )
+        {
+            sym["type"] = QLatin1String( path.first()->getTypeName() );
+            sym["qualified"] = CrossRefModel::qualifiedName( path );
+            res["result"] = sym;
+        }else
+            res["result"] = QJsonValue();
+    }else if( cmd == "token" )
+    {
+        const Token t = d_mdl->findTokenBySourcePos( QFileInfo( req.value("file").toString() ).absoluteFilePath(),
+                                                     req.value("line").toInt(), req.value("col").toInt() );
+        if( t.d_type != Tok_Invalid )
+        {
+            QJsonObject tok = location( t );
+            tok["type"] = QLatin1String( tokenName( t.d_type ) );
+            res["result"] = tok;
+        }else
+            res["result"] = QJsonValue();
+    }else if( cmd == "tokens" )
+    {
+        // without lexing if the model keeps the tokens
+        QJsonArray toks;
+        foreach( const Token& t, d_mdl->getTokens( QFileInfo( req.value("file").toString() ).absoluteFilePath(),
+                                                   req.value("from").toInt(), req.value("to").toInt() ) )
+        {
+            QJsonObject tok = location( t );
+            tok["type"] = QLatin1String( tokenName( t.d_type ) );
+            if( t.d_hidden )
+                tok["hidden"] = true;
+            toks.append( tok );
+        }
+        res["result"] = toks;
+    }else if( cmd == "semantic" )
+    {
+        // flat like LSP semantic tokens: line, col, len, class, declKind, isDecl for each symbol;
+        // "kinds" maps the declKinds to their names
+        const CrossRefModel::SemanticTokens toks =
+                d_mdl->getSemanticTokens( QFileInfo( req.value("file").toString() ).absoluteFilePath() );
+        QJsonArray data;
+        QJsonObject kinds;
+        foreach( const CrossRefModel::SemanticToken& t, toks )
+        {
+            data.append( int(t.d_lineNr) );
+            data.append( int(t.d_colNr) );
+            data.append( int(t.d_len) );
+            data.append( int(t.d_class) );
+            data.append( int(t.d_declKind) );
+            data.append( t.d_isDecl ? 1 : 0 );
+            if( t.d_declKind != 0 )
+                kinds[ QString::number(t.d_declKind) ] = QLatin1String( SynTree::rToStr( t.d_declKind ) );
+        }
+        QJsonObject r;
+        r["data"] = data;
+        r["kinds"] = kinds;
+        res["result"] = r;
+    }else if( cmd == "batch" )
+    {
+        // symbol and decl for many positions in one go
+        QList<CrossRefModel::SourcePos> poss;
+        foreach( const QJsonValue& v, req.value("queries").toArray() )
+        {
+            const QJsonObject q = v.toObject();
+            poss.append( CrossRefModel::SourcePos( QFileInfo( q.value("file").toString() ).absoluteFilePath(),
+                                                   q.value("line").toInt(), q.value("col").toInt() ) );
+        }
+        QJsonArray hits;
+        foreach( const CrossRefModel::PosHit& hit, d_mdl->findSymbolsBySourcePos( poss ) )
+        {
+            QJsonObject h;
+            if( !hit.d_path.isEmpty() )
+            {
+                QJsonObject sym = symLocation( hit.d_path.first().constData() );
+                sym["type"] = QLatin1String( hit.d_path.first()->getTypeName() );
+                sym["qualified"] = CrossRefModel::qualifiedName( hit.d_path );
+                h["symbol"] = sym;
+            }else
+                h["symbol"] = QJsonValue();
+            h["decl"] = hit.d_decl.constData() ? QJsonValue( symLocation( hit.d_decl.constData() ) ) : QJsonValue();
+            hits.append( h );
+        }
+        res["result"] = hits;
+    }else if( cmd == "complete" )
+    {
+        // names visible at the position, best matches of prefix first; fuzzy unless "exact" is true
+        const CrossRefModel::IdentDeclRefList ids = d_mdl->findCompletionsAtSourcePos(
+                    QFileInfo( req.value("file").toString() ).absoluteFilePath(),
+                    req.value("line").toInt(), req.value("col").toInt(), req.value("prefix").toString().toUtf8(),
+                    req.value("max").toInt(20), !req.value("exact").toBool() );
+        QJsonArray names;
+        foreach( const CrossRefModel::IdentDeclRef& id, ids )
+        {
+            QJsonObject n = symLocation( id.constData() );
+            if( id->decl() )
+                n["kind"] = QLatin1String( SynTree::rToStr( id->decl()->tok().d_type ) );
+            names.append( n );
+        }
+        res["result"] = names;
+    }else if( cmd == "search" )
+    {
+        // declared names in all files containing pattern, best first; fuzzy also finds similar names
+        QJsonArray names;
+        foreach( const CrossRefModel::IdentDeclRef& id, d_mdl->findNames( req.value("pattern").toString().toUtf8(),
+                                                                          req.value("max").toInt(100),
+                                                                          req.value("fuzzy").toBool() ) )
+        {
+            QJsonObject n = symLocation( id.constData() );
+            if( id->decl() )
+                n["kind"] = QLatin1String( SynTree::rToStr( id->decl()->tok().d_type ) );
+            names.append( n );
+        }
+        res["result"] = names;
+    }else if( cmd == "globals" )
+    {
+        QString file = req.value("file").toString();
+        if( !file.isEmpty() )
+            file = QFileInfo(file).absoluteFilePath();
+        QJsonArray names;
+        foreach( const CrossRefModel::IdentDeclRef& id, d_mdl->getGlobalNames( file ) )
+            names.append( symLocation( id.constData() ) );
+        res["result"] = names;
+    }else if( cmd == "changed" )
+    {
+        // saved files; the model reparses them in the background, queries see the old state until then
+        QStringList files;
+        foreach( const QJsonValue& v, req.value("files").toArray() )
+            files.append( QFileInfo( v.toString() ).absoluteFilePath() );
+        if( req.contains("file") )
+            files.append( QFileInfo( req.value("file").toString() ).absoluteFilePath() );
+        if( d_mdl->getFcache() )
+        {
+            foreach( const QString& f, files )
+                d_mdl->getFcache()->removeFile( f );
+        }
+        d_mdl->updateFiles( files, false, CrossRefModel::PrioActive );
+        res["result"] = files.size();
+    }else if( cmd == "edit" )
+    {
+        // unsaved editor content replaces the file on disk until the next "changed"
+        const QString file = QFileInfo( req.value("file").toString() ).absoluteFilePath();
+        if( d_mdl->getFcache() == 0 )
+        {
+            res["ok"] = false;
+            res["error"] = QLatin1String("the server has no file cache");
+        }else
+        {
+            d_mdl->getFcache()->addFile( file, req.value("text").toString().toUtf8() );
+            d_mdl->updateFiles( QStringList() << file, false, CrossRefModel::PrioActive );
+        }
+    }else if( cmd == "params" )
+    {
+        // {"cmd":"params","instance":"top.u1"} or {"cmd":"params","module":"fifo"}
+        // the first part of the path is the top module, which need not be the one of the model
+        const QByteArray path = req.value("instance").toString().toUtf8();
+        const Elaborator::Specialisation spec = !path.isEmpty() ? d_elab->findByInstance( path ) :
+                    d_elab->specialise( req.value("module").toString().toUtf8() );
+        if( !spec.isValid() )
+        {
+            res["ok"] = false;
+            res["error"] = spec.d_error;
+        }else
+        {
+            QJsonObject params;
+            Elaborator::Params::const_iterator i;
+            for( i = spec.d_params.begin(); i != spec.d_params.end(); ++i )
+                params[ QString::fromUtf8( i.key() ) ] = QString::fromUtf8( i.value().toString() );
+            QJsonObject r;
+            r["module"] = QString::fromUtf8( spec.d_module );
+            r["key"] = QString::fromUtf8( spec.d_key );
+            r["params"] = params;
+            if( !spec.d_error.isEmpty() )
+            {
+                r["error"] = spec.d_error;
+                r["errorPos"] = location( spec.d_errorPos );
+            }
+            res["result"] = r;
+        }
+    }else if( cmd == "stats" )
+    {
+        const CrossRefModel::Stats s = d_mdl->getStats();
+        QJsonObject st;
+        st["files"] = s.d_files.size();
+        st["symbols"] = double(s.d_total.d_symbols);
+        st["globalNames"] = double(s.d_globalNames);
+        st["indexEntries"] = double(s.d_indexEntries);
+        st["revIndexEntries"] = double(s.d_revIndexEntries);
+        st["tokenTableBytes"] = double(s.d_tokenTableBytes);
+        st["nameIndexBytes"] = double(s.d_nameIndexBytes);
+        st["errors"] = int(d_mdl->getErrs()->getErrCount());
+        const Elaborator::Stats es = d_elab->getStats();
+        st["specialisations"] = double(es.d_specs);
+        st["specialisationHits"] = double(es.d_hits);
+        st["specialisationMisses"] = double(es.d_misses);
+        res["result"] = st;
+    }else if( cmd == "shutdown" )
+    {
+        res["shutdown"] = true;
+    }else
+    {
+        res["ok"] = false;
+        res["error"] = QString("unknown command '%1'").arg(cmd);
+    }
+    return res;
+}
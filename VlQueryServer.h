@@ -0,0 +1,73 @@
+#ifndef VLQUERYSERVER_H
+#define VLQUERYSERVER_H
+
+/*
+* Copyright 2018-2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Verilog parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QObject>
+#include <QJsonObject>
+#include <Verilog/VlCrossRefModel.h>
+
+class QLocalServer;
+class QLocalSocket;
+
+namespace Vl
+{
+    class Elaborator;
+
+    class QueryServer : public QObject
+    {
+        // Serves queries on a CrossRefModel over a local socket (a Unix domain socket or a named pipe).
+        // Each request is a JSON object on one line, each response as well:
+        //   {"id":1,"cmd":"decl","file":"/a/b.v","line":10,"col":5}
+        //   {"id":1,"ok":true,"result":{"name":"clk","file":"/a/b.v","line":3,"col":12,"len":3}}
+        // Commands: decl, refs, symbol and token (file, line, col), tokens (file, from, to), globals (optional file),
+        // semantic (file), batch (queries, each with file, line, col), complete (file, line, col, prefix, max),
+        // search (pattern, max, fuzzy), changed (files),
+        // edit (file, text; needs a FileCache), params (instance path or module name), stats, shutdown.
+        // Line and col are the ones of Vl::Token.
+        Q_OBJECT
+    public:
+        explicit QueryServer(CrossRefModel*, QObject *parent = 0);
+        ~QueryServer();
+
+        bool listen( const QString& name ); // removes a stale socket of a crashed server
+        QString getError() const { return d_error; }
+        QString getServerName() const;
+
+        QJsonObject handle( const QJsonObject& request ); // also usable without a socket
+    signals:
+        void sigShutdown();
+    protected slots:
+        void onNewConnection();
+        void onReadyRead();
+        void onDisconnected();
+    protected:
+        static QJsonObject location( const Token& );
+        QJsonObject symLocation( const CrossRefModel::Symbol* ) const;
+        QJsonObject symbolAt( const QJsonObject& request, CrossRefModel::TreePath& ) const;
+    private:
+        CrossRefModel* d_mdl;
+        Elaborator* d_elab;
+        QLocalServer* d_server;
+        QString d_error;
+    };
+}
+
+#endif // VLQUERYSERVER_H
@@ -53,13 +53,18 @@ namespace Vl
         uint d_substituted : 1; // Token resultiert aus Auflösung MacroUsage
         uint d_hidden : 1; // Token ist wegen IfDef ausgeblendet und wird nur zur Dokumentation geliefert
         uint d_prePp: 1; // Token dokumentiert MacroUsage vor Auflösung durch Präprozessor
+        // number tokens only; set by the lexer, see NumLex::lex
+        uint d_numKind : 3; // NumLex::Kind
+        uint d_numSigned : 1;
+        uint d_numValidity : 2; // NumLex::Validity
         quint32 d_lineNr;
         quint16 d_colNr, d_len;
+        quint32 d_numWidth; // the size of a sized number, 0 otherwise; uses what would be padding on 64 bit
         QByteArray d_val;
         QString d_sourcePath;
         Token(quint16 t = Tok_Invalid, quint32 line = 0, quint16 col = 0, quint16 len = 0, const QByteArray& val = QByteArray() ):
             d_type(t),d_lineNr(line),d_colNr(col),d_len(len),d_val(val),d_substituted(false),
-            d_hidden(false),d_prePp(false){}
+            d_hidden(false),d_prePp(false),d_numKind(0),d_numSigned(false),d_numValidity(0),d_numWidth(0){}
         bool isValid() const;
         bool isEof() const;
         const char* getName() const;
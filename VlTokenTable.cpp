@@ -0,0 +1,112 @@
+/*
+* Copyright 2018-2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Verilog parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "VlTokenTable.h"
+#include "VlAtoms.h"
+#include <algorithm>
+using namespace Vl;
+
+void TokenTable::append(const Token& t, bool hidden)
+{
+    Entry e;
+    e.d_lineNr = t.d_lineNr;
+    e.d_colNr = t.d_colNr;
+    e.d_len = t.d_len;
+    e.d_type = t.d_type;
+    e.d_hidden = hidden;
+    e.d_atom = 0;
+    switch( t.d_type )
+    {
+    case Tok_Ident:
+        e.d_atom = t.d_val.constData(); // the lexer interns all identifiers
+        break;
+    case Tok_SysName:
+    case Tok_CoDi:
+        e.d_atom = Atoms::intern( t.d_val ).constData();
+        break;
+    default:
+        break;
+    }
+    Q_ASSERT( d_entries.isEmpty() || d_entries.last().d_lineNr < e.d_lineNr ||
+              ( d_entries.last().d_lineNr == e.d_lineNr && d_entries.last().d_colNr <= e.d_colNr ) );
+    d_entries.append( e );
+}
+
+void TokenTable::append(const TokenTable& rhs)
+{
+    Q_ASSERT( d_entries.isEmpty() || rhs.isEmpty() || lastLine() <= rhs.firstLine() );
+    d_entries += rhs.d_entries;
+}
+
+void TokenTable::shiftLines(qint32 delta)
+{
+    if( delta == 0 )
+        return;
+    for( int i = 0; i < d_entries.size(); i++ )
+        d_entries[i].d_lineNr += delta;
+}
+
+int TokenTable::lowerBound(quint32 line) const
+{
+    return std::lower_bound( d_entries.begin(), d_entries.end(), line, lessLine ) - d_entries.begin();
+}
+
+int TokenTable::findIndex(quint32 line, quint16 col) const
+{
+    // the tokens of a line are ordered by column and don't overlap
+    const int from = lowerBound( line );
+    const int to = lowerBound( line + 1 );
+    int lo = from, hi = to;
+    while( lo < hi )
+    {
+        const int mid = ( lo + hi ) / 2;
+        if( d_entries[mid].d_colNr <= col )
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    // lo - 1 is the last token starting at or before col
+    if( lo == from )
+        return -1;
+    const Entry& e = d_entries[lo - 1];
+    if( col < e.d_colNr + e.d_len )
+        return lo - 1;
+    return -1;
+}
+
+Token TokenTable::toToken(int i, const QString& sourcePath) const
+{
+    const Entry& e = d_entries[i];
+    QByteArray val;
+    if( e.d_atom )
+        val = Atoms::intern( e.d_atom, int(qstrlen(e.d_atom)) ); // shares the data of the atom
+    Token t( e.d_type, e.d_lineNr, e.d_colNr, e.d_len, val );
+    t.d_hidden = e.d_hidden;
+    t.d_sourcePath = sourcePath;
+    return t;
+}
+
+QList<Token> TokenTable::tokens(quint32 fromLine, quint32 toLine, const QString& sourcePath) const
+{
+    QList<Token> res;
+    const int to = lowerBound( toLine + 1 );
+    for( int i = lowerBound( fromLine ); i < to; i++ )
+        res.append( toToken( i, sourcePath ) );
+    return res;
+}
@@ -0,0 +1,70 @@
+#ifndef VLTOKENTABLE_H
+#define VLTOKENTABLE_H
+
+/*
+* Copyright 2018-2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Verilog parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QVector>
+#include <Verilog/VlToken.h>
+
+namespace Vl
+{
+    class TokenTable
+    {
+        // this class is reentrant
+        // Compact record of the tokens of one source file in the order they were lexed, including comments,
+        // compiler directives and the tokens of ifdef'ed out sections, but not the tokens of included files or
+        // macro expansions. Position and line range queries are served by binary search without lexing again.
+        // Only identifiers, system names and directives keep their text; the text of keywords and operators
+        // follows from the type, the one of numbers, strings and comments is not kept.
+    public:
+        struct Entry
+        {
+            quint32 d_lineNr;
+            quint16 d_colNr, d_len;
+            quint16 d_type; // TokenType
+            bool d_hidden;
+            const char* d_atom; // see Atoms; 0 if the text is not kept
+        };
+
+        TokenTable() {}
+        void append( const Token&, bool hidden = false ); // must not be in front of the last entry
+        void append( const TokenTable& );
+        void shiftLines( qint32 delta );
+        void clear() { d_entries.clear(); }
+        void squeeze() { d_entries.squeeze(); }
+
+        int size() const { return d_entries.size(); }
+        bool isEmpty() const { return d_entries.isEmpty(); }
+        const Entry& at( int i ) const { return d_entries[i]; }
+        quint32 firstLine() const { return d_entries.isEmpty() ? 0 : d_entries.first().d_lineNr; }
+        quint32 lastLine() const { return d_entries.isEmpty() ? 0 : d_entries.last().d_lineNr; }
+        quint64 byteSize() const { return d_entries.capacity() * sizeof(Entry); }
+
+        int findIndex( quint32 line, quint16 col ) const; // the token covering the position or -1
+        int lowerBound( quint32 line ) const; // the first token on or after line, or size()
+        Token toToken( int i, const QString& sourcePath = QString() ) const;
+        QList<Token> tokens( quint32 fromLine, quint32 toLine, const QString& sourcePath = QString() ) const; // inclusive
+    private:
+        static bool lessLine( const Entry& lhs, quint32 line ) { return lhs.d_lineNr < line; }
+        QVector<Entry> d_entries;
+    };
+}
+
+#endif // VLTOKENTABLE_H
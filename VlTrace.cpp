@@ -0,0 +1,143 @@
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Verilog parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include "VlTrace.h"
+#include <QMutex>
+#include <QFile>
+#include <QHash>
+#include <QThread>
+#include <QElapsedTimer>
+#include <QCoreApplication>
+using namespace Vl;
+
+QAtomicInt Trace::s_enabled;
+
+namespace
+{
+    struct Log
+    {
+        QMutex d_lock;
+        QString d_path;
+        QElapsedTimer d_clock;
+        QList<QByteArray> d_events; // formatted JSON objects
+        QHash<Qt::HANDLE,int> d_threads; // thread handle -> small number shown as tid
+        Log() { d_clock.start(); }
+        ~Log() { write(); }
+        void write()
+        {
+            // called with d_lock held or on exit
+            if( d_path.isEmpty() )
+                return;
+            QFile f( d_path );
+            if( !f.open( QIODevice::WriteOnly ) )
+                return;
+            f.write( "{\"traceEvents\":[\n" );
+            for( int i = 0; i < d_events.size(); i++ )
+            {
+                if( i != 0 )
+                    f.write( ",\n" );
+                f.write( d_events[i] );
+            }
+            f.write( "\n],\"displayTimeUnit\":\"ms\"}\n" );
+        }
+    };
+    Log& log()
+    {
+        static Log s_log;
+        return s_log;
+    }
+}
+
+static QByteArray escaped( const QString& str )
+{
+    QByteArray res = str.toUtf8();
+    res.replace( "\\", "\\\\" );
+    res.replace( "\"", "\\\"" );
+    return res;
+}
+
+void Trace::setOutput(const QString& path)
+{
+    Log& l = log();
+    l.d_lock.lock();
+    l.write();
+    l.d_events.clear();
+    l.d_path = path;
+    s_enabled = !path.isEmpty();
+    l.d_lock.unlock();
+}
+
+QString Trace::getOutput()
+{
+    Log& l = log();
+    l.d_lock.lock();
+    const QString res = l.d_path;
+    l.d_lock.unlock();
+    return res;
+}
+
+void Trace::flush()
+{
+    Log& l = log();
+    l.d_lock.lock();
+    l.write();
+    l.d_lock.unlock();
+}
+
+qint64 Trace::now()
+{
+    return log().d_clock.nsecsElapsed() / 1000;
+}
+
+void Trace::addEvent(const char* name, const QString& file, qint64 start, qint64 end)
+{
+    Log& l = log();
+    l.d_lock.lock();
+    if( !l.d_path.isEmpty() )
+    {
+        const Qt::HANDLE h = QThread::currentThreadId();
+        QHash<Qt::HANDLE,int>::const_iterator i = l.d_threads.find( h );
+        if( i == l.d_threads.end() )
+            i = l.d_threads.insert( h, l.d_threads.size() + 1 );
+        QByteArray ev = "{\"name\":\"" + QByteArray(name) + "\",\"cat\":\"vl\",\"ph\":\"X\",\"ts\":" +
+                QByteArray::number(start) + ",\"dur\":" + QByteArray::number(end - start) +
+                ",\"pid\":" + QByteArray::number(QCoreApplication::applicationPid()) +
+                ",\"tid\":" + QByteArray::number(i.value());
+        if( !file.isEmpty() )
+            ev += ",\"args\":{\"file\":\"" + escaped(file) + "\"}";
+        ev += "}";
+        l.d_events.append( ev );
+    }
+    l.d_lock.unlock();
+}
+
+Trace::Scope::Scope(const char* name, const QString& file):d_name(name),d_start(-1)
+{
+    if( isEnabled() )
+    {
+        d_file = file;
+        d_start = now();
+    }
+}
+
+Trace::Scope::~Scope()
+{
+    if( d_start >= 0 )
+        addEvent( d_name, d_file, d_start, now() );
+}
@@ -0,0 +1,69 @@
+#ifndef VLTRACE_H
+#define VLTRACE_H
+
+/*
+* Copyright 2019 Rochus Keller <mailto:me@rochus-keller.ch>
+*
+* This file is part of the Verilog parser library.
+*
+* The following is the license that applies to this copy of the
+* library. For a license to use the library under conditions
+* other than those described here, please email to me@rochus-keller.ch.
+*
+* GNU General Public License Usage
+* This file may be used under the terms of the GNU General Public
+* License (GPL) versions 2.0 or 3.0 as published by the Free Software
+* Foundation and appearing in the file LICENSE.GPL included in
+* the packaging of this file. Please review the following information
+* to ensure GNU General Public Licensing requirements will be met:
+* http://www.fsf.org/licensing/licenses/info/GPLv2.html and
+* http://www.gnu.org/copyleft/gpl.html.
+*/
+
+#include <QString>
+#include <QAtomicInt>
+
+namespace Vl
+{
+    class Trace
+    {
+        // this class is thread-safe
+        // Collects scoped events in the Chrome trace event format (see chrome://tracing or ui.perfetto.dev).
+        // The VL_TRACE macros are only compiled in if VL_ENABLE_TRACE is defined; even then a Scope only
+        // reads a flag as long as no output file is set.
+    public:
+        static void setOutput( const QString& path ); // empty path stops tracing; pending events are written
+        static QString getOutput();
+        static bool isEnabled() { return s_enabled != 0; }
+        static void flush(); // writes all events collected so far to the output file
+
+        class Scope
+        {
+        public:
+            Scope( const char* name, const QString& file = QString() );
+            ~Scope();
+        private:
+            Q_DISABLE_COPY(Scope)
+            const char* d_name;
+            QString d_file;
+            qint64 d_start; // in us, -1 if tracing is disabled
+        };
+    private:
+        Trace() {}
+        static qint64 now();
+        static void addEvent( const char* name, const QString& file, qint64 start, qint64 end );
+        static QAtomicInt s_enabled;
+    };
+}
+
+#define VL_TRACE_CAT2_(a,b) a##b
+#define VL_TRACE_CAT_(a,b) VL_TRACE_CAT2_(a,b)
+#ifdef VL_ENABLE_TRACE
+#define VL_TRACE(name) Vl::Trace::Scope VL_TRACE_CAT_(vlTrace_,__LINE__)(name)
+#define VL_TRACE_FILE(name,file) Vl::Trace::Scope VL_TRACE_CAT_(vlTrace_,__LINE__)(name,file)
+#else
+#define VL_TRACE(name)
+#define VL_TRACE_FILE(name,file)
+#endif
+
+#endif // VLTRACE_H
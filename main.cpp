@@ -17,20 +17,46 @@
 * http://www.gnu.org/copyleft/gpl.html.
 */
 
-#include <QApplication>
+#include <QCoreApplication>
 #include <QFile>
-#include <QtDebug>
 #include <QFileInfo>
 #include <QDir>
 #include <QElapsedTimer>
 #include <QThread>
-#include <QPlainTextEdit>
+#include <QTextStream>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QJsonArray>
 #include "VlErrors.h"
 #include "VlPpSymbols.h"
 #include "VlParser.h"
 #include "VlPpLexer.h"
+#include "VlIncludes.h"
 #include "VlCrossRefModel.h"
 #include "VlProjectConfig.h"
+#include "VlTrace.h"
+#include "VlIndexFile.h"
+#include "VlQueryServer.h"
+#include "VlFileCache.h"
+
+// Headless batch tool; the exit status is 0 if there are no errors, 1 if there are errors and 2 if the
+// command line or the input is invalid.
+
+enum Stage { LexOnly, ParseOnly, CrossRef };
+
+struct Options
+{
+    QStringList d_inputs;
+    QStringList d_defines; // NAME or NAME=VALUE
+    QStringList d_incDirs;
+    QString d_traceFile;
+    QString d_indexFile;
+    QString d_serve; // local socket name
+    int d_jobs;
+    Stage d_stage;
+    bool d_json;
+    Options():d_jobs(0),d_stage(CrossRef),d_json(false) {}
+};
 
 static QStringList collectFiles( const QDir& dir )
 {
@@ -50,171 +76,369 @@ static QStringList collectFiles( const QDir& dir )
     return res;
 }
 
-static bool readFile( const QString& path, bool resOnly )
+static QByteArray definesToCode( const QStringList& defines )
 {
-
-//#define LexerTest
-#ifdef LexerTest
-    qDebug() << "***** reading" << path;
-    QFile in( path );
-    if( !in.open(QIODevice::ReadOnly) )
+    // same form as ProjectConfig::getDefines
+    QByteArray res;
+    foreach( const QString& d, defines )
     {
-        qDebug() << "**** cannot open file" << path;
-        return false;
+        const int pos = d.indexOf('=');
+        res += "`define ";
+        if( pos == -1 )
+            res += d.toUtf8();
+        else
+            res += d.left(pos).toUtf8() + " " + d.mid(pos+1).toUtf8();
+        res += "\n";
     }
-    Vl::PpLexer lex;
-    Vl::PpSymbols s;
-    lex.setSyms(&s);
-    lex.setStream( &in, path );
+    return res;
+}
 
-    Vl::Token t = lex.nextToken();
-    while( true )
+static quint64 countTokens( const Vl::SynTree* st )
+{
+    // the leaves are the tokens the parser consumed, as counted by the xref stage
+    if( st->d_tok.d_type < Vl::SynTree::R_First )
+        return 1;
+    quint64 res = 0;
+    foreach( const Vl::SynTree* sub, st->d_children )
+        res += countTokens( sub );
+    return res;
+}
+
+// für QtConcurrent::run braucht man extra eine separate Library mit minimalem Mehrwert
+class FileWorker : public QThread
+{
+public:
+    QStringList d_files;
+    QByteArray d_defines;
+    Vl::Includes* d_incs;
+    Stage d_stage;
+    Vl::Errors d_errs;
+    quint64 d_tokens;
+    FileWorker():d_incs(0),d_stage(ParseOnly),d_errs(0,true),d_tokens(0)
     {
-        if( !resOnly )
-            qDebug() << t.getName() << t.d_lineNr << t.d_colNr << QString::fromLatin1(t.d_val);
-        if( t.isEof() )
-        {
-            qDebug() << "OK";
-            return true;
-        }
-        if( !t.isValid() )
+        d_errs.setReportToConsole(false);
+        d_errs.setRecord(true);
+    }
+    void run()
+    {
+        foreach( const QString& path, d_files )
         {
-            qDebug() << "FAILED" << t.d_lineNr << t.d_colNr << QString::fromLatin1(t.d_val);
-            return true;
+            VL_TRACE_FILE( d_stage == LexOnly ? "lex" : "parse", path );
+            // each file starts with the command line defines only, as if compiled separately
+            Vl::PpSymbols syms;
+            if( !d_defines.isEmpty() )
+            {
+                Vl::PpLexer def;
+                def.setSyms(&syms);
+                def.setErrors(&d_errs);
+                def.tokens( d_defines, QLatin1String("<command line>") );
+            }
+            Vl::PpLexer lex;
+            lex.setIgnoreAttrs(false);
+            lex.setPackAttrs(false);
+            lex.setSendMacroUsage(true);
+            lex.setErrors(&d_errs);
+            lex.setSyms(&syms);
+            lex.setIncs(d_incs);
+            if( !lex.setStream( path, true ) )
+                continue;
+            if( d_stage == LexOnly )
+            {
+                Vl::Token t = lex.nextToken();
+                while( !t.isEof() )
+                {
+                    d_tokens++;
+                    t = lex.nextToken();
+                }
+            }else
+            {
+                Vl::Parser p(&lex,&d_errs);
+                p.RunParser();
+                foreach( const Vl::SynTree* st, p.d_root.d_children )
+                    d_tokens += countTokens( st );
+            }
         }
-        t = lex.nextToken();
     }
-    in.close();
-    return true;
-#else
+};
 
+static void runFileWorkers( const QStringList& files, const Options& opt, Vl::Errors* errs, quint64* tokens )
+{
+    Vl::Includes incs;
+    foreach( const QString& dir, opt.d_incDirs )
+        incs.addDir( QDir(dir) );
+    const QByteArray defines = definesToCode( opt.d_defines );
 
-    Vl::Errors e;
-    e.setShowWarnings(false);
-    Vl::PpLexer lex;
-    static Vl::PpSymbols* s = 0;
-
-    if( s == 0 )
+    // interleaved distribution so that big files in the same directory end up on different threads
+    const int jobs = qMax( 1, qMin( opt.d_jobs, files.size() ) );
+    QList<FileWorker*> workers;
+    for( int i = 0; i < jobs; i++ )
     {
-        s = new Vl::PpSymbols();
-        // TEST e200
-        s->addSymbol( "DISABLE_SV_ASSERTION", "", Vl::Tok_Str );
-        s->addSymbol( "E203_MTVEC_TRAP_BASE", "0", Vl::Tok_Natural );
-        s->addSymbol( "E203_ITCM_DATA_WIDTH_IS_32", "1", Vl::Tok_Natural );
-        // TEST oh
-        s->addSymbol( "CFG_ASIC", "1", Vl::Tok_Natural );
-        s->addSymbol( "CFG_PLATFORM", "", Vl::Tok_Str );
+        FileWorker* w = new FileWorker();
+        w->d_defines = defines;
+        w->d_incs = &incs;
+        w->d_stage = opt.d_stage;
+        workers.append(w);
     }
-
-    lex.setIgnoreAttrs(false);
-    lex.setPackAttrs(false);
-    lex.setSendMacroUsage(true);
-    lex.setErrors(&e);
-    lex.setSyms(s);
-    lex.setStream( path, true );
-    Vl::Parser p(&lex,&e);
-    p.RunParser();
-
-    if( e.getErrCount() )
+    for( int i = 0; i < files.size(); i++ )
+        workers[ i % jobs ]->d_files.append( files[i] );
+    foreach( FileWorker* w, workers )
+        w->start();
+    foreach( FileWorker* w, workers )
     {
-        qDebug() << "*****" << e.getErrCount() << "errors in" << path;
-        return false;
+        w->wait();
+        errs->merge( w->d_errs );
+        *tokens += w->d_tokens;
+        delete w;
     }
-    return true;
-
-#endif
 }
 
-static void dumpErrors( Vl::Errors* errs )
+static QJsonArray toJson( const Vl::Errors::EntriesByFile& entries, const char* severity )
 {
-    if( errs->getErrCount() == 0 )
-    {
-        qDebug() << "***** no errors";
-        return;
-    } // else
-
-    Vl::Errors::EntriesByFile lbf = errs->getErrors();
+    QJsonArray res;
     Vl::Errors::EntriesByFile::const_iterator i;
-    for( i = lbf.begin(); i != lbf.end(); ++i )
+    for( i = entries.begin(); i != entries.end(); ++i )
     {
         foreach( const Vl::Errors::Entry& e, i.value() )
         {
-            qDebug() << QFileInfo(i.key()).fileName() << e.d_line << e.d_col << e.d_msg;
+            QJsonObject o;
+            o["file"] = i.key();
+            o["line"] = int(e.d_line);
+            o["col"] = int(e.d_col);
+            o["severity"] = QLatin1String(severity);
+            o["source"] = QLatin1String(Vl::Errors::sourceName(e.d_source));
+            o["message"] = e.getMsg();
+            res.append(o);
         }
     }
-    qDebug() << "*****" << errs->getErrCount() << "errors and" << errs->getWrnCount() << "warnings";
+    return res;
 }
 
-int main(int argc, char *argv[])
+static void printText( QTextStream& out, const Vl::Errors::EntriesByFile& entries, const char* severity )
+{
+    Vl::Errors::EntriesByFile::const_iterator i;
+    for( i = entries.begin(); i != entries.end(); ++i )
+    {
+        foreach( const Vl::Errors::Entry& e, i.value() )
+            out << i.key() << ":" << e.d_line << ":" << e.d_col << ": " << severity << ": " << e.getMsg() << endl;
+    }
+}
+
+static void printUsage( QTextStream& out )
 {
-    QApplication a(argc, argv);
+    out << "usage: Verilog [options] <file|directory|project.vlpro>..." << endl
+        << "  --stage lex|parse|xref  stop after lexing, parsing or do full cross-referencing (default)" << endl
+        << "  -j, --jobs N            number of threads (default: number of cores)" << endl
+        << "  -D NAME[=VALUE]         define a text macro" << endl
+        << "  -I DIR                  add an include directory" << endl
+        << "  --json                  print diagnostics and timing as JSON" << endl
+        << "  --index FILE            write the cross-reference index to FILE (xref stage)" << endl
+        << "  --serve NAME            keep the model and answer queries on local socket NAME (xref stage)" << endl
+        << "  --trace FILE            write Chrome trace events (if built with VL_ENABLE_TRACE)" << endl
+        << "  -p                      same as --stage xref" << endl;
+}
 
-    QString dirOrFilePath;
-    bool isProject = false;
-    const QStringList args = QApplication::arguments();
+static bool parseArgs( const QStringList& args, Options& opt, QTextStream& err )
+{
     for( int i = 1; i < args.size(); i++ ) // arg 0 enthaelt Anwendungspfad
     {
-        if( args[i].startsWith( "-p" ) )
-            isProject = true;
-        else if( !args[ i ].startsWith( '-' ) )
+        const QString& a = args[i];
+        const bool hasNext = i + 1 < args.size();
+        if( ( a == "-j" || a == "--jobs" ) && hasNext )
+            opt.d_jobs = args[++i].toInt();
+        else if( a.startsWith("--jobs=") )
+            opt.d_jobs = a.mid(7).toInt();
+        else if( a == "-D" && hasNext )
+            opt.d_defines.append( args[++i] );
+        else if( a.startsWith("-D") && a.size() > 2 )
+            opt.d_defines.append( a.mid(2) );
+        else if( a == "-I" && hasNext )
+            opt.d_incDirs.append( args[++i] );
+        else if( a.startsWith("-I") && a.size() > 2 )
+            opt.d_incDirs.append( a.mid(2) );
+        else if( a == "--stage" && hasNext )
         {
-            dirOrFilePath = args[ i ];
-        }else
+            const QString s = args[++i];
+            if( s == "lex" )
+                opt.d_stage = LexOnly;
+            else if( s == "parse" )
+                opt.d_stage = ParseOnly;
+            else if( s == "xref" )
+                opt.d_stage = CrossRef;
+            else
+            {
+                err << "invalid stage " << s << endl;
+                return false;
+            }
+        }else if( a == "--json" )
+            opt.d_json = true;
+        else if( ( a == "--trace" || a == "-trace" ) && hasNext )
+            opt.d_traceFile = args[++i];
+        else if( a == "--index" && hasNext )
+            opt.d_indexFile = args[++i];
+        else if( a == "--serve" && hasNext )
+            opt.d_serve = args[++i];
+        else if( a == "-p" )
+            opt.d_stage = CrossRef;
+        else if( a == "-h" || a == "--help" )
+            return false;
+        else if( !a.startsWith('-') )
+            opt.d_inputs.append( a );
+        else
         {
-            qDebug() << "invalid command line parameter" << args[i];
-            return -1;
+            err << "invalid command line parameter " << a << endl;
+            return false;
         }
     }
-    if( dirOrFilePath.isEmpty() )
+    if( opt.d_inputs.isEmpty() )
     {
-        qCritical() << "expecting a directory or file path";
-        return -1;
+        err << "expecting a directory, file or project path" << endl;
+        return false;
     }
+    if( opt.d_jobs <= 0 )
+        opt.d_jobs = QThread::idealThreadCount();
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QTextStream out(stdout);
+    QTextStream err(stderr);
 
-    QFileInfo info(dirOrFilePath);
+    Options opt;
+    if( !parseArgs( QCoreApplication::arguments(), opt, err ) )
+    {
+        printUsage( err );
+        return 2;
+    }
+    Vl::Trace::setOutput( opt.d_traceFile );
 
     QElapsedTimer t;
     t.start();
     QStringList files;
     Vl::ProjectConfig config;
-    if( info.isDir() )
+    foreach( const QString& input, opt.d_inputs )
     {
-        files = collectFiles( info.absoluteFilePath() );
-    }else if( info.suffix() == "vlpro" )
-    {
-        if( !config.loadFromFile( info.absoluteFilePath() ) )
+        QFileInfo info(input);
+        if( info.isDir() )
+            files += collectFiles( info.absoluteFilePath() );
+        else if( info.suffix() == "vlpro" )
         {
-            qCritical() << "error reading vlpro file";
-            return -1;
-        }else
-            isProject = true;
-    }else
-        files << info.absoluteFilePath();
-    int succ = 0;
-    if( isProject )
+            if( !config.getPath().isEmpty() || !config.loadFromFile( info.absoluteFilePath() ) )
+            {
+                err << "error reading vlpro file " << input << " (only one project is supported)" << endl;
+                return 2;
+            }
+            opt.d_incDirs += config.getIncDirs();
+        }else if( info.isFile() )
+            files << info.absoluteFilePath();
+        else
+        {
+            err << "cannot find " << input << endl;
+            return 2;
+        }
+    }
+
+    Vl::Errors errs(0,true);
+    errs.setReportToConsole(false);
+    errs.setRecord(true);
+    QJsonObject timing;
+    quint64 tokens = 0;
+    int fileCount = files.size() + config.getSrcFiles().size() + config.getLibFiles().size();
+    if( opt.d_stage == CrossRef )
     {
-        Vl::CrossRefModel m;
-        if( config.getPath().isEmpty() )
+        Vl::FileCache cache; // holds the unsaved editor content sent to the query server
+        Vl::CrossRefModel m( 0, &cache );
+        m.setResolverThreads( opt.d_jobs );
+        m.setKeepTokens( !opt.d_serve.isEmpty() ); // for the token queries of editors
+        m.setIndexNames( !opt.d_serve.isEmpty() ); // for the search query
+        m.getErrs()->setReportToConsole(false);
+        foreach( const QString& dir, opt.d_incDirs )
+            m.getIncs()->addDir( QDir(dir) );
+        if( !opt.d_defines.isEmpty() )
+            m.parseString( definesToCode( opt.d_defines ), QLatin1String("<command line>") );
+        if( !config.getPath().isEmpty() )
         {
-            qDebug() << "*****" << "parsing" << files.size() << "files";
-            m.updateFiles(files, true);
+            config.setup( &m, true );
+            if( !files.isEmpty() )
+                m.updateFiles( files, true );
         }else
+            m.updateFiles( files, true );
+        errs.merge( *m.getErrs() );
+        const Vl::CrossRefModel::Stats s = m.getStats();
+        // a project is updated in several batches (defines, project and library files)
+        timing["parseMs"] = double(s.d_allUpdates.d_parseMs);
+        timing["mergeMs"] = double(s.d_allUpdates.d_mergeMs);
+        timing["resolveMs"] = double(s.d_allUpdates.d_resolveMs);
+        timing["swapMs"] = double(s.d_allUpdates.d_swapMs);
+        tokens = s.d_total.d_tokens;
+        QString msg;
+        if( !opt.d_indexFile.isEmpty() && !Vl::IndexFile::write( &m, opt.d_indexFile, &msg ) )
         {
-            qDebug() << "*****" << "parsing" << config.getSrcFiles().size() + config.getLibFiles().size() << "files";
-            config.setup( &m, true );
+            err << "cannot write index file " << opt.d_indexFile << ": " << msg << endl;
+            return 2;
+        }
+        if( !opt.d_serve.isEmpty() )
+        {
+            Vl::QueryServer server( &m );
+            if( !server.listen( opt.d_serve ) )
+            {
+                err << "cannot listen on " << opt.d_serve << ": " << server.getError() << endl;
+                return 2;
+            }
+            m.setWatchFiles( true );
+            err << "serving " << fileCount << " files on " << server.getServerName() << endl;
+            QObject::connect( &server, SIGNAL(sigShutdown()), &a, SLOT(quit()) );
+            return a.exec();
         }
-        dumpErrors(m.getErrs());
     }else
     {
-        foreach( const QString& f, files )
+        if( !config.getPath().isEmpty() )
         {
-            if( readFile(f, false ) )
-                succ++;
+            files = config.getSrcFiles() + config.getLibFiles() + files;
+            QByteArray defs = config.getDefines().toUtf8();
+            // the project defines are passed the same way as the ones from the command line
+            foreach( const QByteArray& line, defs.split('\n') )
+            {
+                if( line.startsWith("`define ") )
+                {
+                    const QByteArray def = line.mid(8).trimmed();
+                    const int pos = def.indexOf(' ');
+                    opt.d_defines.append( pos == -1 ? QString::fromUtf8(def) :
+                                          QString::fromUtf8(def.left(pos) + "=" + def.mid(pos+1).trimmed()) );
+                }
+            }
         }
+        runFileWorkers( files, opt, &errs, &tokens );
     }
+    const qint64 total = t.elapsed();
+    Vl::Trace::flush();
 
-    if( !isProject )
-        qDebug() << "Elapsed time [ms]:" << t.elapsed() << "Success:" << succ << "/" << files.size();
+    const char* stages[] = { "lex", "parse", "xref" };
+    if( opt.d_json )
+    {
+        QJsonObject res;
+        res["stage"] = QLatin1String( stages[opt.d_stage] );
+        res["files"] = fileCount;
+        res["tokens"] = double(tokens);
+        res["jobs"] = opt.d_jobs;
+        res["errors"] = int(errs.getErrCount());
+        res["warnings"] = int(errs.getWrnCount());
+        timing["totalMs"] = double(total);
+        res["timing"] = timing;
+        QJsonArray diags = toJson( errs.getErrors(), "error" );
+        foreach( const QJsonValue& v, toJson( errs.getWarnings(), "warning" ) )
+            diags.append( v );
+        res["diagnostics"] = diags;
+        out << QJsonDocument(res).toJson();
+    }else
+    {
+        printText( out, errs.getErrors(), "error" );
+        printText( out, errs.getWarnings(), "warning" );
+        out << stages[opt.d_stage] << ": " << fileCount << " files, " << errs.getErrCount() << " errors, "
+            << errs.getWrnCount() << " warnings in " << total << " ms" << endl;
+    }
+    out.flush();
 
-    return 0 ; // a.exec(); // TEST
+    return errs.getErrCount() == 0 ? 0 : 1;
 }